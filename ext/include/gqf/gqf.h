@@ -116,6 +116,9 @@ extern "C" {
 		 value, into qf. */
 	uint64_t qf_count_key_value(const QF *qf, uint64_t key, uint64_t value, bool lock);
 
+	/* Hint the CPU to load the block where the lookup of key starts. */
+	void qf_prefetch(const QF *qf, uint64_t key);
+
 	/* Initialize an iterator */
 	bool qf_iterator(QF *qf, QFi *qfi, uint64_t position);
 
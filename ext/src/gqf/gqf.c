@@ -1630,6 +1630,12 @@ bool qf_insert(QF *qf, uint64_t key, uint64_t value, uint64_t count, bool
 		return insert(qf, key, count, lock, spin);
 }
 
+void qf_prefetch(const QF *qf, uint64_t key)
+{
+	uint64_t hash_bucket_index = key >> qf->metadata->bits_per_slot;
+	__builtin_prefetch(get_block(qf, hash_bucket_index / SLOTS_PER_BLOCK));
+}
+
 uint64_t qf_count_key_value(const QF *qf, uint64_t key, uint64_t value,
                             bool lock)
 {
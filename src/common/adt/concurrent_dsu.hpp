@@ -9,6 +9,9 @@
 #ifndef CONCURRENTDSU_HPP_
 #define CONCURRENTDSU_HPP_
 
+#include "utils/parallel/openmp_wrapper.h"
+#include "utils/verify.hpp"
+
 #include <algorithm>
 #include <atomic>
 #include <string>
@@ -202,23 +205,93 @@ public:
     size_t extract_to_file(const std::string &Prefix);
 
     void get_sets(std::vector<std::vector<size_t> > &otherWay) {
-        otherWay.resize(data_.size());
-        for (size_t i = 0; i < data_.size(); i++) {
-            size_t set = find_set(i);
-            otherWay[set].push_back(i);
-        }
-        otherWay.erase(remove_if(otherWay.begin(), otherWay.end(), zero_size),
-                       otherWay.end());
+        std::vector<size_t> elements(data_.size());
+        std::vector<size_t> ends = group_sets(elements.data());
+
+        size_t start = otherWay.size();
+        otherWay.resize(start + ends.size());
+#       pragma omp parallel for schedule(dynamic, 1024)
+        for (size_t i = 0; i < ends.size(); ++i)
+            otherWay[start + i].assign(elements.begin() + (i ? ends[i - 1] : 0), elements.begin() + ends[i]);
     }
 
 private:
-    size_t parent(size_t x) const {
-        atomic_set_t val = data_[x];
-        return (val.root ? x : val.data);
+    // Parallel exclusive prefix sum in place, returns the total
+    static size_t exclusive_scan(std::vector<size_t> &v) {
+        size_t nchunks = omp_get_max_threads();
+        size_t chunk = (v.size() + nchunks - 1) / nchunks;
+        std::vector<size_t> totals(nchunks + 1, 0);
+#       pragma omp parallel for
+        for (size_t c = 0; c < nchunks; ++c) {
+            for (size_t i = c * chunk; i < std::min(v.size(), (c + 1) * chunk); ++i)
+                totals[c + 1] += v[i];
+        }
+        for (size_t c = 0; c < nchunks; ++c)
+            totals[c + 1] += totals[c];
+#       pragma omp parallel for
+        for (size_t c = 0; c < nchunks; ++c) {
+            size_t sum = totals[c];
+            for (size_t i = c * chunk; i < std::min(v.size(), (c + 1) * chunk); ++i) {
+                size_t cur = v[i];
+                v[i] = sum;
+                sum += cur;
+            }
+        }
+        return totals.back();
     }
 
-    static bool zero_size(const std::vector<size_t> &v) {
-        return v.size() == 0;
+    // Scatters the elements to out (of size()) grouped by sets: sets go in the order of their roots,
+    // elements of every set in increasing order. Returns the ends of the sets in out.
+    // Root ranks are prefix sums of the per-word root masks, set sizes are taken from the roots,
+    // so no per-set lookup structure is needed.
+    std::vector<size_t> group_sets(size_t *out) const {
+        size_t size = data_.size();
+        // First, touch all the sets to make them directly connect to the root
+#       pragma omp parallel for
+        for (size_t x = 0; x < size; ++x)
+            (void) find_set(x);
+
+        size_t nwords = (size + 63) / 64;
+        std::vector<uint64_t> roots(nwords);
+        std::vector<size_t> ranks(nwords);
+#       pragma omp parallel for
+        for (size_t w = 0; w < nwords; ++w) {
+            uint64_t mask = 0;
+            for (size_t x = w * 64; x < std::min(size, (w + 1) * 64); ++x)
+                mask |= uint64_t(is_root(x)) << (x % 64);
+            roots[w] = mask;
+            ranks[w] = __builtin_popcountll(mask);
+        }
+        size_t nsets = exclusive_scan(ranks);
+        auto rank = [&](size_t x) {
+            return ranks[x / 64] + __builtin_popcountll(roots[x / 64] & ((uint64_t(1) << (x % 64)) - 1));
+        };
+
+        std::vector<size_t> ends(nsets);
+#       pragma omp parallel for
+        for (size_t x = 0; x < size; ++x) {
+            atomic_set_t entry = data_[x];
+            if (entry.root)
+                ends[rank(x)] = entry.data;
+        }
+        size_t total = exclusive_scan(ends);
+        VERIFY(total == size);
+
+        // Now ends are the starts, advance them while scattering
+#       pragma omp parallel for
+        for (size_t x = 0; x < size; ++x) {
+            size_t pos;
+            size_t &end = ends[rank(find_set(x))];
+#           pragma omp atomic capture
+            pos = end++;
+            out[pos] = x;
+        }
+
+#       pragma omp parallel for schedule(dynamic, 1024)
+        for (size_t i = 0; i < nsets; ++i)
+            std::sort(out + (i ? ends[i - 1] : 0), out + ends[i]);
+
+        return ends;
     }
 
     mutable std::vector<std::atomic<atomic_set_t> > data_;
@@ -100,6 +100,11 @@ class cqf {
         return qf_count_key_value(&qf_, d & range_mask_, 0, lock);
     }
 
+    // Issue before lookup(d) to overlap the memory accesses of several lookups
+    void prefetch(digest d) const {
+        qf_prefetch(&qf_, d & range_mask_);
+    }
+
 private:
     void merge(QF *qf, QF *other) {
         QFi other_cfi;
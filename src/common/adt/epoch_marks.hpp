@@ -0,0 +1,47 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace adt {
+
+/**
+ * Set of small integer ids (e.g. graph element int_id's) kept as a stamp array.
+ * Clear is O(1): it just starts a new epoch, so the instance is meant to be kept
+ * per thread and reused between the searches. Memory grows up to the largest marked id.
+ */
+class EpochMarks {
+    std::vector<unsigned> stamp_;
+    unsigned epoch_ = 1;
+
+public:
+    void clear() {
+        if (++epoch_ == 0) {
+            std::fill(stamp_.begin(), stamp_.end(), 0);
+            epoch_ = 1;
+        }
+    }
+
+    bool count(size_t id) const {
+        return id < stamp_.size() && stamp_[id] == epoch_;
+    }
+
+    //returns true iff id was not marked before
+    bool insert(size_t id) {
+        if (id >= stamp_.size())
+            stamp_.resize(std::max(id + 1, 2 * stamp_.size()), 0);
+        if (stamp_[id] == epoch_)
+            return false;
+        stamp_[id] = epoch_;
+        return true;
+    }
+};
+
+}
@@ -13,6 +13,7 @@
 #include "assembly_graph/core/graph.hpp"
 #include "assembly_graph/core/action_handlers.hpp"
 #include "assembly_graph/index/edge_info_updater.hpp"
+#include "assembly_graph/index/edge_remap_log.hpp"
 
 #include <limits>
 #include <utility>
@@ -28,6 +29,8 @@ namespace debruijn_graph {
 /**
  * EdgeIndex is a structure to store info about location of certain k-mers in graph. It delegates all
  * container procedures to inner_index_ and all handling procedures to updater_.
+ * In deferred mode (see Defer) graph modifications are only recorded into log_, lookups are
+ * resolved through it and Compact applies it to the index in parallel.
  */
 template<class Graph>
 class EdgeIndex: public omnigraph::GraphActionHandler<Graph> {
@@ -46,9 +49,58 @@ private:
     EdgeInfoUpdater<Graph> updater_;
     EdgeIndexRefiller refiller_;
 
+    bool deferred_;
+    EdgeRemapLog<Graph> log_;
+
+    // Index values as they would be after the log is applied
+    template<class Index>
+    class RemappedValues {
+        typedef typename Index::KmerPos KmerPos;
+        const Index &index_;
+        const EdgeRemapLog<Graph> &log_;
+
+    public:
+        RemappedValues(const Index &index, const EdgeRemapLog<Graph> &log)
+                : index_(index), log_(log) {}
+
+        KmerPos operator[](size_t idx) const {
+            const KmerPos &entry = index_.values()[idx];
+            if (!entry.valid())
+                return entry;
+
+            auto pos = log_.Resolve(entry.edge(), entry.offset());
+            if (pos.first == EdgeId())
+                return KmerPos();
+            return KmerPos(pos.first, unsigned(pos.second));
+        }
+    };
+
+    template<class Index>
+    typename Index::KmerPos get_remapped(const Index *index, const typename Index::KeyWithHash &kwh) const {
+        if (!index->valid(kwh))
+            return typename Index::KmerPos();
+
+        return Index::storing_type::get_value(RemappedValues<Index>(*index, log_), kwh,
+                                              GraphInverter<Graph>(this->g(), index->k()));
+    }
+
+    template<class Index>
+    bool contains_remapped(const Index *index, const typename Index::KeyWithHash &kwh) const {
+        auto entry = get_remapped(index, kwh);
+        return entry.valid() && this->g().EdgeNucls(entry.edge()).contains(kwh.key(), entry.offset());
+    }
+
     template<class Index>
     std::pair<EdgeId, size_t> get(const Index *index, const KMer& kmer) const {
         auto kwh = index->ConstructKWH(kmer);
+        if (!log_.empty()) {
+            if (contains_remapped(index, kwh)) {
+                auto entry = get_remapped(index, kwh);
+                return { entry.edge(), (size_t)entry.offset() };
+            }
+            return { EdgeId(), NOT_FOUND };
+        }
+
         if (index->contains(kwh)) {
             auto entry = index->get_value(kwh);
             return { entry.edge(), (size_t)entry.offset() };
@@ -59,6 +111,9 @@ private:
 
     template<class Index>
     bool contains(const Index *index, const KMer& kmer) const {
+        if (!log_.empty())
+            return contains_remapped(index, index->ConstructKWH(kmer));
+
         return index->contains(index->ConstructKWH(kmer));
     }
 
@@ -72,6 +127,39 @@ private:
         updater_.DeleteKmers(this->g(), e, *index);
     }
 
+    template<class Index>
+    void ApplyLog(Index *index) {
+        auto &values = index->values();
+#       pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < values.size(); ++i) {
+            auto &entry = values[i];
+            if (!entry.valid())
+                continue;
+
+            auto pos = log_.Resolve(entry.edge(), entry.offset());
+            if (pos.first == EdgeId())
+                entry.clear();
+            else if (pos.first != entry.edge())
+                entry = typename Index::KmerPos(pos.first, unsigned(pos.second));
+        }
+
+        // k-mers of the added edges might have been moved as well, so they are put at their current positions
+        const auto &added = log_.added();
+#       pragma omp parallel for schedule(guided)
+        for (size_t i = 0; i < added.size(); ++i) {
+            for (size_t offset = 0; offset < added[i].second; ++offset) {
+                auto pos = log_.Resolve(added[i].first, offset);
+                if (pos.first == EdgeId())
+                    continue;
+
+                auto kwh = index->ConstructKWH(KMer(index->k(), this->g().EdgeNucls(pos.first), pos.second));
+                if (kwh.is_minimal())
+                    index->PutInIndex(kwh, pos.first, pos.second);
+            }
+        }
+        log_.clear();
+    }
+
     template<class Index>
     void clear(Index *index) {
         if (!inner_index_)
@@ -128,7 +216,7 @@ public:
     EdgeIndex(const Graph& g, const std::filesystem::path &workdir)
             : omnigraph::GraphActionHandler<Graph>(g, "EdgeIndex"),
               large_index_(true), inner_index_(nullptr),
-              refiller_(workdir) {
+              refiller_(workdir), deferred_(false) {
         INFO("Size of edge index entries: "
              << sizeof(typename InnerIndex64::KmerPos) << "/"
              << sizeof(typename InnerIndex32::KmerPos));
@@ -153,13 +241,70 @@ public:
     } while(0)
 
     void HandleAdd(EdgeId e) override {
+        if (deferred_) {
+            CheckRecycled(e);
+            log_.Add(e, this->g().length(e));
+            return;
+        }
         DISPATCH_TO(UpdateKmers, e);
     }
 
     void HandleDelete(EdgeId e) override {
+        if (deferred_) {
+            log_.Remove(e);
+            return;
+        }
         DISPATCH_TO(DeleteKmers, e);
     }
 
+    void HandleMerge(const std::vector<EdgeId> &old_edges, EdgeId new_edge) override {
+        if (!deferred_)
+            return;
+
+        CheckRecycled(new_edge);
+        size_t total = 0;
+        for (EdgeId e : old_edges)
+            total += this->g().length(e);
+        // Merge with non-standard overlaps, the old k-mers are forgotten and the new edge is indexed from scratch
+        if (total != this->g().length(new_edge))
+            return;
+
+        size_t shift = 0;
+        for (EdgeId e : old_edges) {
+            log_.Move(e, new_edge, shift);
+            shift += this->g().length(e);
+        }
+    }
+
+    void HandleGlue(EdgeId new_edge, EdgeId edge1, EdgeId edge2) override {
+        if (!deferred_)
+            return;
+
+        // There will be no separate notification for the conjugate glue
+        bool self_conjugate = edge1 == this->g().conjugate(edge1);
+        CheckRecycled(new_edge);
+        if (self_conjugate)
+            CheckRecycled(this->g().conjugate(new_edge));
+
+        log_.Move(edge2, new_edge, 0);
+        log_.Remove(edge1);
+        if (self_conjugate)
+            log_.Move(this->g().conjugate(edge2), this->g().conjugate(new_edge), 0);
+    }
+
+    void HandleSplit(EdgeId old_edge, EdgeId new_edge_1, EdgeId new_edge_2) override {
+        if (!deferred_)
+            return;
+
+        CheckRecycled(new_edge_1);
+        CheckRecycled(new_edge_2);
+        // Self-conjugate edge is split into three, its new edges are indexed from scratch
+        if (old_edge == this->g().conjugate(old_edge))
+            return;
+
+        log_.Split(old_edge, new_edge_1, new_edge_2, this->g().length(new_edge_1));
+    }
+
     bool contains(const KMer& kmer) const {
         DISPATCH_TO(contains, kmer);
     }
@@ -199,10 +344,49 @@ public:
         INFO("Index refilled");
     }
 
+    /**
+     * Switches to deferred maintenance: graph modifications are only logged, lookups are resolved
+     * through the log. K-mers of the edges which are not derived from the existing ones
+     * (e.g. added by AddEdge) are not found until Compact.
+     */
+    void Defer() {
+        VERIFY(inner_index_);
+        deferred_ = true;
+    }
+
+    bool deferred() const {
+        return deferred_;
+    }
+
+    // Applies the log to the index and switches back to immediate maintenance
+    void Compact() {
+        if (!deferred_)
+            return;
+
+        INFO("Applying postponed edge index updates");
+        ApplyLog();
+        deferred_ = false;
+    }
+
     void clear() {
+        log_ = EdgeRemapLog<Graph>();
+        deferred_ = false;
         DISPATCH_TO(clear);
     }
 
+private:
+    void ApplyLog() {
+        if (!log_.empty())
+            DISPATCH_TO(ApplyLog);
+    }
+
+    // Ids are reused by the graph, so the log is applied before the id of the removed edge reappears
+    void CheckRecycled(EdgeId e) {
+        if (log_.remapped(e))
+            ApplyLog();
+    }
+
+public:
     static bool IsInvertable() {
         static_assert(InnerIndex32::storing_type::IsInvertable() == InnerIndex64::storing_type::IsInvertable(),
                       "Indices must be compatible");
@@ -211,6 +395,7 @@ public:
 
     template<class Writer>
     void BinWrite(Writer &writer) const {
+        VERIFY_MSG(log_.empty(), "Edge index should be compacted before saving");
         writer << large_index_;
         DISPATCH_TO(BinWrite, writer);
     }
@@ -16,6 +16,8 @@
 #include "alignment/gap_info.hpp"
 #include "assembly_graph/graph_support/basic_vertex_conditions.hpp"
 
+#include <parallel_hashmap/phmap.h>
+
 #include <algorithm>
 #include <set>
 #include <vector>
@@ -290,29 +292,6 @@ class PacBioMappingIndex {
         return res;
     }
 
-    std::vector<std::vector<bool>> FillConnectionsTable(const RangeSet &mapping_descr) const {
-        size_t len =  mapping_descr.size();
-        TRACE("getting colors, table size " << len);
-        std::vector<std::vector<bool>> cons_table(len);
-        for (size_t i = 0; i < len; i++) {
-            cons_table[i].resize(len);
-            cons_table[i][i] = 0;
-        }
-        size_t i = 0;
-        for (auto i_iter = mapping_descr.begin(); i_iter != mapping_descr.end();
-                ++i_iter, ++i) {
-            size_t j = i;
-            for (auto j_iter = i_iter;
-                    j_iter != mapping_descr.end(); ++j_iter, ++j) {
-                if (i_iter == j_iter)
-                    continue;
-                cons_table[i][j] = IsConsistent(*i_iter, *j_iter);
-            }
-        }
-        return cons_table;
-    }
-
-
 //Currently unused but useful for debug purposes
     std::string DebugEmptyBestScoredPath(VertexId start_v, VertexId end_v, EdgeId prev_edge, EdgeId cur_edge,
                                          size_t prev_last_edge_position, size_t cur_first_edge_position, int seq_len) const {
@@ -325,39 +304,79 @@ class PacBioMappingIndex {
     }
 
 
+  public:
 //former GetWeightedColors
+//Chains of anchors (sorted by read position) are extracted greedily by weight with the DP.
+//Consistency of the anchor pairs is evaluated on demand and memoized. Anchors which end too far in read
+//from the beginning of the current one are inconsistent with it (see IsConsistent), so only the ones
+//on the same edge are looked at beyond this window.
+//Extraction of a chain does not change the DP values of the anchors before its first one,
+//so the next round recomputes the DP starting from there.
     std::vector<ColoredRange> GetRangedColors(const io::SingleRead &read) const {
-        Sequence s = read.sequence();
-        RangeSet mapping_descr = GetBWAClusters(read);
+        return GetRangedColors(GetBWAClusters(read));
+    }
+
+    std::vector<ColoredRange> GetRangedColors(const RangeSet &mapping_descr) const {
+        std::vector<QualityRange> ranges(mapping_descr.begin(), mapping_descr.end());
 
-        size_t len = mapping_descr.size();
+        size_t len = ranges.size();
         std::vector<int> colors(len, static_cast<int>(InvalidColors::UNDEF_COLOR));
-        std::vector<double> cluster_size(len) ;
-        size_t ii = 0;
-        for (const auto &cl : mapping_descr) {
-            cluster_size[ii++] = cl.size * cl.quality;
+        std::vector<double> cluster_size(len);
+        for (size_t i = 0; i < len; ++i) {
+            cluster_size[i] = ranges[i].size * ranges[i].quality;
         }
-        const auto cons_table = FillConnectionsTable(mapping_descr);
+
+        //anchors before look_back[i] end too far from the i-th one in read
+        std::vector<size_t> look_back(len);
+        std::vector<int> max_end(len);
+        phmap::flat_hash_map<EdgeId, std::vector<size_t>> same_edge;
+        for (size_t i = 0; i < len; ++i) {
+            const QualityRange &r = ranges[i];
+            int end = r.sorted_positions[r.last_trustable_index].read_position;
+            max_end[i] = i ? std::max(max_end[i - 1], end) : end;
+            int start = r.sorted_positions[r.first_trustable_index].read_position;
+            look_back[i] = std::partition_point(max_end.begin(), max_end.begin() + i, [&](int e) {
+                return e + (int) pb_config_.max_path_in_dijkstra < start;
+            }) - max_end.begin();
+            same_edge[r.edgeId].push_back(i);
+        }
+
+        phmap::flat_hash_map<size_t, bool> cons_cache;
+        auto consistent = [&](size_t j, size_t i) {
+            auto it = cons_cache.find(j * len + i);
+            if (it != cons_cache.end())
+                return it->second;
+            bool res = IsConsistent(ranges[j], ranges[i]);
+            cons_cache.emplace(j * len + i, res);
+            return res;
+        };
 
         std::vector<double> max_size(len);
         std::vector<size_t> prev(len);
 
         int cur_color = 0;
         int num_colors = 0;
+        //DP values before are up to date
+        size_t from = 0;
         while (true) {
-            for (size_t i = 0; i < len; ++i) {
+            for (size_t i = from; i < len; ++i) {
                 max_size[i] = 0;
                 prev[i] = size_t(-1);
-            }
-            for (size_t i = 0; i < len; ++i) {
                 if (colors[i] != static_cast<int>(InvalidColors::UNDEF_COLOR)) continue;
                 max_size[i] = cluster_size[i];
-                for (size_t j = 0; j < i; j++) {
-                    if (colors[j] != -1) continue;
-                    if (cons_table[j][i] && math::ls(max_size[i], cluster_size[i] + max_size[j])) {
+                auto relax = [&](size_t j) {
+                    if (colors[j] != -1) return;
+                    if (math::ls(max_size[i], cluster_size[i] + max_size[j]) && consistent(j, i)) {
                         max_size[i] = max_size[j] + cluster_size[i];
                         prev[i] = j;
                     }
+                };
+                for (size_t j : same_edge[ranges[i].edgeId]) {
+                    if (j >= look_back[i]) break;
+                    relax(j);
+                }
+                for (size_t j = look_back[i]; j < i; j++) {
+                    relax(j);
                 }
             }
             double maxx = 0;
@@ -381,6 +400,7 @@ class PacBioMappingIndex {
                 maxi = int(prev[maxi]);
                 colors[maxi] = cur_color;
             }
+            from = maxi;
             while (real_maxi >= min_i) {
                 if (colors[real_maxi] == static_cast<int>(InvalidColors::UNDEF_COLOR)) {
                     colors[real_maxi] = static_cast<int>(InvalidColors::DELETED_COLOR);
@@ -388,15 +408,15 @@ class PacBioMappingIndex {
                 real_maxi--;
             }
         }
-        DEBUG("Num hits clusters=" << num_colors);
+        DEBUG("Num hits clusters=" << num_colors << ", consistency checks=" << cons_cache.size());
         std::vector<ColoredRange> res;
-        size_t ind = 0;
-        for ( auto i_iter = mapping_descr.begin(); i_iter != mapping_descr.end(); ++i_iter, ++ind) {
-            res.push_back(std::make_pair(*i_iter, colors[ind]));
+        for (size_t i = 0; i < len; ++i) {
+            res.push_back(std::make_pair(ranges[i], colors[i]));
         }
         return res;
     }
 
+  private:
     size_t GetDistance(VertexId start_v, VertexId end_v,
                        bool update_cache = true) const {
         size_t result = size_t(-1);
@@ -430,6 +450,7 @@ class PacBioMappingIndex {
         return result;
     }
 
+  public:
     bool IsConsistent(const QualityRange &a,
                       const QualityRange &b) const {
         EdgeId a_edge = a.edgeId;
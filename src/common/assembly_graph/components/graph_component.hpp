@@ -8,77 +8,111 @@
 
 #pragma once
 
+#include "adt/flat_set.hpp"
 #include "utils/verify.hpp"
 
-#include <set>
+#include <algorithm>
 #include <string>
+#include <vector>
 
 namespace omnigraph {
 
+/**
+ * Vertices and edges are kept in sorted vectors, entrances and exits are computed on the first request.
+ * Hence the first call of exits(), entrances() or IsBorder() should not race with other calls.
+ */
 template<class Graph>
 class GraphComponent {
     typedef typename Graph::VertexId VertexId;
     typedef typename Graph::EdgeId EdgeId;
-    typedef typename std::set<VertexId>::const_iterator vertex_iterator;
-    typedef typename std::set<EdgeId>::const_iterator edge_iterator;
+public:
+    typedef adt::flat_set<VertexId> VertexSet;
+    typedef adt::flat_set<EdgeId> EdgeSet;
+private:
+    typedef typename VertexSet::const_iterator vertex_iterator;
+    typedef typename EdgeSet::const_iterator edge_iterator;
     const Graph& graph_;
-    std::set<VertexId> vertices_;
-    std::set<EdgeId> edges_;
-    std::set<VertexId> exits_;
-    std::set<VertexId> entrances_;
+    VertexSet vertices_;
+    EdgeSet edges_;
+    mutable VertexSet exits_;
+    mutable VertexSet entrances_;
+    mutable bool borders_found_;
     std::string name_;
 
+    template<class T>
+    static adt::flat_set<T> SortedSet(std::vector<T> &&elements) {
+        std::sort(elements.begin(), elements.end());
+        elements.erase(std::unique(elements.begin(), elements.end()), elements.end());
+        return adt::flat_set<T>(elements.begin(), elements.end());
+    }
+
     template<class VertexIt>
     void FillVertices(VertexIt begin, VertexIt end, bool add_conjugate = false) {
+        std::vector<VertexId> vertices;
         for (auto it = begin; it != end; ++it) {
-            vertices_.insert(*it);
+            vertices.push_back(*it);
             if (add_conjugate)
-                vertices_.insert(graph_.conjugate(*it));
+                vertices.push_back(graph_.conjugate(*it));
         }
+        vertices_ = SortedSet(std::move(vertices));
     }
 
     template<class EdgeIt>
     void FillEdges(EdgeIt begin, EdgeIt end, bool add_conjugate = false) {
+        std::vector<EdgeId> edges;
         for (auto it = begin; it != end; ++it) {
-            edges_.insert(*it);
+            edges.push_back(*it);
             if (add_conjugate)
-                edges_.insert(graph_.conjugate(*it));
+                edges.push_back(graph_.conjugate(*it));
         }
+        edges_ = SortedSet(std::move(edges));
     }
 
     void FillInducedEdges() {
+        std::vector<EdgeId> edges;
         for (VertexId v : vertices_) {
             for (EdgeId e : graph_.OutgoingEdges(v)) {
                 if (vertices_.count(graph_.EdgeEnd(e)) > 0) {
-                    edges_.insert(e);
+                    edges.push_back(e);
                 }
             }
         }
+        edges_ = SortedSet(std::move(edges));
     }
 
     void FillRelevantVertices() {
+        std::vector<VertexId> vertices;
+        vertices.reserve(2 * edges_.size());
         for (EdgeId e : edges_) {
-            vertices_.insert(graph_.EdgeStart(e));
-            vertices_.insert(graph_.EdgeEnd(e));
+            vertices.push_back(graph_.EdgeStart(e));
+            vertices.push_back(graph_.EdgeEnd(e));
         }
+        vertices_ = SortedSet(std::move(vertices));
     }
 
-    void FindEntrancesAndExits() {
+    void FindEntrancesAndExits() const {
+        if (borders_found_)
+            return;
+        //vertices are processed in sorted order, so the borders are filled sorted
+        std::vector<VertexId> entrances, exits;
         for (auto v : vertices_) {
             for (auto e : graph_.IncomingEdges(v)) {
                 if (!contains(e)) {
-                    entrances_.insert(v);
+                    entrances.push_back(v);
                     break;
                 }
             }
 
             for (auto e : graph_.OutgoingEdges(v)) {
                 if (!contains(e)) {
-                    exits_.insert(v);
+                    exits.push_back(v);
                     break;
                 }
             }
         }
+        entrances_ = VertexSet(entrances.begin(), entrances.end());
+        exits_ = VertexSet(exits.begin(), exits.end());
+        borders_found_ = true;
     }
 
     void Swap(GraphComponent<Graph> &that) {
@@ -88,6 +122,7 @@ class GraphComponent {
         std::swap(this->edges_, that.edges_);
         std::swap(this->exits_, that.exits_);
         std::swap(this->entrances_, that.entrances_);
+        std::swap(this->borders_found_, that.borders_found_);
     }
 
     template<class EdgeIt>
@@ -95,7 +130,6 @@ class GraphComponent {
                        bool add_conjugate) {
         FillEdges(begin, end, add_conjugate);
         FillRelevantVertices();
-        FindEntrancesAndExits();
     }
 
     GraphComponent<Graph> &operator=(const GraphComponent<Graph> &);
@@ -109,7 +143,6 @@ public:
         GraphComponent answer(g, name);
         answer.FillVertices(begin, end, add_conjugate);
         answer.FillInducedEdges();
-        answer.FindEntrancesAndExits();
         return answer;
     }
 
@@ -142,17 +175,17 @@ public:
     }
 
     GraphComponent(const Graph &g, const std::string &name = "") :
-            graph_(g), name_(name) {
+            graph_(g), borders_found_(false), name_(name) {
     }
 
     //may be used for conjugate closure
     GraphComponent(const GraphComponent& component,
                    bool add_conjugate,
-                   const std::string &name = "") : graph_(component.graph_), name_(name) {
+                   const std::string &name = "") : graph_(component.graph_), borders_found_(false), name_(name) {
         FillFromEdges(component.e_begin(), component.e_end(), add_conjugate);
     }
 
-    GraphComponent(GraphComponent&& that) : graph_(that.graph_) {
+    GraphComponent(GraphComponent&& that) : graph_(that.graph_), borders_found_(false) {
         Swap(that);
     }
 
@@ -193,11 +226,11 @@ public:
         return edges_.end();
     }
 
-    const std::set<EdgeId>& edges() const {
+    const EdgeSet& edges() const {
         return edges_;
     }
 
-    const std::set<VertexId>& vertices() const{
+    const VertexSet& vertices() const{
         return vertices_;
     }
 
@@ -209,15 +242,18 @@ public:
         return vertices_.end();
     }
 
-    const std::set<VertexId>& exits() const {
+    const VertexSet& exits() const {
+        FindEntrancesAndExits();
         return exits_;
     }
 
-    const std::set<VertexId>& entrances() const {
+    const VertexSet& entrances() const {
+        FindEntrancesAndExits();
         return entrances_;
     }
 
     bool IsBorder(VertexId v) const {
+        FindEntrancesAndExits();
         return exits_.count(v) || entrances_.count(v);
     }
 
@@ -12,6 +12,14 @@
 #include "assembly_graph/dijkstra/dijkstra_helper.hpp"
 #include "component_filters.hpp"
 
+#include "adt/epoch_marks.hpp"
+#include "utils/parallel/openmp_wrapper.h"
+
+#include <parallel_hashmap/phmap.h>
+
+#include <atomic>
+#include <deque>
+
 namespace omnigraph {
 
 
@@ -109,7 +117,7 @@ class RangeIterator : public RelaxingIterator<typename std::iterator_traits<It>:
 private:
     typedef typename std::iterator_traits<It>::value_type Element;
     It current_, end_;
-    std::set<Element> relaxed_;
+    phmap::flat_hash_set<Element> relaxed_;
 public:
     RangeIterator(It begin, It end)
             : current_(std::move(begin)), end_(std::move(end)) {
@@ -210,8 +218,20 @@ template<class Graph>
 class AbstractNeighbourhoodFinder {
 private:
     const Graph &graph_;
+    mutable std::vector<adt::EpochMarks> marks_;
+
+protected:
+    //per-thread visited marks, cleared
+    adt::EpochMarks &marks() const {
+        size_t tid = omp_get_thread_num();
+        VERIFY(tid < marks_.size());
+        marks_[tid].clear();
+        return marks_[tid];
+    }
+
 public:
-    AbstractNeighbourhoodFinder(const Graph &graph) : graph_(graph) {
+    AbstractNeighbourhoodFinder(const Graph &graph)
+            : graph_(graph), marks_(omp_get_max_threads()) {
     }
 
     const Graph &graph() const {
@@ -222,6 +242,11 @@ public:
 
     virtual std::vector<typename Graph::VertexId> InnerVertices(const GraphComponent<Graph> &component) const = 0;
 
+    //false if InnerVertices depends on the state left by the last Find
+    virtual bool ThreadSafe() const {
+        return true;
+    }
+
     virtual ~AbstractNeighbourhoodFinder() {
     }
 };
@@ -241,26 +266,25 @@ public:
               edge_length_bound_(edge_length_bound) {
     }
 
-    void CloseComponent(std::set<VertexId> &component) const {
-        std::set<VertexId> additional_vertices;
-        for (auto it = component.begin(); it != component.end(); ++it) {
-            for (EdgeId e : graph_.OutgoingEdges(*it)) {
+    //appends the ends of long edges incident to the component, duplicates are possible
+    void CloseComponent(std::vector<VertexId> &component) const {
+        size_t size = component.size();
+        for (size_t i = 0; i < size; ++i) {
+            for (EdgeId e : graph_.OutgoingEdges(component[i])) {
                 if (graph_.length(e) >= edge_length_bound_) {
-                    additional_vertices.insert(graph_.EdgeEnd(e));
+                    component.push_back(graph_.EdgeEnd(e));
                 }
             }
-            for (EdgeId e : graph_.IncomingEdges(*it)) {
+            for (EdgeId e : graph_.IncomingEdges(component[i])) {
                 if (graph_.length(e) >= edge_length_bound_) {
-                    additional_vertices.insert(graph_.EdgeStart(e));
+                    component.push_back(graph_.EdgeStart(e));
                 }
             }
         }
-        component.insert(additional_vertices.begin(),
-                         additional_vertices.end());
     }
 
     GraphComponent<Graph> CloseComponent(const GraphComponent<Graph>& component) const {
-        std::set<VertexId> vertices(component.v_begin(), component.v_end());
+        std::vector<VertexId> vertices(component.v_begin(), component.v_end());
         CloseComponent(vertices);
         return GraphComponent<Graph>::FromVertices(graph_, vertices);
     }
@@ -272,127 +296,93 @@ private:
     typedef typename Graph::VertexId VertexId;
     typedef typename Graph::EdgeId EdgeId;
 
-    class CoverageBoundedDFS {
-    private:
-        const Graph &graph_;
-        const double coverage_bound_;
-        const size_t edge_limit_;
-        mutable size_t edge_summary_length_;
-        const size_t edge_summary_length_limit_;
-
-        void Find(EdgeId edge, std::set<EdgeId> &result) const {
-            if (edge_summary_length_ > edge_summary_length_limit_)
-                return;
-
-            if (result.size() > edge_limit_)
-                return;
-
-            if (math::ls(graph_.coverage(edge), coverage_bound_))
-                return;
-
-            if (result.count(edge) || result.count(graph_.conjugate(edge)))
-                return;
-
-            edge_summary_length_ += graph_.length(edge);
-            result.insert(edge);
-            result.insert(graph_.conjugate(edge));
-
-            VertexId v = graph_.EdgeEnd(edge);
-            for (auto e : graph_.IncidentEdges(v))
-                Find(e, result);
-
-            v = graph_.EdgeStart(edge);
-            for (auto e : graph_.IncidentEdges(v))
-                Find(e, result);
-        }
-
-        // FIXME: Get rid of recursion, it's ugly!
-        void Fill(EdgeId edge, phmap::flat_hash_set<EdgeId> &processed) const {
-            if (edge_summary_length_ >= edge_summary_length_limit_)
-                return;
-
-            if (processed.size() > edge_limit_)
-                return;
-
-            if (math::ls(graph_.coverage(edge), coverage_bound_))
-                return;
-
-            if (processed.count(edge) || processed.count(graph_.conjugate(edge)))
-                return;
-
-            edge_summary_length_ += graph_.length(edge);
-            processed.insert(edge);
-            processed.insert(graph_.conjugate(edge));
-
-            VertexId v = graph_.EdgeEnd(edge);
-            for (auto e : graph_.IncidentEdges(v))
-                Fill(e, processed);
-
-            v = graph_.EdgeStart(edge);
-            for (auto e : graph_.IncidentEdges(v))
-                Fill(e, processed);
-        }
-
-    public:
-        CoverageBoundedDFS(const Graph &graph, double coverage_bound, size_t edge_summary_limit,
-                           size_t edge_limit = 500)
-                : graph_(graph),
-                  coverage_bound_(coverage_bound),
-                  edge_limit_(edge_limit),
-                  edge_summary_length_(0),
-                  edge_summary_length_limit_(edge_summary_limit) {
-        }
-
-        std::set<EdgeId> Find(VertexId v) const {
-            edge_summary_length_ = 0;
-            std::set<EdgeId> result;
-            for (auto e : graph_.OutgoingEdges(v)) {
-                Find(e, result);
-            }
-            for (auto e : graph_.IncomingEdges(v)) {
-                Find(e, result);
-            }
-            return result;
-        }
+    //state of a single search, visited edges are kept in the per-thread marks
+    struct Search {
+        adt::EpochMarks &visited;
+        double coverage_bound;
+        //Find stops as soon as the limit is exceeded, Fill as soon as it is reached
+        bool stop_at_limit;
+        size_t visited_cnt = 0;
+        size_t edge_summary_length = 0;
+        std::vector<EdgeId> *edges = nullptr;
+    };
 
-        size_t Fill(VertexId v) const {
-            edge_summary_length_ = 0;
-            phmap::flat_hash_set<EdgeId> processed;
-            for (auto e : graph_.OutgoingEdges(v))
-                Fill(e, processed);
-            for (auto e : graph_.IncomingEdges(v)) {
-                Fill(e, processed);
-            }
-            return edge_summary_length_;
+    const double coverage_bound_;
+    const size_t edge_limit_;
+    const size_t edge_summary_length_limit_;
+
+    // FIXME: Get rid of recursion, it's ugly!
+    void Go(EdgeId edge, Search &search) const {
+        const Graph &g = this->graph();
+        if (search.stop_at_limit ? search.edge_summary_length >= edge_summary_length_limit_
+                                 : search.edge_summary_length > edge_summary_length_limit_)
+            return;
+
+        if (search.visited_cnt > edge_limit_)
+            return;
+
+        if (math::ls(g.coverage(edge), search.coverage_bound))
+            return;
+
+        //edge and its conjugate are always marked together
+        if (!search.visited.insert(g.int_id(edge)))
+            return;
+        search.visited_cnt += 1;
+        if (search.edges)
+            search.edges->push_back(edge);
+        if (search.visited.insert(g.int_id(g.conjugate(edge)))) {
+            search.visited_cnt += 1;
+            if (search.edges)
+                search.edges->push_back(g.conjugate(edge));
         }
+        search.edge_summary_length += g.length(edge);
 
-        size_t CumulativeEdgeLength() const {
-            return edge_summary_length_;
-        }
-    };
+        VertexId v = g.EdgeEnd(edge);
+        for (auto e : g.IncidentEdges(v))
+            Go(e, search);
 
+        v = g.EdgeStart(edge);
+        for (auto e : g.IncidentEdges(v))
+            Go(e, search);
+    }
 
-    const double coverage_bound_;
-    CoverageBoundedDFS dfs_helper;
+    void Go(VertexId v, Search &search) const {
+        for (auto e : this->graph().OutgoingEdges(v))
+            Go(e, search);
+        for (auto e : this->graph().IncomingEdges(v))
+            Go(e, search);
+    }
 
 public:
     HighCoverageComponentFinder(const Graph &graph,
                                 double max_coverage,
-                                size_t edge_sum_limit = std::numeric_limits<size_t>::max())
+                                size_t edge_sum_limit = std::numeric_limits<size_t>::max(),
+                                size_t edge_limit = 500)
             : AbstractNeighbourhoodFinder<Graph>(graph),
               coverage_bound_(max_coverage),
-              dfs_helper(graph, max_coverage, edge_sum_limit) {
+              edge_limit_(edge_limit),
+              edge_summary_length_limit_(edge_sum_limit) {
     }
 
     GraphComponent<Graph> Find(VertexId v) const {
-        std::set<EdgeId> result = dfs_helper.Find(v);
-        return GraphComponent<Graph>::FromEdges(this->graph(), result, false);
+        std::vector<EdgeId> edges;
+        Search search{this->marks(), coverage_bound_, false};
+        search.edges = &edges;
+        Go(v, search);
+        return GraphComponent<Graph>::FromEdges(this->graph(), edges, false);
+    }
+
+    //total length of the edges covered not less than coverage_bound reachable from v
+    //(conjugate edges are counted once), the search stops when it reaches the edge length limit
+    size_t CumulativeEdgeLength(VertexId v, double coverage_bound) const {
+        Search search{this->marks(), coverage_bound, true};
+        Go(v, search);
+        DEBUG("Total edge length for vertex " << v.int_id() << " is " << search.edge_summary_length);
+        return search.edge_summary_length;
     }
 
     size_t CumulativeEdgeLength(VertexId v) const {
-        size_t result = dfs_helper.Fill(v);
-        DEBUG("Total edge length for vertex " << v.int_id() << " is " << result);
-        return result;
+        return CumulativeEdgeLength(v, coverage_bound_);
     }
 
     std::vector<VertexId> InnerVertices(const GraphComponent<Graph> &component) const {
@@ -455,8 +445,7 @@ public:
         auto cd = DijkstraHelper<Graph>::CreateCountingDijkstra(this->graph(), max_size_,
                 edge_length_bound_);
         cd.Run(v);
-        auto result_vector = cd.ReachedVertices();
-        std::set<VertexId> result(result_vector.begin(), result_vector.end());
+        auto result = cd.ReachedVertices();
         ComponentCloser<Graph> cc(this->graph(), edge_length_bound_);
         cc.CloseComponent(result);
         return GraphComponent<Graph>::FromVertices(this->graph(), result);
@@ -484,20 +473,26 @@ class PathNeighbourhoodFinder : public AbstractNeighbourhoodFinder<Graph> {
             return this->graph().EdgeStart(e);
     }
 
-    bool Go(VertexId v, size_t curr_depth, std::set<VertexId> &grey, std::set<VertexId> &black) const {
+    struct Search {
+        adt::EpochMarks &grey_marks;
+        std::vector<VertexId> grey, black;
+    };
+
+    bool Go(VertexId v, size_t curr_depth, Search &search) const {
         //allows single vertex to be visited many times with different depth values
         TRACE("Came to vertex " << this->graph().str(v) << " on depth " << curr_depth);
         if (curr_depth >= max_depth_) {
             TRACE("Too deep");
             return true;
         }
-        if (grey.size() >= max_size_) {
+        if (search.grey.size() >= max_size_) {
             TRACE("Too many vertices");
             return false;
         }
 
         TRACE("Started processing of vertex " << this->graph().str(v));
-        grey.insert(v);
+        if (search.grey_marks.insert(this->graph().int_id(v)))
+            search.grey.push_back(v);
 
         TRACE("Sorting incident edges");
         std::vector<EdgeId> incident_path, incident_non_path;
@@ -518,18 +513,18 @@ class PathNeighbourhoodFinder : public AbstractNeighbourhoodFinder<Graph> {
                 continue;
             }
             TRACE("Going along edge " << this->graph().str(e));
-            if (!Go(OtherEnd(e, v), curr_depth + 1, grey, black))
+            if (!Go(OtherEnd(e, v), curr_depth + 1, search))
                 return false;
         }
 
         TRACE("End processing of vertex " << this->graph().str(v));
-        black.insert(v);
+        search.black.push_back(v);
 
         for (EdgeId e : incident_path) {
-            if (grey.count(OtherEnd(e, v)) != 0)
+            if (search.grey_marks.count(this->graph().int_id(OtherEnd(e, v))))
                 continue;
             TRACE("Going along next path edge " << this->graph().str(e));
-            if (!Go(OtherEnd(e, v), 0, grey, black))
+            if (!Go(OtherEnd(e, v), 0, search))
                 return false;
         }
 
@@ -546,7 +541,8 @@ public:
     const size_t max_size_;
     const size_t max_depth_;
 
-    mutable std::set<VertexId> last_inner_;
+    //inner vertices of the last found component, so the finder is not thread-safe
+    mutable std::vector<VertexId> last_inner_;
 
     PathNeighbourhoodFinder(const Graph &graph, const std::vector<EdgeId> &path,
                             size_t edge_length_bound = DEFAULT_EDGE_LENGTH_BOUND,
@@ -562,17 +558,22 @@ public:
 
     GraphComponent<Graph> Find(VertexId v) const {
         TRACE("Starting from vertex " << this->graph().str(v));
-        last_inner_.clear();
-        std::set<VertexId> grey, black;
-        Go(v, 0, grey, black);
-        last_inner_ = black;
-        last_inner_.insert(v);
-        ComponentCloser<Graph>(this->graph(), 0).CloseComponent(grey);
-        return GraphComponent<Graph>::FromVertices(this->graph(), grey);
+        Search search{this->marks(), {}, {}};
+        Go(v, 0, search);
+        last_inner_ = std::move(search.black);
+        last_inner_.push_back(v);
+        std::sort(last_inner_.begin(), last_inner_.end());
+        last_inner_.erase(std::unique(last_inner_.begin(), last_inner_.end()), last_inner_.end());
+        ComponentCloser<Graph>(this->graph(), 0).CloseComponent(search.grey);
+        return GraphComponent<Graph>::FromVertices(this->graph(), search.grey);
     }
 
     std::vector<VertexId> InnerVertices(const GraphComponent<Graph> &/*component*/) const {
-        return std::vector<VertexId>(last_inner_.begin(), last_inner_.end());
+        return last_inner_;
+    }
+
+    bool ThreadSafe() const override {
+        return false;
     }
 private:
     DECL_LOGGER("PathNeighbourhoodFinder");
@@ -594,17 +595,23 @@ public:
               edge_length_bound_(edge_length_bound) {
     }
 
+    //vertices connected with v by short edges regardless of direction
     GraphComponent<Graph> Find(VertexId v) const {
-        auto cd = DijkstraHelper<Graph>::CreateShortEdgeDijkstra(this->graph(), edge_length_bound_);
-        cd.Run(v);
-        std::set<VertexId> short_vertices;
-        for (auto entry : cd.reached()) {
-            if (entry.second > 0)
-                continue;
-            
-            short_vertices.insert(entry.first);
+        const Graph &g = this->graph();
+        auto &visited = this->marks();
+        std::vector<VertexId> short_vertices = {v};
+        visited.insert(g.int_id(v));
+        for (size_t i = 0; i < short_vertices.size(); ++i) {
+            for (EdgeId e : g.IncidentEdges(short_vertices[i])) {
+                if (g.length(e) > edge_length_bound_)
+                    continue;
+                if (visited.insert(g.int_id(g.EdgeStart(e))))
+                    short_vertices.push_back(g.EdgeStart(e));
+                if (visited.insert(g.int_id(g.EdgeEnd(e))))
+                    short_vertices.push_back(g.EdgeEnd(e));
+            }
         }
-        return GraphComponent<Graph>::FromVertices(this->graph(), short_vertices);
+        return GraphComponent<Graph>::FromVertices(g, short_vertices);
     }
 
     std::vector<VertexId> InnerVertices(const GraphComponent<Graph> &component) const {
@@ -664,7 +671,7 @@ private:
     std::shared_ptr<GraphSplitter<Graph>> inner_splitter_;
     std::shared_ptr<GraphComponentFilter<Graph>> checker_;
     std::unique_ptr<GraphComponent<Graph>> next_;
-    std::set<VertexId> filtered_;
+    std::vector<VertexId> filtered_;
 public:
     CollectingSplitterWrapper(
             std::shared_ptr<GraphSplitter<Graph>> inner_splitter,
@@ -694,7 +701,7 @@ public:
         while (!next_ && inner_splitter_->HasNext()) {
             next_ = this->MakeUniquePtr(inner_splitter_->Next());
             if (!checker_->Check(*next_)) {
-                filtered_.insert(next_->v_begin(), next_->v_end());
+                filtered_.insert(filtered_.end(), next_->v_begin(), next_->v_end());
                 next_ = nullptr;
             }
         }
@@ -729,7 +736,7 @@ private:
         if (checker_->Check(next)) {
             return next;
         }
-        std::set<VertexId> vertices(next.v_begin(), next.v_end());
+        std::vector<VertexId> vertices(next.v_begin(), next.v_end());
         std::string name = next.name();
         for (size_t i = 0; i < 10 && inner_splitter_->HasNext(); i++) {
             next = inner_splitter_->Next();
@@ -738,7 +745,7 @@ private:
                 next_ = this->MakeUniquePtr(std::move(next));
                 break;
             } else {
-                vertices.insert(next.v_begin(), next.v_end());
+                vertices.insert(vertices.end(), next.v_begin(), next.v_end());
                 if (next.name() != "") {
                     name += ";";
                     name += next.name();
@@ -811,7 +818,7 @@ public:
     NeighbourhoodFindingSplitter(const Graph& graph)
             : GraphSplitter<Graph>(graph),
               inner_iterator_(
-                      std::make_shared<CollectionIterator<std::set<VertexId>>>(graph.begin(), graph.end())),
+                      std::make_shared<RangeIterator<typename Graph::VertexIt>>(graph.begin(), graph.end())),
                       neighbourhood_finder_(std::make_shared<ReliableNeighbourhoodFinder<Graph>>(graph)) {
     }
 
@@ -829,6 +836,100 @@ public:
     }
 };
 
+/**
+ * Finds the neighbourhoods of the seeds in parallel. Every thread claims a seed and then
+ * the inner vertices of its neighbourhood, seeds claimed before are skipped. Since threads
+ * might find the same neighbourhood from different seeds simultaneously, components are
+ * keyed by the first seed among their inner vertices and only one component per key is kept.
+ * If the neighbourhood is the same when found from any of its inner vertices
+ * (e.g. for ShortEdgeComponentFinder), the components coincide with the ones of the serial
+ * NeighbourhoodFindingSplitter over the seeds, and with deterministic ordering they are
+ * also returned in the same order.
+ * Finder should be thread-safe and the graph should not change while splitting.
+ */
+template<class Graph>
+class ParallelNeighbourhoodSplitter : public GraphSplitter<Graph> {
+private:
+    typedef typename Graph::VertexId VertexId;
+    typedef std::pair<size_t, GraphComponent<Graph>> KeyedComponent;
+
+    std::vector<VertexId> seeds_;
+    std::shared_ptr<AbstractNeighbourhoodFinder<Graph>> neighbourhood_finder_;
+    bool deterministic_;
+    bool split_;
+    std::deque<GraphComponent<Graph>> components_;
+
+    //returns true iff vertex was not claimed before
+    static bool Claim(std::vector<std::atomic<bool>> &claimed, size_t id) {
+        return !claimed[id].exchange(true, std::memory_order_relaxed);
+    }
+
+    void Split() {
+        const Graph &g = this->graph();
+        std::vector<std::atomic<bool>> claimed(g.max_vid() + 1);
+        for (auto &c : claimed)
+            c.store(false, std::memory_order_relaxed);
+        std::vector<size_t> first_seed(g.max_vid() + 1, seeds_.size());
+        for (size_t i = seeds_.size(); i > 0; --i)
+            first_seed[g.int_id(seeds_[i - 1])] = i - 1;
+
+        std::vector<std::vector<KeyedComponent>> found(omp_get_max_threads());
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (size_t i = 0; i < seeds_.size(); ++i) {
+            VertexId seed = seeds_[i];
+            if (!Claim(claimed, g.int_id(seed)))
+                continue;
+            GraphComponent<Graph> component = neighbourhood_finder_->Find(seed);
+            size_t key = i;
+            for (VertexId v : neighbourhood_finder_->InnerVertices(component)) {
+                Claim(claimed, g.int_id(v));
+                key = std::min(key, first_seed[g.int_id(v)]);
+            }
+            found[omp_get_thread_num()].emplace_back(key, std::move(component));
+        }
+
+        std::vector<KeyedComponent> components;
+        for (auto &thread_found : found)
+            std::move(thread_found.begin(), thread_found.end(), std::back_inserter(components));
+        if (deterministic_)
+            std::stable_sort(components.begin(), components.end(),
+                             [](const KeyedComponent &a, const KeyedComponent &b) { return a.first < b.first; });
+
+        phmap::flat_hash_set<size_t> reported;
+        for (auto &entry : components) {
+            if (reported.insert(entry.first).second)
+                components_.push_back(std::move(entry.second));
+        }
+        split_ = true;
+    }
+
+public:
+    ParallelNeighbourhoodSplitter(const Graph &graph, std::vector<VertexId> seeds,
+                                  std::shared_ptr<AbstractNeighbourhoodFinder<Graph>> neighbourhood_finder,
+                                  bool deterministic = true)
+            : GraphSplitter<Graph>(graph),
+              seeds_(std::move(seeds)),
+              neighbourhood_finder_(neighbourhood_finder),
+              deterministic_(deterministic),
+              split_(false) {
+        VERIFY_MSG(neighbourhood_finder_->ThreadSafe(),
+                   "Neighbourhood finder can not be used for parallel splitting");
+    }
+
+    GraphComponent<Graph> Next() {
+        VERIFY(HasNext());
+        GraphComponent<Graph> result = std::move(components_.front());
+        components_.pop_front();
+        return result;
+    }
+
+    bool HasNext() {
+        if (!split_)
+            Split();
+        return !components_.empty();
+    }
+};
+
 template<class Graph>
 std::shared_ptr<GraphSplitter<Graph>> ReliableSplitter(const Graph &graph,
                             size_t edge_length_bound = ReliableNeighbourhoodFinder<Graph>::DEFAULT_EDGE_LENGTH_BOUND,
@@ -875,6 +976,17 @@ std::shared_ptr<GraphSplitter<Graph>> LongEdgesExclusiveSplitter(const Graph &gr
     return std::make_shared<NeighbourhoodFindingSplitter<Graph>>(graph, inner_iterator, nf);
 }
 
+//Same as LongEdgesExclusiveSplitter, but components are found in parallel. Graph should not change while splitting
+template<class Graph>
+std::shared_ptr<GraphSplitter<Graph>> ParallelLongEdgesExclusiveSplitter(const Graph &graph,
+                                                                         size_t bound = ReliableNeighbourhoodFinder<Graph>::DEFAULT_EDGE_LENGTH_BOUND,
+                                                                         bool deterministic = true) {
+    std::shared_ptr<AbstractNeighbourhoodFinder<Graph>> nf =
+            std::make_shared<ShortEdgeComponentFinder<Graph>>(graph, bound);
+    return std::make_shared<ParallelNeighbourhoodSplitter<Graph>>(
+            graph, std::vector<typename Graph::VertexId>(graph.begin(), graph.end()), nf, deterministic);
+}
+
 template<class Graph, typename Collection>
 std::shared_ptr<GraphSplitter<Graph>> StandardSplitter(
         const Graph &graph, const Collection &collection, size_t max_size = ReliableNeighbourhoodFinder<Graph>::DEFAULT_MAX_SIZE,
@@ -305,6 +305,21 @@ private:
             return id;
         }
 
+        // Ids which are free now and covered by the storage, so the elements can be emplaced at them
+        // concurrently. The ids are not allocated, new ones are only created after the emplacement
+        std::vector<uint64_t> free_ids(size_t cnt) {
+            std::vector<uint64_t> ids;
+            ids.reserve(cnt);
+            for (size_t i = 0; i < cnt; ++i)
+                ids.push_back(id_distributor_.allocate());
+            for (uint64_t id : ids) {
+                id_distributor_.release(id);
+                while (storage_size_ < id + 1)
+                    resize(storage_size_ * 2 + 1);
+            }
+            return ids;
+        }
+
         template<typename... ArgTypes>
         uint64_t emplace(uint64_t at, ArgTypes &&... args) {
             // One MUST call reserve before using emplace()
@@ -666,12 +681,21 @@ protected:
 
     void HiddenDeleteEdge(EdgeId e) {
         TRACE("Hidden delete edge " << e.int_id());
+        HiddenDetachEdge(e);
+        HiddenDestroyEdge(e);
+    }
+
+    //removes the edge (and its conjugate) from the incidence lists, but keeps its data
+    void HiddenDetachEdge(EdgeId e) {
         EdgeId rcEdge = conjugate(e);
         VertexId rcStart = conjugate(edge(e).end());
         VertexId start = conjugate(edge(rcEdge).end());
         vertex(start).RemoveOutgoingEdge(e);
         vertex(rcStart).RemoveOutgoingEdge(rcEdge);
-        DestroyEdge(e, rcEdge);
+    }
+
+    void HiddenDestroyEdge(EdgeId e) {
+        DestroyEdge(e, conjugate(e));
     }
 
     void HiddenDeletePath(const std::vector<EdgeId>& edgesToDelete,
@@ -699,6 +723,16 @@ public:
         ereserve(edges);
     }
 
+    std::vector<VertexId> FreeVertexIds(size_t cnt) {
+        auto ids = vstorage_.free_ids(cnt);
+        return std::vector<VertexId>(ids.begin(), ids.end());
+    }
+
+    std::vector<EdgeId> FreeEdgeIds(size_t cnt) {
+        auto ids = estorage_.free_ids(cnt);
+        return std::vector<EdgeId>(ids.begin(), ids.end());
+    }
+
     size_t vreserved() const { return vstorage_.reserved(); }
     size_t ereserved() const { return estorage_.reserved(); }
 
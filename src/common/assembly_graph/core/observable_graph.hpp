@@ -15,6 +15,7 @@
 #include <vector>
 #include <set>
 #include <cstring>
+#include <tuple>
 
 namespace omnigraph {
 
@@ -35,11 +36,53 @@ public:
     typedef SmartEdgeIterator<ObservableGraph> SmartEdgeIt;
     typedef ActionHandler<VertexId, EdgeId> Handler;
 
+    // Events of the modifications made by a single thread and the elements removed by them, see LogModifications
+    class ModificationLog {
+        friend class ObservableGraph;
+
+        enum class EventType { AddVertex, AddEdge, DeleteVertex, DeleteEdge, Merge, Glue, Split };
+
+        struct Event {
+            EventType type;
+            VertexId v;
+            //merge: old edges and the new one; glue: new edge, edge1, edge2; split: old edge, new edge 1, new edge 2
+            std::vector<EdgeId> edges;
+        };
+
+        std::vector<Event> events_;
+        std::vector<VertexId> vertex_ids_;
+        std::vector<EdgeId> edge_ids_;
+        std::vector<VertexId> removed_vertices_;
+        std::vector<EdgeId> removed_edges_;
+
+    public:
+        //new elements and their conjugates are created at the given ids (see FreeVertexIds and FreeEdgeIds)
+        ModificationLog(std::vector<VertexId> vertex_ids, std::vector<EdgeId> edge_ids)
+                : vertex_ids_(std::move(vertex_ids)), edge_ids_(std::move(edge_ids)) {}
+    };
+
 private:
    //todo switch to smart iterators
    mutable std::vector<Handler*> action_handler_list_;
    std::unique_ptr<const HandlerApplier<VertexId, EdgeId>> applier_;
 
+    static inline thread_local std::pair<const ObservableGraph*, ModificationLog*> thread_log_ = {nullptr, nullptr};
+
+    ModificationLog *thread_log() const {
+        return thread_log_.first == this ? thread_log_.second : nullptr;
+    }
+
+    //returns false if the event should be reported to the handlers right away
+    bool LogEvent(typename ModificationLog::EventType type, VertexId v, std::vector<EdgeId> edges = {}) const;
+
+    std::pair<VertexId, VertexId> NewVertexIds() const;
+
+    std::pair<EdgeId, EdgeId> NewEdgeIds() const;
+
+    void RemoveVertex(VertexId v);
+
+    void RemoveEdge(EdgeId e);
+
 public:
 //todo move to graph core
     typedef ConstructionHelper<DataMaster> HelperT;
@@ -82,6 +125,18 @@ public:
 
     bool VerifyAllDetached();
 
+    // While the log is set, the modifications made by the calling thread are recorded in it instead of being
+    // reported to the handlers, new elements get the ids from the log and removed ones are only detached.
+    // So vertex-disjoint regions of the graph (which do not share the neighbours) can be modified concurrently,
+    // with the logs replayed afterwards in a fixed order. Pass nullptr to stop logging.
+    void LogModifications(ModificationLog *log) const {
+        thread_log_ = {log ? this : nullptr, log};
+    }
+
+    // Reports the logged events to the handlers and frees the removed elements.
+    // Handlers see the graph as it is after all the logged modifications.
+    void ReplayLog(ModificationLog &log);
+
     //smart iterators
     template<typename Priority>
     SmartVertexIterator<ObservableGraph, Priority> SmartVertexBegin(
@@ -159,6 +214,8 @@ private:
 template<class DataMaster>
 typename ObservableGraph<DataMaster>::VertexId
 ObservableGraph<DataMaster>::AddVertex(VertexData data, VertexId id1, VertexId id2) {
+    if (!id1)
+        std::tie(id1, id2) = NewVertexIds();
     VertexId v = base::HiddenAddVertex(std::move(data), id1, id2);
     FireAddVertex(v);
     return v;
@@ -169,7 +226,7 @@ void ObservableGraph<DataMaster>::DeleteVertex(VertexId v) {
     VERIFY(base::IsDeadEnd(v) && base::IsDeadStart(v));
     VERIFY(v != VertexId());
     FireDeleteVertex(v);
-    base::HiddenDeleteVertex(v);
+    RemoveVertex(v);
 }
 
 template<class DataMaster>
@@ -183,6 +240,8 @@ template<class DataMaster>
 typename ObservableGraph<DataMaster>::EdgeId
 ObservableGraph<DataMaster>::AddEdge(VertexId v1, VertexId v2, EdgeData data,
                                      EdgeId id1, EdgeId id2) {
+    if (!id1)
+        std::tie(id1, id2) = NewEdgeIds();
     EdgeId e = base::HiddenAddEdge(v1, v2, std::move(data), id1, id2);
     FireAddEdge(e);
     return e;
@@ -191,6 +250,8 @@ ObservableGraph<DataMaster>::AddEdge(VertexId v1, VertexId v2, EdgeData data,
 template<class DataMaster>
 typename ObservableGraph<DataMaster>::EdgeId
 ObservableGraph<DataMaster>::AddEdge(EdgeData data, EdgeId id1, EdgeId id2) {
+    if (!id1)
+        std::tie(id1, id2) = NewEdgeIds();
     EdgeId e = base::HiddenAddEdge(std::move(data), id1, id2);
     FireAddEdge(e);
     return e;
@@ -199,7 +260,7 @@ ObservableGraph<DataMaster>::AddEdge(EdgeData data, EdgeId id1, EdgeId id2) {
 template<class DataMaster>
 void ObservableGraph<DataMaster>::DeleteEdge(EdgeId e) {
     FireDeleteEdge(e);
-    base::HiddenDeleteEdge(e);
+    RemoveEdge(e);
 }
 
 template<class DataMaster>
@@ -321,6 +382,8 @@ void ObservableGraph<DataMaster>::FireGameOver() const {
 
 template<class DataMaster>
 void ObservableGraph<DataMaster>::FireAddVertex(VertexId v) const {
+    if (LogEvent(ModificationLog::EventType::AddVertex, v))
+        return;
     for (Handler* handler_ptr : action_handler_list_) {
         if (handler_ptr->IsAttached()) {
             TRACE("FireAddVertex to handler " << handler_ptr->name());
@@ -331,6 +394,8 @@ void ObservableGraph<DataMaster>::FireAddVertex(VertexId v) const {
 
 template<class DataMaster>
 void ObservableGraph<DataMaster>::FireAddEdge(EdgeId e) const {
+    if (LogEvent(ModificationLog::EventType::AddEdge, VertexId(), {e}))
+        return;
     for (Handler* handler_ptr : action_handler_list_) {
         if (handler_ptr->IsAttached()) {
             TRACE("FireAddEdge to handler " << handler_ptr->name());
@@ -341,6 +406,8 @@ void ObservableGraph<DataMaster>::FireAddEdge(EdgeId e) const {
 
 template<class DataMaster>
 void ObservableGraph<DataMaster>::FireDeleteVertex(VertexId v) const {
+    if (LogEvent(ModificationLog::EventType::DeleteVertex, v))
+        return;
     for (auto it = action_handler_list_.rbegin(); it != action_handler_list_.rend(); ++it) {
         if ((*it)->IsAttached()) {
             applier_->ApplyDelete(**it, v);
@@ -350,6 +417,8 @@ void ObservableGraph<DataMaster>::FireDeleteVertex(VertexId v) const {
 
 template<class DataMaster>
 void ObservableGraph<DataMaster>::FireDeleteEdge(EdgeId e) const {
+    if (LogEvent(ModificationLog::EventType::DeleteEdge, VertexId(), {e}))
+        return;
     for (auto it = action_handler_list_.rbegin(); it != action_handler_list_.rend(); ++it) {
         if ((*it)->IsAttached()) {
             applier_->ApplyDelete(**it, e);
@@ -359,6 +428,12 @@ void ObservableGraph<DataMaster>::FireDeleteEdge(EdgeId e) const {
 
 template<class DataMaster>
 void ObservableGraph<DataMaster>::FireMerge(const std::vector<EdgeId> &old_edges, EdgeId new_edge) const {
+    if (thread_log()) {
+        std::vector<EdgeId> edges(old_edges);
+        edges.push_back(new_edge);
+        LogEvent(ModificationLog::EventType::Merge, VertexId(), std::move(edges));
+        return;
+    }
     for (Handler* handler_ptr : action_handler_list_) {
         if (handler_ptr->IsAttached()) {
             applier_->ApplyMerge(*handler_ptr, old_edges, new_edge);
@@ -368,6 +443,8 @@ void ObservableGraph<DataMaster>::FireMerge(const std::vector<EdgeId> &old_edges
 
 template<class DataMaster>
 void ObservableGraph<DataMaster>::FireGlue(EdgeId new_edge, EdgeId edge1, EdgeId edge2) const {
+    if (LogEvent(ModificationLog::EventType::Glue, VertexId(), {new_edge, edge1, edge2}))
+        return;
     for (Handler* handler_ptr : action_handler_list_) {
         if (handler_ptr->IsAttached()) {
             applier_->ApplyGlue(*handler_ptr, new_edge, edge1, edge2);
@@ -377,6 +454,8 @@ void ObservableGraph<DataMaster>::FireGlue(EdgeId new_edge, EdgeId edge1, EdgeId
 
 template<class DataMaster>
 void ObservableGraph<DataMaster>::FireSplit(EdgeId edge, EdgeId new_edge1, EdgeId new_edge2) const {
+    if (LogEvent(ModificationLog::EventType::Split, VertexId(), {edge, new_edge1, new_edge2}))
+        return;
     for (Handler* handler_ptr : action_handler_list_) {
         if (handler_ptr->IsAttached()) {
             applier_->ApplySplit(*handler_ptr, edge, new_edge1, new_edge2);
@@ -394,6 +473,103 @@ bool ObservableGraph<DataMaster>::VerifyAllDetached() {
     return true;
 }
 
+template<class DataMaster>
+bool ObservableGraph<DataMaster>::LogEvent(typename ModificationLog::EventType type,
+                                           VertexId v, std::vector<EdgeId> edges) const {
+    ModificationLog *log = thread_log();
+    if (!log)
+        return false;
+    log->events_.push_back({type, v, std::move(edges)});
+    return true;
+}
+
+template<class DataMaster>
+std::pair<typename ObservableGraph<DataMaster>::VertexId, typename ObservableGraph<DataMaster>::VertexId>
+ObservableGraph<DataMaster>::NewVertexIds() const {
+    ModificationLog *log = thread_log();
+    if (!log)
+        return {VertexId(), VertexId()};
+    VERIFY_MSG(log->vertex_ids_.size() >= 2, "Not enough vertex ids reserved");
+    VertexId id1 = log->vertex_ids_.back();
+    log->vertex_ids_.pop_back();
+    VertexId id2 = log->vertex_ids_.back();
+    log->vertex_ids_.pop_back();
+    return {id1, id2};
+}
+
+template<class DataMaster>
+std::pair<typename ObservableGraph<DataMaster>::EdgeId, typename ObservableGraph<DataMaster>::EdgeId>
+ObservableGraph<DataMaster>::NewEdgeIds() const {
+    ModificationLog *log = thread_log();
+    if (!log)
+        return {EdgeId(), EdgeId()};
+    VERIFY_MSG(log->edge_ids_.size() >= 2, "Not enough edge ids reserved");
+    EdgeId id1 = log->edge_ids_.back();
+    log->edge_ids_.pop_back();
+    EdgeId id2 = log->edge_ids_.back();
+    log->edge_ids_.pop_back();
+    return {id1, id2};
+}
+
+template<class DataMaster>
+void ObservableGraph<DataMaster>::RemoveVertex(VertexId v) {
+    if (ModificationLog *log = thread_log())
+        log->removed_vertices_.push_back(v);
+    else
+        base::HiddenDeleteVertex(v);
+}
+
+template<class DataMaster>
+void ObservableGraph<DataMaster>::RemoveEdge(EdgeId e) {
+    if (ModificationLog *log = thread_log()) {
+        base::HiddenDetachEdge(e);
+        log->removed_edges_.push_back(e);
+    } else {
+        base::HiddenDeleteEdge(e);
+    }
+}
+
+template<class DataMaster>
+void ObservableGraph<DataMaster>::ReplayLog(ModificationLog &log) {
+    VERIFY(!thread_log());
+    typedef typename ModificationLog::EventType EventType;
+    for (const auto &event : log.events_) {
+        const auto &edges = event.edges;
+        switch (event.type) {
+            case EventType::AddVertex:
+                FireAddVertex(event.v);
+                break;
+            case EventType::AddEdge:
+                FireAddEdge(edges[0]);
+                break;
+            case EventType::DeleteVertex:
+                FireDeleteVertex(event.v);
+                break;
+            case EventType::DeleteEdge:
+                FireDeleteEdge(edges[0]);
+                break;
+            case EventType::Merge:
+                FireMerge(std::vector<EdgeId>(edges.begin(), std::prev(edges.end())), edges.back());
+                break;
+            case EventType::Glue:
+                FireGlue(edges[0], edges[1], edges[2]);
+                break;
+            case EventType::Split:
+                FireSplit(edges[0], edges[1], edges[2]);
+                break;
+        }
+    }
+
+    for (EdgeId e : log.removed_edges_)
+        base::HiddenDestroyEdge(e);
+    for (VertexId v : log.removed_vertices_)
+        base::HiddenDeleteVertex(v);
+
+    log.events_.clear();
+    log.removed_edges_.clear();
+    log.removed_vertices_.clear();
+}
+
 template<class DataMaster>
 void ObservableGraph<DataMaster>::FireDeletePath(const std::vector<EdgeId> &edgesToDelete,
                                                  const std::vector<VertexId> &verticesToDelete) const {
@@ -469,13 +645,17 @@ typename ObservableGraph<DataMaster>::EdgeId
         to_merge.push_back(&(base::data(*it1)));
     }
     to_merge.push_back(&(base::data(corrected_path.back())));
-    EdgeId new_edge = base::HiddenAddEdge(v1, v2, base::master().MergeData(to_merge, overlaps, safe_merging));
+    auto [id1, id2] = NewEdgeIds();
+    EdgeId new_edge = base::HiddenAddEdge(v1, v2, base::master().MergeData(to_merge, overlaps, safe_merging), id1, id2);
     FireMerge(corrected_path, new_edge);
     auto edges_to_delete = EdgesToDelete(corrected_path);
     auto vertices_to_delete = VerticesToDelete(corrected_path);
     FireDeletePath(edges_to_delete, vertices_to_delete);
     FireAddEdge(new_edge);
-    base::HiddenDeletePath(edges_to_delete, vertices_to_delete);
+    for (EdgeId e : edges_to_delete)
+        RemoveEdge(e);
+    for (VertexId v : vertices_to_delete)
+        RemoveVertex(v);
     return new_edge;
 }
 
@@ -486,32 +666,37 @@ std::pair<typename ObservableGraph<DataMaster>::EdgeId, typename ObservableGraph
     VERIFY_MSG(position > 0 && position < (sc_flag ? base::length(edge) / 2 + 1 : base::length(edge)),
             "Edge length is " << base::length(edge) << " but split pos was " << position);
     auto [vdata, edata1, edata2]  = base::master().SplitData(base::data(edge), position, sc_flag);
-    VertexId splitVertex = base::HiddenAddVertex(std::move(vdata));
+    auto [vid1, vid2] = NewVertexIds();
+    VertexId splitVertex = base::HiddenAddVertex(std::move(vdata), vid1, vid2);
+    auto [eid1, ceid1] = NewEdgeIds();
     EdgeId new_edge1 = base::HiddenAddEdge(base::EdgeStart(edge), splitVertex,
-                                           std::move(edata1));
+                                           std::move(edata1), eid1, ceid1);
+    auto [eid2, ceid2] = NewEdgeIds();
     EdgeId new_edge2 = base::HiddenAddEdge(splitVertex, sc_flag ? conjugate(splitVertex) : base::EdgeEnd(edge),
-                                           std::move(edata2));
+                                           std::move(edata2), eid2, ceid2);
     VERIFY(!sc_flag || new_edge2 == conjugate(new_edge2))
     FireSplit(edge, new_edge1, new_edge2);
     FireDeleteEdge(edge);
     FireAddVertex(splitVertex);
     FireAddEdge(new_edge1);
     FireAddEdge(new_edge2);
-    base::HiddenDeleteEdge(edge);
+    RemoveEdge(edge);
     return {new_edge1, new_edge2};
 }
 
 template<class DataMaster>
 typename ObservableGraph<DataMaster>::EdgeId ObservableGraph<DataMaster>::GlueEdges(EdgeId edge1, EdgeId edge2) {
-    EdgeId new_edge = base::HiddenAddEdge(base::EdgeStart(edge2), base::EdgeEnd(edge2), base::master().GlueData(base::data(edge1), base::data(edge2)));
+    auto [id1, id2] = NewEdgeIds();
+    EdgeId new_edge = base::HiddenAddEdge(base::EdgeStart(edge2), base::EdgeEnd(edge2),
+                                          base::master().GlueData(base::data(edge1), base::data(edge2)), id1, id2);
     FireGlue(new_edge, edge1, edge2);
     FireDeleteEdge(edge1);
     FireDeleteEdge(edge2);
     FireAddEdge(new_edge);
     VertexId start = base::EdgeStart(edge1);
     VertexId end = base::EdgeEnd(edge1);
-    base::HiddenDeleteEdge(edge1);
-    base::HiddenDeleteEdge(edge2);
+    RemoveEdge(edge1);
+    RemoveEdge(edge2);
 
     if (base::IsDeadStart(start) && base::IsDeadEnd(start))
         DeleteVertex(start);
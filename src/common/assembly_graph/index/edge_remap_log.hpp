@@ -0,0 +1,101 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#pragma once
+
+#include <parallel_hashmap/phmap.h>
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace debruijn_graph {
+
+/**
+ * Log of the graph modifications relevant for k-mer -> (edge, offset) indices.
+ * Instead of rewriting the index entries of every k-mer of the edges being merged, split or glued,
+ * the log records where the k-mers of the old edge went, so the stale entries are resolved on lookup
+ * and rewritten in one pass later. Edges whose k-mers are not derived from the old ones
+ * (plain additions) are collected to be indexed during that pass.
+ * Offsets are the positions of the index k-mers in the edge.
+ */
+template<class Graph>
+class EdgeRemapLog {
+    typedef typename Graph::EdgeId EdgeId;
+    static constexpr size_t NO_SPLIT = std::numeric_limits<size_t>::max();
+
+    //offsets less than split go to lower shifted by shift, others go to upper shifted back by split,
+    //lower == EdgeId() means that the k-mers are gone
+    struct Remap {
+        EdgeId lower;
+        EdgeId upper;
+        size_t split;
+        size_t shift;
+    };
+
+    phmap::flat_hash_map<EdgeId, Remap> remaps_;
+    //new edges with remapped k-mers, their addition should not be treated as plain one
+    phmap::flat_hash_set<EdgeId> derived_;
+    std::vector<std::pair<EdgeId, size_t>> added_;
+
+public:
+    bool empty() const {
+        return remaps_.empty() && added_.empty();
+    }
+
+    //true if e was removed or remapped, i.e. e might be a recycled id
+    bool remapped(EdgeId e) const {
+        return remaps_.count(e);
+    }
+
+    void Move(EdgeId from, EdgeId to, size_t shift) {
+        remaps_.insert_or_assign(from, Remap{to, to, NO_SPLIT, shift});
+        derived_.insert(to);
+    }
+
+    void Split(EdgeId from, EdgeId to1, EdgeId to2, size_t split) {
+        remaps_.insert_or_assign(from, Remap{to1, to2, split, 0});
+        derived_.insert(to1);
+        derived_.insert(to2);
+    }
+
+    //keeps the remapping if the k-mers of e were moved before
+    void Remove(EdgeId e) {
+        remaps_.try_emplace(e, Remap{EdgeId(), EdgeId(), NO_SPLIT, 0});
+    }
+
+    void Add(EdgeId e, size_t length) {
+        if (!derived_.erase(e))
+            added_.emplace_back(e, length);
+    }
+
+    //current location of k-mer which was at offset of e, EdgeId() if it is not in the graph anymore
+    std::pair<EdgeId, size_t> Resolve(EdgeId e, size_t offset) const {
+        for (auto it = remaps_.find(e); it != remaps_.end(); it = remaps_.find(e)) {
+            const Remap &r = it->second;
+            if (offset < r.split) {
+                e = r.lower;
+                offset += r.shift;
+            } else {
+                e = r.upper;
+                offset -= r.split;
+            }
+        }
+        return { e, offset };
+    }
+
+    //plain additions together with their lengths at the moment of addition
+    const std::vector<std::pair<EdgeId, size_t>> &added() const {
+        return added_;
+    }
+
+    void clear() {
+        remaps_.clear();
+        added_.clear();
+    }
+};
+
+}
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include "path_periodicity_index.hpp"
+
 #include "assembly_graph/core/graph.hpp"
 #include "adt/small_pod_vector.hpp"
 #include "io/binary/binary.hpp"
@@ -16,6 +18,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <memory>
 #include <vector>
 
 namespace path_extend {
@@ -381,16 +384,22 @@ class BidirectionalPath : public PathListener, public SimpleBidirectionalPath {
     const debruijn_graph::Graph& g_;
     BidirectionalPath* conj_path_;
     // Length from beginning of i-th edge to path end: L(e_i + gap_(i+1) + e_(i+1) + ... + gap_N + e_N)
-    rdsl::devector<size_t> cumulative_len_;
+    // is kept as end_len_ - start_len_[i], both counted from an arbitrary origin,
+    // so adding or removing an edge does not touch the other ones
+    rdsl::devector<size_t> start_len_;
+    size_t end_len_;
     adt::SmallPODVector<PathListener*,
                         adt::impl::HybridAllocatedStorage<PathListener*, 2>> listeners_;
     const uint64_t id_;  //Unique ID
     float weight_;
     int cycle_overlapping_; // in edges; [ < 0 ] => is not cycled
+    // built on the first repeat query and maintained after that
+    mutable std::unique_ptr<PathPeriodicityIndex> periodicity_;
 
     BidirectionalPath(const debruijn_graph::Graph& g)
             : g_(g),
               conj_path_(nullptr),
+              end_len_(0),
               id_(path_id_++),
               weight_(1.0),
               cycle_overlapping_(-1) {}
@@ -403,13 +412,12 @@ class BidirectionalPath : public PathListener, public SimpleBidirectionalPath {
     BidirectionalPath(const debruijn_graph::Graph& g, SimpleBidirectionalPath path)
             : BidirectionalPath(g)  {
         SimpleBidirectionalPath::PushBack(std::move(path));
-        cumulative_len_.resize(Size(), 0);
-
-        for (size_t i = 0; i < Size(); ++i)
-            cumulative_len_.front() += g_.length(edges_[i]) + gaps_[i].gap;
+        start_len_.resize(Size(), 0);
 
         for (size_t i = 1; i < Size(); ++i)
-            cumulative_len_[i] = cumulative_len_[i - 1] - g_.length(edges_[i - 1]) - gaps_[i].gap;
+            start_len_[i] = start_len_[i - 1] + g_.length(edges_[i - 1]) + gaps_[i].gap;
+        if (!Empty())
+            end_len_ = start_len_.back() + g_.length(edges_.back());
     }
 
     BidirectionalPath(const debruijn_graph::Graph& g, std::vector<EdgeId> path)
@@ -419,7 +427,8 @@ class BidirectionalPath : public PathListener, public SimpleBidirectionalPath {
             : SimpleBidirectionalPath(path),
               g_(path.g_),
               conj_path_(nullptr),
-              cumulative_len_(path.cumulative_len_),
+              start_len_(path.start_len_),
+              end_len_(path.end_len_),
               listeners_(),
               id_(path_id_++),
               weight_(path.weight_),
@@ -558,7 +567,7 @@ public:
             return 0;
         }
         VERIFY(gaps_[0].gap == 0);
-        return cumulative_len_[0];
+        return LengthAt(0);
     }
 
     int ShiftLength(size_t index) const {
@@ -567,7 +576,7 @@ public:
 
     // Length from beginning of i-th edge to path end for forward directed path: L(e1 + e2 + ... + eN)
     size_t LengthAt(size_t index) const noexcept {
-        return cumulative_len_[index];
+        return end_len_ - start_len_[index];
     }
 
     size_t GetId() const noexcept {
@@ -586,6 +595,8 @@ public:
         }
         SimpleBidirectionalPath::PushBack(e, std::move(gap));
         IncreaseLengths(g_.length(e), gaps_.back().gap);
+        if (periodicity_)
+            periodicity_->PushBack(e);
         NotifyBackEdgeAdded(e, gaps_.back());
     }
 
@@ -612,6 +623,8 @@ public:
         EdgeId e = edges_.back();
         DecreaseLengths();
         SimpleBidirectionalPath::PopBack();
+        if (periodicity_)
+            periodicity_->PopBack(e);
         NotifyBackEdgeRemoved(e);
         DecreaseCycleOverlapping();
     }
@@ -652,6 +665,64 @@ public:
         return false;
     }
 
+    // Repeat queries below use the periodicity index, which is built on the first call and then
+    // maintained by the path modifications, and do not copy the path
+
+    /// @returns whether subpaths [from1, from1 + len) and [from2, from2 + len) consist of the same edges
+    bool EqualSubPaths(size_t from1, size_t from2, size_t len) const {
+        VERIFY(from1 + len <= Size() && from2 + len <= Size());
+        if (from1 == from2 || len == 0)
+            return true;
+        if (!periodicity().EqualHashes(from1, from2, len))
+            return false;
+        return std::equal(edges_.begin() + from1, edges_.begin() + from1 + len, edges_.begin() + from2);
+    }
+
+    /// @returns the position of the first occurrence of subpath [from, Size()), same as FindFirst(SubPath(from))
+    size_t FindFirstOccurrenceOfTail(size_t from) const {
+        VERIFY(from < Size());
+        const auto &index = periodicity();
+        size_t len = Size() - from;
+        for (int64_t pos : index.Positions(Back())) {
+            size_t end = size_t(pos - index.origin()) + 1;
+            if (end < len)
+                continue;
+            size_t start = end - len;
+            if (start >= from)
+                break;
+            if (EqualSubPaths(start, from, len))
+                return start;
+        }
+        return from;
+    }
+
+    /// Same as FindLast(sample), but only checks the occurrences of the last sample edge
+    int FindLastOccurrence(const SimpleBidirectionalPath& sample) const {
+        if (sample.Empty())
+            return SimpleBidirectionalPath::FindLast(sample);
+        const auto &index = periodicity();
+        const auto &positions = index.Positions(sample.Back());
+        for (auto it = positions.rbegin(); it != positions.rend(); ++it) {
+            size_t end = size_t(*it - index.origin()) + 1;
+            if (end < sample.Size())
+                break;
+            if (CompareFrom(end - sample.Size(), sample))
+                return int(end - sample.Size());
+        }
+        return -1;
+    }
+
+    /// @returns whether edge 'second' follows edge 'first' somewhere in the path
+    bool ContainsPair(EdgeId first, EdgeId second) const {
+        const auto &index = periodicity();
+        for (int64_t pos : index.Positions(second)) {
+            size_t i = size_t(pos - index.origin());
+            if (i > 0 && edges_[i - 1] == first)
+                return true;
+        }
+        return false;
+    }
+
     BidirectionalPath SubPath(size_t from, size_t to) const {
         return BidirectionalPath(g_, SimpleBidirectionalPath::SubPath(from, to));
     }
@@ -682,20 +753,20 @@ public:
 private:
     std::vector<std::string> PrintLines() const;
 
+    const PathPeriodicityIndex &periodicity() const {
+        if (!periodicity_)
+            periodicity_ = std::make_unique<PathPeriodicityIndex>(edges_.begin(), edges_.end());
+        return *periodicity_;
+    }
+
     void IncreaseLengths(size_t length, int gap) {
-        for (auto iter = cumulative_len_.begin(); iter != cumulative_len_.end(); ++iter) {
-            *iter += length + gap;
-        }
-        cumulative_len_.push_back(length);
+        start_len_.push_back(start_len_.empty() ? 0 : end_len_ + gap);
+        end_len_ = start_len_.back() + length;
     }
 
     void DecreaseLengths() {
-        size_t length = g_.length(edges_.back()) + gaps_.back().gap;
-
-        for (auto iter = cumulative_len_.begin(); iter != cumulative_len_.end(); ++iter) {
-            *iter -= length;
-        }
-        cumulative_len_.pop_back();
+        end_len_ = start_len_.back() - gaps_.back().gap;
+        start_len_.pop_back();
     }
 
     void NotifyFrontEdgeAdded(EdgeId e, const Gap& gap) {
@@ -730,19 +801,24 @@ private:
 
         SimpleBidirectionalPath::PushFront(e, gap);
 
-        int length = (int) g_.length(e);
-        if (cumulative_len_.empty()) {
-            cumulative_len_.push_front(length);
+        size_t length = g_.length(e);
+        if (start_len_.empty()) {
+            start_len_.push_front(0);
+            end_len_ = length;
         } else {
-            cumulative_len_.push_front(cumulative_len_.front() + length + gap.gap);
+            start_len_.push_front(start_len_.front() - length - gap.gap);
         }
+        if (periodicity_)
+            periodicity_->PushFront(e);
         NotifyFrontEdgeAdded(e, gap);
     }
 
     void PopFront() {
         EdgeId e = edges_.front();
-        cumulative_len_.pop_front();
+        start_len_.pop_front();
         SimpleBidirectionalPath::PopFront();
+        if (periodicity_)
+            periodicity_->PopFront(e);
 
         NotifyFrontEdgeRemoved(e);
         DecreaseCycleOverlapping();
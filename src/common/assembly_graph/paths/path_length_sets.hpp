@@ -0,0 +1,208 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#pragma once
+
+#include "assembly_graph/dijkstra/dijkstra_helper.hpp"
+#include "assembly_graph/paths/path_processor.hpp"
+
+#include <parallel_hashmap/phmap.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace omnigraph {
+
+/**
+ * Sets of lengths of all the paths from the start vertex, which are not longer than max_length.
+ * Length sets are kept as bitsets over the neighbourhood reached by bounded Dijkstra and are
+ * propagated along the edges until nothing changes, so a single sweep answers the queries
+ * for all the vertices. Paths are not required to be simple, as in PathProcessor.
+ * Memory is reused between the runs. Instance is not thread-safe.
+ */
+template<class Graph>
+class PathLengthSets {
+    typedef typename Graph::EdgeId EdgeId;
+    typedef typename Graph::VertexId VertexId;
+    typedef uint64_t Word;
+    static constexpr size_t WORD_BITS = 64;
+
+    const Graph &g_;
+    size_t dijkstra_vertex_limit_;
+
+    VertexId start_;
+    size_t max_length_;
+    size_t words_;
+
+    phmap::flat_hash_map<VertexId, size_t> vertex_idx_;
+    std::vector<VertexId> vertices_;
+    //words_ words per vertex: all known lengths and the lengths not propagated yet
+    std::vector<Word> lengths_;
+    std::vector<Word> pending_;
+    std::vector<bool> queued_;
+    std::vector<size_t> queue_;
+    std::vector<size_t> next_queue_;
+    std::vector<Word> current_;
+    std::vector<Word> shifted_;
+
+    Word *lengths(size_t idx) {
+        return lengths_.data() + idx * words_;
+    }
+
+    const Word *lengths(size_t idx) const {
+        return lengths_.data() + idx * words_;
+    }
+
+    Word *pending(size_t idx) {
+        return pending_.data() + idx * words_;
+    }
+
+    //dst = src << shift, truncated to max_length_ + 1 bits
+    void Shift(const Word *src, size_t shift, Word *dst) const {
+        size_t word_shift = shift / WORD_BITS, bit_shift = shift % WORD_BITS;
+        for (size_t i = words_; i-- > 0; ) {
+            Word w = 0;
+            if (i >= word_shift) {
+                w = src[i - word_shift] << bit_shift;
+                if (bit_shift && i > word_shift)
+                    w |= src[i - word_shift - 1] >> (WORD_BITS - bit_shift);
+            }
+            dst[i] = w;
+        }
+        size_t tail = (max_length_ + 1) % WORD_BITS;
+        if (tail)
+            dst[words_ - 1] &= (Word(1) << tail) - 1;
+    }
+
+    //returns true if any new length was added to the vertex
+    bool Propagate(const Word *src, size_t shift, size_t idx) {
+        Shift(src, shift, shifted_.data());
+        Word *known = lengths(idx);
+        Word *fresh = pending(idx);
+        bool changed = false;
+        for (size_t i = 0; i < words_; ++i) {
+            Word delta = shifted_[i] & ~known[i];
+            if (!delta)
+                continue;
+            known[i] |= delta;
+            fresh[i] |= delta;
+            changed = true;
+        }
+        return changed;
+    }
+
+    void Enqueue(size_t idx) {
+        if (queued_[idx])
+            return;
+        queued_[idx] = true;
+        next_queue_.push_back(idx);
+    }
+
+public:
+    PathLengthSets(const Graph &g,
+                   size_t dijkstra_vertex_limit = PathProcessor<Graph>::MAX_DIJKSTRA_VERTICES)
+            : g_(g), dijkstra_vertex_limit_(dijkstra_vertex_limit),
+              max_length_(0), words_(0) {}
+
+    void Run(VertexId start, size_t max_length) {
+        start_ = start;
+        max_length_ = max_length;
+        words_ = max_length / WORD_BITS + 1;
+
+        auto dijkstra = DijkstraHelper<Graph>::CreateBoundedDijkstra(g_, max_length, dijkstra_vertex_limit_);
+        dijkstra.Run(start);
+
+        vertex_idx_.clear();
+        vertices_.clear();
+        for (const auto &entry : dijkstra.reached()) {
+            vertex_idx_.emplace(entry.first, vertices_.size());
+            vertices_.push_back(entry.first);
+        }
+
+        lengths_.assign(vertices_.size() * words_, 0);
+        pending_.assign(vertices_.size() * words_, 0);
+        queued_.assign(vertices_.size(), false);
+        current_.resize(words_);
+        shifted_.resize(words_);
+
+        size_t start_idx = vertex_idx_.at(start);
+        lengths(start_idx)[0] = pending(start_idx)[0] = 1;
+        queue_.assign(1, start_idx);
+        queued_[start_idx] = true;
+
+        while (!queue_.empty()) {
+            next_queue_.clear();
+            for (size_t idx : queue_) {
+                queued_[idx] = false;
+                Word *fresh = pending(idx);
+                std::copy(fresh, fresh + words_, current_.begin());
+                std::fill(fresh, fresh + words_, 0);
+
+                for (EdgeId e : g_.OutgoingEdges(vertices_[idx])) {
+                    size_t length = g_.length(e);
+                    if (length > max_length_)
+                        continue;
+                    auto it = vertex_idx_.find(g_.EdgeEnd(e));
+                    if (it == vertex_idx_.end())
+                        continue;
+                    if (Propagate(current_.data(), length, it->second))
+                        Enqueue(it->second);
+                }
+            }
+            std::swap(queue_, next_queue_);
+        }
+    }
+
+    VertexId start() const {
+        return start_;
+    }
+
+    size_t max_length() const {
+        return max_length_;
+    }
+
+    //checks if there is a path to v with length in [min_length, max_length]
+    bool Contains(VertexId v, size_t min_length, size_t max_length) const {
+        return !ForEachWord(v, min_length, max_length, [](size_t, Word) { return false; });
+    }
+
+    //appends lengths of the paths to v within [min_length, max_length] in increasing order
+    void Lengths(VertexId v, size_t min_length, size_t max_length, std::vector<size_t> &lengths) const {
+        ForEachWord(v, min_length, max_length, [&](size_t i, Word w) {
+            for (; w; w &= w - 1)
+                lengths.push_back(i * WORD_BITS + __builtin_ctzll(w));
+            return true;
+        });
+    }
+
+private:
+    //calls f(word index, word masked to the range) for non-zero words while f returns true,
+    //returns false iff f did so
+    template<class F>
+    bool ForEachWord(VertexId v, size_t min_length, size_t max_length, F f) const {
+        auto it = vertex_idx_.find(v);
+        if (it == vertex_idx_.end())
+            return true;
+        max_length = std::min(max_length, max_length_);
+        if (min_length > max_length)
+            return true;
+
+        const Word *known = lengths(it->second);
+        size_t first = min_length / WORD_BITS, last = max_length / WORD_BITS;
+        for (size_t i = first; i <= last; ++i) {
+            Word w = known[i];
+            if (i == first)
+                w &= ~Word(0) << (min_length % WORD_BITS);
+            if (i == last && (max_length + 1) % WORD_BITS)
+                w &= (Word(1) << ((max_length + 1) % WORD_BITS)) - 1;
+            if (w && !f(i, w))
+                return false;
+        }
+        return true;
+    }
+};
+
+}
@@ -0,0 +1,147 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#pragma once
+
+#include "assembly_graph/core/graph.hpp"
+
+#include <parallel_hashmap/phmap.h>
+#include <rdsl/devector.hpp>
+
+#include <cstdint>
+#include <utility>
+
+namespace path_extend {
+
+/**
+ * Rolling hash of the edge sequence of a path together with the positions of every edge.
+ * Updated in O(1) when an edge is added to or removed from either end of the path, so the
+ * repeats of the path tail are found by checking the earlier occurrences of its last edge
+ * and comparing the hashes instead of scanning and copying the path.
+ * Positions are kept absolute: edge at index i of the path has position origin() + i.
+ */
+class PathPeriodicityIndex {
+    typedef debruijn_graph::EdgeId EdgeId;
+    static constexpr uint64_t MOD = (uint64_t(1) << 61) - 1;
+    static constexpr uint64_t BASE = 0x1f2e3d4c5b6a798ULL % MOD;
+
+    int64_t origin_ = 0;
+    //B^origin_ and B^(origin_ + size)
+    uint64_t pow_front_ = 1;
+    uint64_t pow_back_ = 1;
+    //hash of the first i edges shifted by an arbitrary constant,
+    //prefix_hash_[i + 1] - prefix_hash_[i] = x(e_i) * B^(origin_ + i)
+    rdsl::devector<uint64_t> prefix_hash_;
+    phmap::flat_hash_map<EdgeId, rdsl::devector<int64_t>> positions_;
+    const rdsl::devector<int64_t> empty_{};
+
+    static uint64_t Mul(uint64_t a, uint64_t b) {
+        __uint128_t p = (__uint128_t) a * b;
+        uint64_t r = (uint64_t(p) & MOD) + uint64_t(p >> 61);
+        return r >= MOD ? r - MOD : r;
+    }
+
+    static uint64_t Add(uint64_t a, uint64_t b) {
+        uint64_t r = a + b;
+        return r >= MOD ? r - MOD : r;
+    }
+
+    static uint64_t Sub(uint64_t a, uint64_t b) {
+        return a >= b ? a - b : a + MOD - b;
+    }
+
+    static uint64_t Pow(uint64_t a, uint64_t n) {
+        uint64_t r = 1;
+        for (; n; n >>= 1, a = Mul(a, a)) {
+            if (n & 1)
+                r = Mul(r, a);
+        }
+        return r;
+    }
+
+    static uint64_t InverseBase() {
+        static const uint64_t inv = Pow(BASE, MOD - 2);
+        return inv;
+    }
+
+    static uint64_t EdgeValue(EdgeId e) {
+        uint64_t x = e.int_id() + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x % (MOD - 1) + 1;
+    }
+
+    uint64_t Hash(size_t from, size_t len) const {
+        return Sub(prefix_hash_[from + len], prefix_hash_[from]);
+    }
+
+public:
+    template<class It>
+    PathPeriodicityIndex(It begin, It end) {
+        prefix_hash_.push_back(0);
+        for (It it = begin; it != end; ++it)
+            PushBack(*it);
+    }
+
+    size_t size() const {
+        return prefix_hash_.size() - 1;
+    }
+
+    int64_t origin() const {
+        return origin_;
+    }
+
+    //absolute positions of e in increasing order
+    const rdsl::devector<int64_t> &Positions(EdgeId e) const {
+        auto it = positions_.find(e);
+        return it == positions_.end() ? empty_ : it->second;
+    }
+
+    //false means that the subpaths [from1, from1 + len) and [from2, from2 + len) differ,
+    //true means that they are equal with high probability
+    bool EqualHashes(size_t from1, size_t from2, size_t len) const {
+        if (from1 > from2)
+            std::swap(from1, from2);
+        return Hash(from2, len) == Mul(Hash(from1, len), Pow(BASE, from2 - from1));
+    }
+
+    void PushBack(EdgeId e) {
+        prefix_hash_.push_back(Add(prefix_hash_.back(), Mul(EdgeValue(e), pow_back_)));
+        positions_[e].push_back(origin_ + int64_t(size()) - 1);
+        pow_back_ = Mul(pow_back_, BASE);
+    }
+
+    void PopBack(EdgeId e) {
+        prefix_hash_.pop_back();
+        auto it = positions_.find(e);
+        VERIFY(it != positions_.end() && it->second.back() == origin_ + int64_t(size()));
+        it->second.pop_back();
+        if (it->second.empty())
+            positions_.erase(it);
+        pow_back_ = Mul(pow_back_, InverseBase());
+    }
+
+    void PushFront(EdgeId e) {
+        --origin_;
+        pow_front_ = Mul(pow_front_, InverseBase());
+        prefix_hash_.push_front(Sub(prefix_hash_.front(), Mul(EdgeValue(e), pow_front_)));
+        positions_[e].push_front(origin_);
+    }
+
+    void PopFront(EdgeId e) {
+        prefix_hash_.pop_front();
+        auto it = positions_.find(e);
+        VERIFY(it != positions_.end() && it->second.front() == origin_);
+        it->second.pop_front();
+        if (it->second.empty())
+            positions_.erase(it);
+        ++origin_;
+        pow_front_ = Mul(pow_front_, BASE);
+    }
+};
+
+}
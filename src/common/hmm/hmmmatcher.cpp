@@ -76,6 +76,11 @@ void HMMMatcher::summarize() {
     p7_tophits_Threshold(th_.get(), pli_.get());
 }
 
+void HMMMatcher::merge(HMMMatcher &other) {
+    p7_tophits_Merge(th_.get(), other.th_.get());
+    p7_pipeline_Merge(pli_.get(), other.pli_.get());
+}
+
 P7_TOPHITS *HMMMatcher::top_hits() const {
     return th_.get();
 }
@@ -99,7 +104,7 @@ HMMMatcher::pipeline_create(const hmmer_cfg &cfg, int M_hint, int L_hint, int lo
     if ((pli->oxb = p7_omx_Create(M_hint, 0,      L_hint)) == NULL) goto ERROR;
 
     pli->r                  = esl_randomness_CreateFast(seed);
-    pli->do_reseeding       = FALSE;
+    pli->do_reseeding       = cfg.reseed;
     pli->ddef               = p7_domaindef_Create(pli->r);
     pli->ddef->do_reseeding = pli->do_reseeding;
 
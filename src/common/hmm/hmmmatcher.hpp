@@ -27,6 +27,9 @@ struct hmmer_cfg {
     bool cut_ga; bool cut_nc; bool cut_tc;
     size_t Z;
     bool max; double F1; double F2; double F3; bool nobias;
+    // Reset RNG for every domain region (as hmmsearch --seed does), so the results
+    // of a sequence do not depend on the sequences matched before it
+    bool reseed;
 
     hmmer_cfg()
             : acc(false), noali(false),
@@ -34,7 +37,8 @@ struct hmmer_cfg {
               incE(0.01), incT(0.0), incdomE(0.01), incdomT(0),
               cut_ga(false), cut_nc(false), cut_tc(false),
               Z(0),
-              max(false), F1(0.02), F2(1e-3), F3(1e-5), nobias(false)
+              max(false), F1(0.02), F2(1e-3), F3(1e-5), nobias(false),
+              reseed(false)
     {}
 };
 
@@ -133,6 +137,9 @@ class HMMMatcher {
 
     void reset();
     void summarize();
+    // Moves the hits of other into this matcher and accumulates its pipeline statistics.
+    // Hits are kept sorted, call summarize() afterwards to set reporting thresholds
+    void merge(HMMMatcher &other);
     P7_TOPHITS *top_hits() const;
     P7_PIPELINE *pipeline() const;
 
@@ -15,42 +15,85 @@
 #include "adt/cyclichash.hpp"
 #include "kmer_index/kmer_counting.hpp"
 
+#include <algorithm>
+#include <array>
 #include <memory>
+#include <utility>
 
 namespace io {
 
-class KmerMultiplicityFiller {
-    std::vector<unsigned> &mlts_;
-    const kmers::CQFKmerFilter &kmer_mlt_index_;
+/**
+ * Incremental check of "median multiplicity of the k-mers of a sequence >= threshold".
+ * Median is the element at position n / 2 of n sorted multiplicities, so it is not below the threshold
+ * iff at most n / 2 k-mers are. K-mers below and above the threshold are counted, and the check is
+ * settled as soon as one of the counters reaches its bound.
+ */
+template<class Hasher>
+class MedianMltCheck {
+    typedef decltype(std::declval<Hasher>().hash(std::declval<RtSeq>())) HashT;
+
+    const Sequence *s_ = nullptr;
+    unsigned k_ = 0;
+    //position of the last nucleotide of the next k-mer
+    size_t pos_ = 0;
+    HashT hash_;
+    size_t below_ = 0, above_ = 0;
+    size_t max_below_ = 0, min_above_ = 0;
 
 public:
-    KmerMultiplicityFiller(std::vector<unsigned> &mlts,
-                           const kmers::CQFKmerFilter &kmer_mlt_index) :
-            mlts_(mlts), kmer_mlt_index_(kmer_mlt_index) {}
+    void Init(const Sequence &s, unsigned k, const Hasher &hasher) {
+        s_ = &s;
+        k_ = k;
+        below_ = above_ = 0;
+        if (s.size() < k) {
+            //median of nothing is 0, which is below any positive threshold
+            below_ = min_above_ = 1;
+            max_below_ = 0;
+            return;
+        }
+
+        size_t n = s.size() - k + 1;
+        max_below_ = n / 2;
+        min_above_ = n - max_below_;
+        pos_ = k - 1;
+        hash_ = hasher.hash(s.start<RtSeq>(k) >> 'A');
+    }
 
-    void ProcessKmer(const RtSeq &/*kmer*/, uint64_t hash) {
-        mlts_.push_back(unsigned(kmer_mlt_index_.lookup(hash)));
+    bool settled() const {
+        return below_ > max_below_ || above_ >= min_above_;
     }
-};
 
-template<class Hasher>
-unsigned CountMedianMlt(const Sequence &s, unsigned k, const Hasher &hasher,
-                        const kmers::CQFKmerFilter &kmer_mlt_index) {
-    if (s.size() < k)
-        return 0;
-
-    std::vector<unsigned> mlts;
-    KmerMultiplicityFiller mlt_filler(mlts, kmer_mlt_index);
-    kmers::KmerSequenceProcessor<Hasher, KmerMultiplicityFiller> processor(hasher, mlt_filler);
-    processor.ProcessSequence(s, k);
-
-    size_t n = mlts.size() / 2;
-    std::nth_element(mlts.begin(), mlts.begin() + n, mlts.end());
-    return mlts[n];
-}
+    bool passed() const {
+        return above_ >= min_above_;
+    }
+
+    //hashes of the next k-mers, at most max_cnt and no more than needed to settle the check
+    size_t FillHashes(const Hasher &hasher, uint64_t *hashes, size_t max_cnt) {
+        if (settled())
+            return 0;
+
+        size_t cnt = std::min(max_cnt, (max_below_ + 1 - below_) + (min_above_ - above_) - 1);
+        size_t i = 0;
+        for (; i < cnt && pos_ < s_->size(); ++i, ++pos_) {
+            auto outchar = (rolling_hash::chartype) (pos_ < k_ ? 0 : (*s_)[pos_ - k_]);
+            hash_ = hasher.hash_update(hash_, outchar, (rolling_hash::chartype) (*s_)[pos_]);
+            hashes[i] = (uint64_t) hash_;
+        }
+        return i;
+    }
+
+    void Account(size_t mlt, unsigned threshold) {
+        if (mlt < threshold)
+            below_ += 1;
+        else
+            above_ += 1;
+    }
+};
 
 template<class Hasher>
 class CoverageFilterBase {
+    static constexpr size_t BATCH_SIZE = 32;
+
     const unsigned k_;
     const Hasher hasher_;
     const kmers::CQFKmerFilter &kmer_mlt_index_;
@@ -63,8 +106,46 @@ public:
             kmer_mlt_index_(kmer_mlt_index), thr_(threshold) {
     }
 
+    /**
+     * True if median k-mer multiplicity of any of the sequences is at least the threshold.
+     * K-mers of all the sequences are probed in common batches: CQF blocks of the whole batch are
+     * prefetched before the lookups. Checking stops as soon as the answer is known.
+     * Does not allocate and might be called concurrently.
+     */
+    template<size_t N>
+    bool CheckAnyMedianMlt(const std::array<const Sequence*, N> &seqs) const {
+        if (thr_ == 0)
+            return true;
+
+        std::array<MedianMltCheck<Hasher>, N> checks;
+        for (size_t i = 0; i < N; ++i)
+            checks[i].Init(*seqs[i], k_, hasher_);
+
+        std::array<uint64_t, BATCH_SIZE> hashes;
+        std::array<size_t, N> filled;
+        while (true) {
+            size_t total = 0;
+            for (size_t i = 0; i < N; ++i) {
+                if (checks[i].passed())
+                    return true;
+                filled[i] = checks[i].FillHashes(hasher_, hashes.data() + total, BATCH_SIZE / N);
+                total += filled[i];
+            }
+            if (!total)
+                return false;
+
+            for (size_t j = 0; j < total; ++j)
+                kmer_mlt_index_.prefetch(hashes[j]);
+
+            for (size_t i = 0, j = 0; i < N; ++i) {
+                for (size_t end = j + filled[i]; j < end; ++j)
+                    checks[i].Account(kmer_mlt_index_.lookup(hashes[j]), thr_);
+            }
+        }
+    }
+
     bool CheckMedianMlt(const Sequence &s) const {
-        return CountMedianMlt(s, k_, hasher_, kmer_mlt_index_) >= thr_;
+        return CheckAnyMedianMlt(std::array<const Sequence*, 1>{ &s });
     }
 };
 
@@ -93,7 +174,8 @@ public:
             base(k, hasher, kmer_mlt_index, thr) {}
 
     bool operator()(const PairedReadType& r) const {
-        return this->CheckMedianMlt(r.first().sequence()) || this->CheckMedianMlt(r.second().sequence());
+        Sequence first = r.first().sequence(), second = r.second().sequence();
+        return this->CheckAnyMedianMlt(std::array<const Sequence*, 2>{ &first, &second });
     }
 
 };
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "kmer_extension_index.hpp"
+#include "kpomer_extension_counter.hpp"
 
 #include "kmer_index/kmer_mph/kmer_index_builder.hpp"
 #include "kmer_index/kmer_mph/kmer_splitters.hpp"
@@ -42,23 +43,6 @@ public:
     }
 
 
-    template<class Index, class It>
-    void FillExtensionsFromIndex(It begin, It end,
-                                 Index &index) const {
-        unsigned KPlusOne = index.k() + 1;
-        for (; begin != end; ++begin) {
-            RtSeq kpomer(KPlusOne, begin->first); // FIXME: temporary until boophm refactoring
-
-            char pnucl = kpomer[0], nnucl = kpomer[KPlusOne - 1];
-            TRACE("processing k+1-mer " << kpomer);
-            index.AddOutgoing(index.ConstructKWH(RtSeq(KPlusOne - 1, kpomer)),
-                              nnucl);
-            // FIXME: This is extremely ugly. Needs to add start / end methods to extract first / last N symbols...
-            index.AddIncoming(index.ConstructKWH(RtSeq(KPlusOne - 1, kpomer << 0)),
-                              pnucl);
-        }
-    }
-
 public:
     template<class Index, class Streams>
     kmers::KMerDiskStorage<RtSeq>
@@ -86,23 +70,25 @@ public:
                                         unsigned nthreads, size_t read_buffer_size = 0) const {
         VERIFY(kpomers.k() == index.k() + 1);
 
-        // Now, count unique k-mers from k+1-mers
-        using Splitter = DeBruijnKMerKMerSplitter<StoringTypeFilter<typename Index::storing_type>,
-                                                  typename KMerStorage::kmer_iterator>;
-        Splitter splitter(workdir, index.k(),
-                          index.k() + 1, Index::storing_type::IsInvertable(), read_buffer_size);
-        for (unsigned i = 0; i < kpomers.num_buckets(); ++i)
-            splitter.AddKMers(adt::make_range(kpomers.bucket_begin(i), kpomers.bucket_end(i)));
-        kmers::KMerDiskCounter<RtSeq> counter(workdir, std::move(splitter));
+        // Now, derive unique k-mers together with their extensions from k+1-mers
+        DeBruijnKPOMerExtensionCounter<typename Index::storing_type> counter(workdir, index.k(), read_buffer_size);
+        auto kmers = counter.Count(kpomers, nthreads);
 
-        BuildIndex(index, counter, kpomers.num_buckets(), nthreads);
+        BuildIndex(index, kmers, nthreads);
 
         // Build the kmer extensions
         INFO("Building k-mer extensions from k+1-mers");
-#       pragma omp parallel for num_threads(nthreads)
-        for (size_t i = 0; i < kpomers.num_buckets(); ++i)
-            FillExtensionsFromIndex(kpomers.bucket_begin(i), kpomers.bucket_end(i),
-                                    index);
+#       pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+        for (size_t i = 0; i < kmers.num_buckets(); ++i) {
+            const auto &masks = counter.masks(i);
+            size_t j = 0;
+            for (auto it = kmers.bucket_begin(i), end = kmers.bucket_end(i); it != end; ++it, ++j) {
+                RtSeq kmer(index.k(), it->first);
+                index.get_raw_value_reference(index.ConstructKWH(kmer)) |= InOutMask(masks[j]);
+            }
+        }
+        counter.clear();
+        KeyIteratingIndexBuilder().AttachKMers(index, kmers);
         INFO("Building k-mer extensions from k+1-mers finished.");
     }
 
@@ -0,0 +1,219 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#pragma once
+
+#include "inout_mask.hpp"
+
+#include "kmer_index/kmer_mph/kmer_index_builder.hpp"
+#include "sequence/rtseq.hpp"
+#include "utils/filesystem/file_limit.hpp"
+#include "utils/memory_limit.hpp"
+
+#include <pdqsort/pdqsort_pod.h>
+
+#include <cstring>
+#include <vector>
+
+namespace kmers {
+
+/**
+ * Derives the set of k-mers of the de Bruijn graph together with their in/out masks
+ * from the counted k+1-mers in one streaming pass.
+ * Every k+1-mer contributes its prefix (with the outgoing nucleotide) and its suffix
+ * (with the incoming one) as (k-mer, mask) records, which are distributed into buckets
+ * by the k-mer segment policy. Records are sorted and collapsed per bucket in memory,
+ * the sorted runs are merged with the masks OR-ed, so the result is the final k-mer
+ * storage ready for BuildIndex plus the masks of every stored k-mer in the same order.
+ * K-mers are stored canonical iff StoringType is invertible, as DeBruijnKMerKMerSplitter does.
+ */
+template<class StoringType>
+class DeBruijnKPOMerExtensionCounter {
+    typedef RtSeq::DataType DataType;
+    typedef std::vector<DataType> Records;
+
+public:
+    DeBruijnKPOMerExtensionCounter(fs::TmpDir work_dir, unsigned k, size_t read_buffer_size = 0)
+            : work_dir_(work_dir), k_(k), read_buffer_size_(read_buffer_size),
+              kmer_size_(RtSeq::GetDataSize(k)), record_size_(kmer_size_ + 1) {}
+
+    template<class KMerStorage>
+    KMerDiskStorage<RtSeq> Count(const KMerStorage &kpomers, unsigned nthreads) {
+        VERIFY(kpomers.k() == k_ + 1);
+        size_t num_buckets = kpomers.num_buckets();
+        policy_.reset(num_buckets);
+
+        INFO("Extracting k-mers with extensions from " << num_buckets << " k+1-mer buckets using " << nthreads << " threads");
+        auto raw = Split(kpomers, nthreads);
+
+        INFO("Merging k-mer extensions");
+        KMerDiskStorage<RtSeq> res(work_dir_, k_, policy_);
+        masks_.assign(num_buckets, {});
+        size_t kmers = 0;
+#       pragma omp parallel for num_threads(nthreads) schedule(dynamic) reduction(+:kmers)
+        for (size_t i = 0; i < num_buckets; ++i) {
+            kmers += Merge(*raw[i], *res.create(i), masks_[i]);
+            raw[i].reset();
+        }
+        INFO("K-mer counting done. There are " << kmers << " kmers in total.");
+        if (!kmers)
+            FATAL_ERROR("No kmers were extracted from reads. Check the read lengths and k-mer length settings");
+
+        return res;
+    }
+
+    //masks of the k-mers of the bucket in the storage order
+    const std::vector<uint8_t> &masks(size_t bucket) const {
+        return masks_[bucket];
+    }
+
+    void clear() {
+        masks_.clear();
+        masks_.shrink_to_fit();
+    }
+
+private:
+    fs::TmpDir work_dir_;
+    unsigned k_;
+    size_t read_buffer_size_;
+    size_t kmer_size_;
+    //k-mer data and one word with the mask
+    size_t record_size_;
+    size_t cell_size_ = 0;
+    kmer::KMerSegmentPolicy<RtSeq> policy_;
+    std::vector<std::vector<uint8_t>> masks_;
+
+    void Add(std::vector<Records> &cells, const RtSeq &kmer, InOutMask mask,
+             const std::vector<fs::DependentTmpFile> &raw) const {
+        size_t idx = policy_(kmer);
+        Records &cell = cells[idx];
+        cell.insert(cell.end(), kmer.data(), kmer.data() + kmer_size_);
+        cell.push_back(mask.get_mask());
+        if (cell.size() >= cell_size_ * record_size_)
+            Dump(cell, *raw[idx]);
+    }
+
+    template<class KMerStorage>
+    std::vector<fs::DependentTmpFile> Split(const KMerStorage &kpomers, unsigned nthreads) {
+        size_t num_buckets = policy_.num_segments();
+        std::vector<fs::DependentTmpFile> raw;
+        auto tmp_prefix = work_dir_->tmp_file("kmer_extensions_raw");
+        for (size_t i = 0; i < num_buckets; ++i)
+            raw.emplace_back(tmp_prefix->CreateDep(std::to_string(i)));
+
+        size_t file_limit = num_buckets + 2 * nthreads;
+        if (utils::limit_file(file_limit) < file_limit) {
+            WARN("Failed to setup necessary limit for number of open files. The process might crash later on.");
+            WARN("Do 'ulimit -n " << file_limit << "' in the console to overcome the limit");
+        }
+
+        size_t buffer_size = read_buffer_size_;
+        if (buffer_size == 0) {
+            buffer_size = 536870912ull;
+            size_t mem_limit = (size_t)((double)(utils::get_free_memory()) / (nthreads * 3));
+            INFO("Memory available for splitting buffers: " << (double)mem_limit / 1024.0 / 1024.0 / 1024.0 << " Gb");
+            buffer_size = std::min(buffer_size, mem_limit);
+        }
+        cell_size_ = std::max(buffer_size / (num_buckets * record_size_ * sizeof(DataType)), size_t(16384));
+        INFO("Using cell size of " << cell_size_);
+
+        std::vector<std::vector<Records>> cells(nthreads, std::vector<Records>(num_buckets));
+        bool invertable = StoringType::IsInvertable();
+        size_t processed = 0;
+#       pragma omp parallel for num_threads(nthreads) schedule(dynamic) reduction(+:processed)
+        for (size_t i = 0; i < kpomers.num_buckets(); ++i) {
+            auto &thread_cells = cells[omp_get_thread_num()];
+            for (auto it = kpomers.bucket_begin(i), end = kpomers.bucket_end(i); it != end; ++it) {
+                RtSeq kpomer(k_ + 1, it->first);
+                RtSeq prefix(k_, kpomer), suffix(k_, kpomer << 0);
+
+                bool prefix_as_is = !invertable || prefix.IsMinimal();
+                InOutMask out;
+                out.AddOutgoing(kpomer[k_], prefix_as_is);
+                Add(thread_cells, prefix_as_is ? prefix : !prefix, out, raw);
+
+                bool suffix_as_is = !invertable || suffix.IsMinimal();
+                InOutMask in;
+                in.AddIncoming(kpomer[0], suffix_as_is);
+                Add(thread_cells, suffix_as_is ? suffix : !suffix, in, raw);
+
+                processed += 1;
+            }
+        }
+        INFO("Used " << processed << " kmers.");
+
+        // Remaining records of all the threads make the last run of every bucket
+#       pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+        for (size_t i = 0; i < num_buckets; ++i) {
+            Records run;
+            for (auto &thread_cells : cells) {
+                run.insert(run.end(), thread_cells[i].begin(), thread_cells[i].end());
+                Records().swap(thread_cells[i]);
+            }
+            Dump(run, *raw[i]);
+        }
+
+        return raw;
+    }
+
+    bool SameKMer(const DataType *lhs, const DataType *rhs) const {
+        return std::equal(lhs, lhs + kmer_size_, rhs);
+    }
+
+    //sorts records, merges the masks of equal k-mers and appends the result as a new run
+    void Dump(Records &records, const std::filesystem::path &file) const {
+        pdqsort_pod(records.data(), records.data() + records.size(), record_size_);
+        size_t cnt = 0;
+        for (size_t i = 0; i < records.size(); i += record_size_) {
+            if (cnt && SameKMer(records.data() + (cnt - 1) * record_size_, records.data() + i)) {
+                records[cnt * record_size_ - 1] |= records[i + kmer_size_];
+                continue;
+            }
+            std::copy(records.begin() + i, records.begin() + i + record_size_,
+                      records.begin() + cnt * record_size_);
+            cnt += 1;
+        }
+
+        KMerSortingSplitter<RtSeq>::AppendRun(file, records.data(), record_size_ * sizeof(DataType), cnt);
+        records.clear();
+    }
+
+    void Write(FILE *f, const Records &kmers) const {
+        size_t cnt = kmers.size() / kmer_size_;
+        size_t res = fwrite(kmers.data(), kmer_size_ * sizeof(DataType), cnt, f);
+        if (res != cnt)
+            FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
+    }
+
+    size_t Merge(const std::filesystem::path &ifname, const std::filesystem::path &ofname,
+                 std::vector<uint8_t> &masks) const {
+        FILE *g = fopen(ofname.c_str(), "wb");
+        if (!g)
+            FATAL_ERROR("Cannot open temporary file " << ofname << " for writing");
+
+        const size_t buffer_size = 1024 * 1024 * kmer_size_;
+        Records kmers;
+        kmers.reserve(buffer_size);
+        KMerSortingSplitter<RtSeq>::MergeRuns(ifname, kmer_size_,
+                                              [](DataType mask, DataType other) { return mask | other; },
+                                              [&](const DataType *record) {
+            if (kmers.size() >= buffer_size) {
+                Write(g, kmers);
+                kmers.clear();
+            }
+            kmers.insert(kmers.end(), record, record + kmer_size_);
+            masks.push_back(uint8_t(record[kmer_size_]));
+        });
+        Write(g, kmers);
+        fclose(g);
+
+        return masks.size();
+    }
+
+    DECL_LOGGER("DeBruijnKPOMerExtensionCounter");
+};
+
+}
@@ -0,0 +1,212 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#pragma once
+
+#include "kmer_index_builder.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace kmers {
+
+/**
+ * K-mer counter which keeps the multiplicities of the k-mers.
+ * Splitter must dump (k-mer, count) runs, see KMerSortingSplitter::DumpCountedBuffers.
+ * The runs of every bucket are merged with the counts summed up, the abundance histogram is
+ * collected over all the distinct k-mers and only the k-mers with abundance within [min_count, max_count]
+ * are kept. Resulting buckets consist of (k-mer, count) records sorted by the k-mer data,
+ * so the buckets could be concatenated as is or merged into the globally sorted output.
+ */
+template<class Seq>
+class KMerAbundanceCounter {
+    typedef typename Seq::DataType DataType;
+    typedef std::vector<DataType> Records;
+    // Abundances below are accounted densely, the rest (rare high ones) go to the map
+    static constexpr size_t DENSE_HISTOGRAM_SIZE = 65536;
+
+public:
+    typedef std::vector<fs::DependentTmpFile> Buckets;
+    typedef std::map<uint64_t, size_t> Histogram;
+
+    template<class Splitter>
+    KMerAbundanceCounter(fs::TmpDir work_dir, Splitter splitter)
+            : splitter_(new Splitter{std::move(splitter)}), work_dir_(work_dir),
+              kmer_size_(Seq::GetDataSize(splitter_->K())), record_size_(kmer_size_ + 1) {}
+
+    template<class Splitter>
+    KMerAbundanceCounter(const std::filesystem::path &work_dir, Splitter splitter)
+            : KMerAbundanceCounter(fs::tmp::make_temp_dir(work_dir, "kmer_counter"), std::move(splitter)) {}
+
+    unsigned k() const { return splitter_->K(); }
+
+    Buckets Count(unsigned num_buckets, unsigned num_threads,
+                  uint64_t min_count = 1, uint64_t max_count = std::numeric_limits<uint64_t>::max()) {
+        INFO("Splitting kmer instances into " << num_buckets << " files using " << num_threads << " threads. This might take a while.");
+        auto raw_kmers = splitter_->Split(num_buckets, num_threads);
+        VERIFY(raw_kmers.size() == num_buckets);
+
+        INFO("Starting k-mer counting.");
+        Buckets res;
+        auto tmp_prefix = work_dir_->tmp_file("kmers_counted");
+        for (size_t i = 0; i < num_buckets; ++i)
+            res.emplace_back(tmp_prefix->CreateDep(std::to_string(i)));
+
+        std::vector<Histogram> histograms(num_buckets);
+        size_t kmers = 0, kept = 0;
+#       pragma omp parallel for num_threads(num_threads) schedule(dynamic) reduction(+:kmers, kept)
+        for (size_t i = 0; i < num_buckets; ++i) {
+            std::vector<size_t> dense;
+            kept += Merge(*raw_kmers[i], *res[i], dense, histograms[i], min_count, max_count);
+            raw_kmers[i].reset();
+            for (size_t a = 0; a < dense.size(); ++a) {
+                if (dense[a])
+                    histograms[i][a] += dense[a];
+            }
+        }
+
+        histogram_.clear();
+        for (const auto &hist : histograms) {
+            for (const auto &entry : hist) {
+                histogram_[entry.first] += entry.second;
+                kmers += entry.second;
+            }
+        }
+        INFO("K-mer counting done. There are " << kmers << " kmers in total, "
+             << kept << " of them have abundance within [" << min_count << ", " << max_count << "]");
+        if (!kmers)
+            FATAL_ERROR("No kmers were extracted from reads. Check the read lengths and k-mer length settings");
+
+        return res;
+    }
+
+    // Number of distinct k-mers for every abundance, including the filtered out ones
+    const Histogram &histogram() const {
+        return histogram_;
+    }
+
+    /**
+     * Writes k-mers (optionally followed by 32-bit counts, saturated) of the counted buckets to the file.
+     * If sorted is set, the buckets are merged, so the k-mers go in the order of their data words,
+     * otherwise the buckets are concatenated.
+     */
+    size_t Write(const Buckets &buckets, const std::filesystem::path &ofname, bool counts, bool sorted) const {
+        std::vector<std::unique_ptr<MMappedRecordArrayReader<DataType>>> ins;
+        for (const auto &bucket : buckets)
+            ins.emplace_back(new MMappedRecordArrayReader<DataType>(*bucket, record_size_, /* unlink */ false));
+
+        typedef decltype(ins.front()->begin()) iterator;
+        std::vector<std::vector<adt::iterator_range<iterator>>> groups;
+        if (sorted)
+            groups.emplace_back();
+        for (const auto &in : ins) {
+            if (!sorted)
+                groups.emplace_back();
+            groups.back().push_back(adt::make_range(in->begin(), in->end()));
+        }
+
+        FILE *g = fopen(ofname.c_str(), "wb");
+        if (!g)
+            FATAL_ERROR("Cannot open file " << ofname << " for writing");
+
+        const size_t buffer_size = 1024 * 1024;
+        std::vector<char> buf;
+        buf.reserve(buffer_size + record_size_ * sizeof(DataType));
+        size_t total = 0;
+        for (const auto &ranges : groups) {
+            adt::loser_tree<iterator, adt::array_less<DataType>> tree(ranges);
+            while (!tree.empty()) {
+                const DataType *record = tree.top().data();
+                const char *kmer = reinterpret_cast<const char*>(record);
+                buf.insert(buf.end(), kmer, kmer + kmer_size_ * sizeof(DataType));
+                if (counts) {
+                    uint32_t cnt = uint32_t(std::min<DataType>(record[kmer_size_], std::numeric_limits<uint32_t>::max()));
+                    const char *bytes = reinterpret_cast<const char*>(&cnt);
+                    buf.insert(buf.end(), bytes, bytes + sizeof(cnt));
+                }
+                if (buf.size() >= buffer_size)
+                    Flush(g, buf);
+                total += 1;
+                tree.replay();
+            }
+        }
+        Flush(g, buf);
+        fclose(g);
+
+        return total;
+    }
+
+private:
+    std::unique_ptr<KMerSplitter<Seq>> splitter_;
+    fs::TmpDir work_dir_;
+    size_t kmer_size_;
+    // k-mer data and one word with the count
+    size_t record_size_;
+    Histogram histogram_;
+
+    static void Flush(FILE *f, std::vector<char> &buf) {
+        size_t res = fwrite(buf.data(), 1, buf.size(), f);
+        if (res != buf.size())
+            FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
+        buf.clear();
+    }
+
+    static void Account(uint64_t abundance, std::vector<size_t> &dense, Histogram &sparse) {
+        if (abundance >= DENSE_HISTOGRAM_SIZE) {
+            sparse[abundance] += 1;
+            return;
+        }
+        if (abundance >= dense.size())
+            dense.resize(std::min(std::max(2 * dense.size(), size_t(abundance + 1)), DENSE_HISTOGRAM_SIZE));
+        dense[abundance] += 1;
+    }
+
+    size_t Merge(const std::filesystem::path &ifname, const std::filesystem::path &ofname,
+                 std::vector<size_t> &dense, Histogram &sparse,
+                 uint64_t min_count, uint64_t max_count) const {
+        FILE *g = fopen(ofname.c_str(), "wb");
+        if (!g)
+            FATAL_ERROR("Cannot open temporary file " << ofname << " for writing");
+
+        const size_t buffer_size = 1024 * 1024 * record_size_;
+        Records kmers;
+        kmers.reserve(buffer_size + record_size_);
+        size_t kept = 0;
+        KMerSortingSplitter<Seq>::MergeRuns(ifname, kmer_size_,
+                                            [](DataType count, DataType other) { return count + other; },
+                                            [&](const DataType *record) {
+            uint64_t abundance = record[kmer_size_];
+            Account(abundance, dense, sparse);
+            if (abundance < min_count || abundance > max_count)
+                return;
+            kmers.insert(kmers.end(), record, record + record_size_);
+            kept += 1;
+            if (kmers.size() >= buffer_size) {
+                WriteRecords(g, kmers);
+                kmers.clear();
+            }
+        });
+        WriteRecords(g, kmers);
+        fclose(g);
+
+        return kept;
+    }
+
+    void WriteRecords(FILE *f, const Records &records) const {
+        size_t cnt = records.size() / record_size_;
+        size_t res = fwrite(records.data(), record_size_ * sizeof(DataType), cnt, f);
+        if (res != cnt)
+            FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
+    }
+
+    DECL_LOGGER("KMerAbundanceCounter");
+};
+
+}
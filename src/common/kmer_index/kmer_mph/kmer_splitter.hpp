@@ -9,15 +9,20 @@
 
 #include "kmer_buckets.hpp"
 
+#include "adt/iterator_range.hpp"
 #include "adt/kmer_vector.hpp"
+#include "adt/loser_tree.hpp"
+#include "io/kmers/mmapped_reader.hpp"
 #include "utils/filesystem/file_limit.hpp"
 #include "utils/filesystem/temporary.hpp"
 #include "utils/memory_limit.hpp"
 #include "utils/logger/logger.hpp"
 
 #include <pdqsort/pdqsort_pod.h>
+#include <algorithm>
 #include <string>
 #include <cstdio>
+#include <vector>
 
 namespace kmers {
 
@@ -63,6 +68,73 @@ public:
     KMerSortingSplitter(fs::TmpDir work_dir, unsigned K)
             : KMerSplitter<Seq>(work_dir, K), cell_size_(0), num_files_(0) {}
 
+    // Appends sorted run of cnt records to the raw file and its size to the run index
+    static void AppendRun(const std::filesystem::path &file, const void *data, size_t record_size, size_t cnt) {
+#     pragma omp critical
+        {
+            // Write k-mers
+            FILE *f = fopen(file.c_str(), "ab");
+            if (!f)
+                FATAL_ERROR("Cannot open temporary file " << file << " for writing");
+            size_t res = fwrite(data, record_size, cnt, f);
+            if (res != cnt)
+                FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
+            fclose(f);
+
+            // Write index
+            f = fopen((file.native() + ".idx").c_str(), "ab");
+            if (!f)
+                FATAL_ERROR("Cannot open temporary file " << file << " for writing");
+            res = fwrite(&cnt, sizeof(cnt), 1, f);
+            if (res != 1)
+                FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
+            fclose(f);
+        }
+    }
+
+    // Merges the sorted runs of (k-mer data, payload word) records appended by AppendRun. Runs are sorted by the
+    // k-mer and then by the payload, so the records of the same k-mer are adjacent: their payloads are folded
+    // with combine(payload, other) and emit(record) is called once for every distinct k-mer in increasing order.
+    // kmer_size is the number of data words of the k-mer, the runs are removed afterwards.
+    template<class Combine, class Emit>
+    static void MergeRuns(const std::filesystem::path &file, size_t kmer_size, Combine combine, Emit emit) {
+        using DataType = typename Seq::DataType;
+
+        // Nothing was dumped to the file
+        if (!std::filesystem::exists(file.native() + ".idx"))
+            return;
+
+        size_t record_size = kmer_size + 1;
+        MMappedRecordArrayReader<DataType> ins(file, record_size, /* unlink */ true);
+        MMappedRecordReader<size_t> index(file.native() + ".idx", true, -1ULL);
+
+        std::vector<adt::iterator_range<decltype(ins.begin())>> ranges;
+        auto beg = ins.begin();
+        for (size_t sz : index) {
+            auto end = std::next(beg, sz);
+            ranges.push_back(adt::make_range(beg, end));
+            beg = end;
+        }
+        adt::loser_tree<decltype(beg), adt::array_less<DataType>> tree(ranges);
+
+        std::vector<DataType> last(record_size);
+        bool has_last = false;
+        while (!tree.empty()) {
+            const DataType *record = tree.top().data();
+            if (has_last && std::equal(last.begin(), last.begin() + kmer_size, record)) {
+                last[kmer_size] = combine(last[kmer_size], record[kmer_size]);
+            } else {
+                if (has_last)
+                    emit(last.data());
+                std::copy(record, record + record_size, last.begin());
+                has_last = true;
+            }
+            tree.replay();
+        }
+        if (has_last)
+            emit(last.data());
+    }
+
 protected:
     using SeqKMerVector = adt::KMerVector<Seq>;
     using KMerBuffer = std::vector<SeqKMerVector>;
@@ -138,28 +210,49 @@ protected:
             pdqsort_pod(SortBuffer.data(), SortBuffer.data() + SortBuffer.size() * SortBuffer.el_size(), SortBuffer.el_size());
             auto it = std::unique(SortBuffer.begin(), SortBuffer.end(), typename adt::KMerVector<Seq>::equal_to());
 
-#     pragma omp critical
-            {
-                size_t cnt =  it - SortBuffer.begin();
-
-                // Write k-mers
-                FILE *f = fopen(ostreams[k]->file().c_str(), "ab");
-                if (!f)
-                    FATAL_ERROR("Cannot open temporary file " << ostreams[k]->file() << " for writing");
-                size_t res = fwrite(SortBuffer.data(), SortBuffer.el_data_size(), cnt, f);
-                if (res != cnt)
-                    FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
-                fclose(f);
-
-                // Write index
-                f = fopen((ostreams[k]->file().native() + ".idx").c_str(), "ab");
-                if (!f)
-                    FATAL_ERROR("Cannot open temporary file " << ostreams[k]->file() << " for writing");
-                res = fwrite(&cnt, sizeof(cnt), 1, f);
-                if (res != 1)
-                    FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
-                fclose(f);
+            AppendRun(ostreams[k]->file(), SortBuffer.data(), SortBuffer.el_data_size(), it - SortBuffer.begin());
+        }
+
+        for (auto & entry : kmer_buffers_)
+            for (auto & eentry : entry)
+                eentry.clear();
+    }
+
+    // Same as DumpBuffers, but keeps the multiplicities: every run consists of
+    // (k-mer data, count) records, count takes one more DataType word
+    void DumpCountedBuffers(const RawKMers &ostreams) {
+        VERIFY(ostreams.size() == num_files_ && kmer_buffers_[0].size() == num_files_);
+        using DataType = typename Seq::DataType;
+
+#   pragma omp parallel for
+        for (size_t k = 0; k < num_files_; ++k) {
+            size_t sz = 0;
+            for (size_t i = 0; i < kmer_buffers_.size(); ++i)
+                sz += kmer_buffers_[i][k].size();
+
+            adt::KMerVector<Seq> SortBuffer(this->K_, sz);
+            for (auto & entry : kmer_buffers_) {
+                const auto &buffer = entry[k];
+                for (size_t j = 0; j < buffer.size(); ++j)
+                    SortBuffer.push_back(buffer[j]);
             }
+            size_t el_size = SortBuffer.el_size();
+            pdqsort_pod(SortBuffer.data(), SortBuffer.data() + SortBuffer.size() * el_size, el_size);
+
+            std::vector<DataType> records;
+            records.reserve(sz * (el_size + 1));
+            const DataType *data = SortBuffer.data();
+            for (size_t i = 0; i < SortBuffer.size(); ++i) {
+                const DataType *kmer = data + i * el_size;
+                if (i && std::equal(kmer, kmer + el_size, kmer - el_size)) {
+                    records.back() += 1;
+                    continue;
+                }
+                records.insert(records.end(), kmer, kmer + el_size);
+                records.push_back(1);
+            }
+
+            AppendRun(ostreams[k]->file(), records.data(), (el_size + 1) * sizeof(DataType), records.size() / (el_size + 1));
         }
 
         for (auto & entry : kmer_buffers_)
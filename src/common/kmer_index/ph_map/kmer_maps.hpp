@@ -10,6 +10,12 @@
 #include "perfect_hash_map.hpp"
 #include "io/kmers/kmer_iterator.hpp"
 #include "utils/logger/logger.hpp"
+#include "utils/parallel/openmp_wrapper.h"
+#include "utils/memory_limit.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 
 namespace kmers {
 
@@ -31,27 +37,194 @@ public:
     using base::ConstructKWH;
 
 private:
+    // Fingerprints are derived from a seeded hash, independent from the MPHF one
+    typedef uint16_t Fingerprint;
+    static constexpr uint64_t FINGERPRINT_SEED = 0x9E3779B9;
+    // Minimal size of the per-thread buffer of every range while arranging out of core
+    static constexpr size_t ARRANGE_CELL_SIZE = 1 << 16;
+
     typename traits::ResultFile kmers_file_;
     mutable std::unique_ptr<KMerStorage> kmers_;
+    // Per-slot fingerprints of the stored k-mers (in hash order). Allow to
+    // reject most of the non-members without touching the k-mer storage.
+    bool use_fingerprints_;
+    std::vector<Fingerprint> fingerprints_;
+
+    static Fingerprint fingerprint(const KMer &kmer) {
+        return Fingerprint(typename traits_t::hash_function()(kmer, FINGERPRINT_SEED) >> 48);
+    }
+
+    static Fingerprint fingerprint(typename traits_t::KMerRawReference kmer) {
+        return Fingerprint(typename traits_t::hash_function()(kmer, FINGERPRINT_SEED) >> 48);
+    }
+
+    void FillFingerprints() {
+        fingerprints_.clear();
+        if (!use_fingerprints_ || !kmers_)
+            return;
+
+        size_t sz = kmers_->size();
+        fingerprints_.resize(sz);
+        auto kbegin = kmers_->begin();
+#       pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < sz; ++i)
+            fingerprints_[i] = fingerprint(*(kbegin + i));
+    }
+
+    // Writes count k-mer records to the k-mer file starting from the given slot
+    void WriteKMers(const typename KMer::DataType *data, size_t start, size_t count, size_t elcnt) const {
+        size_t record_size = elcnt * sizeof(typename KMer::DataType);
+        FILE *f = fopen(kmers_file_->file().c_str(), "r+b");
+        if (!f)
+            FATAL_ERROR("Cannot open file " << kmers_file_->file() << " for writing");
+        if (fseeko(f, off_t(start * record_size), SEEK_SET) != 0)
+            FATAL_ERROR("Cannot seek in file " << kmers_file_->file() << ". Reason: " << strerror(errno));
+        size_t res = fwrite(data, record_size, count, f);
+        if (res != count)
+            FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
+        fclose(f);
+    }
+
+    // Places the k-mers into their MPHF slots using an in-memory buffer
+    void ArrangeKMersInMemory(KMerStorage &storage) const {
+        typedef typename KMer::DataType DataType;
+        size_t kmers = storage.size(), elcnt = storage.elcnt();
+        const DataType *data = storage.data();
+        auto kbegin = storage.begin();
+
+        std::vector<DataType> buffer(kmers * elcnt);
+#       pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < kmers; ++i) {
+            size_t idx = this->raw_seq_idx(*(kbegin + i));
+            VERIFY(idx < kmers);
+            std::copy(data + i * elcnt, data + (i + 1) * elcnt, buffer.data() + idx * elcnt);
+        }
+
+        WriteKMers(buffer.data(), 0, kmers, elcnt);
+    }
+
+    // Scatters the k-mers into files covering ranges of MPHF slots (with
+    // sequential writes), then lays out every range independently. Only a
+    // single range per thread is kept in memory. Spilled records are bare
+    // k-mers, their slots are recomputed when the range is laid out.
+    void ArrangeKMersOutOfCore(KMerStorage &storage, size_t range, unsigned nthreads) const {
+        typedef typename KMer::DataType DataType;
+        size_t kmers = storage.size(), elcnt = storage.elcnt();
+        size_t record_size = elcnt * sizeof(DataType);
+        size_t nranges = (kmers + range - 1) / range;
+        const DataType *data = storage.data();
+        auto kbegin = storage.begin();
+
+        std::vector<fs::DependentTmpFile> ranges;
+        for (size_t r = 0; r < nranges; ++r)
+            ranges.emplace_back(kmers_file_->CreateDep("arrange." + std::to_string(r)));
+
+        // Range files are opened for every flush only, so the number of ranges
+        // is not bounded by the descriptor limit. Every range is guarded by its
+        // own lock, so the threads only wait for each other when flushing into
+        // the same range
+        std::vector<omp_lock_t> locks(nranges);
+        for (auto &lock : locks)
+            omp_init_lock(&lock);
+
+        // Cell is flushed to the range file as soon as it becomes full
+        size_t cell_size = std::max(ARRANGE_CELL_SIZE, range * record_size / (8 * nranges));
+        std::vector<std::vector<std::vector<char>>> cells(nthreads, std::vector<std::vector<char>>(nranges));
+        auto flush = [&](size_t r, std::vector<char> &cell) {
+            omp_set_lock(&locks[r]);
+            FILE *f = fopen(ranges[r]->file().c_str(), "ab");
+            if (!f)
+                FATAL_ERROR("Cannot open temporary file " << ranges[r]->file() << " for writing");
+            size_t res = fwrite(cell.data(), 1, cell.size(), f);
+            fclose(f);
+            omp_unset_lock(&locks[r]);
+            if (res != cell.size())
+                FATAL_ERROR("I/O error! Incomplete write! Reason: " << strerror(errno) << ". Error code: " << errno);
+            cell.clear();
+        };
+
+#       pragma omp parallel for schedule(static) num_threads(nthreads)
+        for (size_t i = 0; i < kmers; ++i) {
+            auto &thread_cells = cells[omp_get_thread_num()];
+            size_t idx = this->raw_seq_idx(*(kbegin + i));
+            VERIFY(idx < kmers);
+            auto &cell = thread_cells[idx / range];
+            const char *record = reinterpret_cast<const char*>(data + i * elcnt);
+            cell.insert(cell.end(), record, record + record_size);
+            if (cell.size() >= cell_size)
+                flush(idx / range, cell);
+        }
 
-    void SortUniqueKMers() const {
-        if (!kmers_)
-            kmers_.reset(new KMerStorage(*kmers_file_, KMer::GetDataSize(base::k())));
-
-        size_t swaps = 0;
-        INFO("Arranging kmers in hash map order");
-        for (auto I = kmers_->begin(), E = kmers_->end(); I != E; ++I) {
-            size_t cidx = I - kmers_->begin();
-            size_t kidx = this->raw_seq_idx(*I);
-            while (cidx != kidx) {
-                auto J = kmers_->begin() + kidx;
-                using std::swap;
-                swap(*I, *J);
-                swaps += 1;
-                kidx = this->raw_seq_idx(*I);
+#       pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+        for (size_t r = 0; r < nranges; ++r) {
+            for (auto &thread_cells : cells) {
+                if (!thread_cells[r].empty())
+                    flush(r, thread_cells[r]);
+                std::vector<char>().swap(thread_cells[r]);
             }
+            omp_destroy_lock(&locks[r]);
+        }
+
+#       pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+        for (size_t r = 0; r < nranges; ++r) {
+            size_t start = r * range, end = std::min(kmers, start + range);
+            std::vector<DataType> buffer((end - start) * elcnt);
+
+            FILE *f = fopen(ranges[r]->file().c_str(), "rb");
+            if (!f)
+                FATAL_ERROR("Cannot open temporary file " << ranges[r]->file() << " for reading");
+            const size_t chunk_records = 1 << 16;
+            std::vector<DataType> chunk(chunk_records * elcnt);
+            size_t placed = 0, cnt;
+            while ((cnt = fread(chunk.data(), record_size, chunk_records, f)) > 0) {
+                adt::array_vector<DataType> records(chunk.data(), cnt, elcnt);
+                for (size_t j = 0; j < cnt; ++j) {
+                    size_t idx = this->raw_seq_idx(*(records.begin() + j));
+                    VERIFY(start <= idx && idx < end);
+                    std::copy(chunk.data() + j * elcnt, chunk.data() + (j + 1) * elcnt,
+                              buffer.data() + (idx - start) * elcnt);
+                }
+                placed += cnt;
+            }
+            fclose(f);
+            VERIFY(placed == end - start);
+
+            WriteKMers(buffer.data(), start, end - start, elcnt);
         }
-        INFO("Done. Total swaps: " << swaps);
+    }
+
+    // Half of the free memory is used if mem_limit is not set. The k-mer file
+    // is rewritten in place, the storage mapping is read-only.
+    void SortUniqueKMers(size_t mem_limit = 0) const {
+        VERIFY(!kmers_);
+        size_t kmers;
+        {
+            KMerStorage storage(*kmers_file_, KMer::GetDataSize(base::k()), /* unlink */ false);
+            kmers = storage.size();
+            size_t record_size = storage.elcnt() * sizeof(typename KMer::DataType);
+            unsigned nthreads = omp_get_max_threads();
+            if (!mem_limit)
+                mem_limit = utils::get_free_memory() / 2;
+
+            INFO("Arranging kmers in hash map order");
+            if (kmers * record_size <= mem_limit) {
+                ArrangeKMersInMemory(storage);
+            } else {
+                // Every thread keeps a single range of slots in memory at a time
+                // while laying them out, and a buffer for every range while
+                // scattering: nthreads * range * record_size and
+                // nthreads * nranges * ARRANGE_CELL_SIZE bytes, both should fit
+                // into mem_limit, which bounds the number of threads
+                size_t max_threads = size_t(double(mem_limit) /
+                                            std::sqrt(double(kmers) * double(record_size) * double(ARRANGE_CELL_SIZE)));
+                nthreads = unsigned(std::max<size_t>(1, std::min<size_t>(nthreads, max_threads)));
+                size_t range = std::max<size_t>(1 << 16, mem_limit / (nthreads * record_size));
+                INFO("Not enough memory to arrange in core, using " << (kmers + range - 1) / range << " ranges");
+                ArrangeKMersOutOfCore(storage, range, nthreads);
+            }
+        }
+        kmers_.reset(new KMerStorage(*kmers_file_, KMer::GetDataSize(base::k())));
+        INFO("Done. Total kmers: " << kmers);
     }
 
 protected:
@@ -63,6 +236,7 @@ protected:
     template<class Reader>
     void BinReadKmers(Reader &reader, const std::string &FileName) {
         this->kmers_ = traits_t::raw_deserialize(reader, FileName);
+        FillFingerprints();
     }
 
 public:
@@ -78,11 +252,13 @@ public:
         BinReadKmers(reader, FileName);
     }
 
-    KeyStoringMap(unsigned k)
-            : base(k), kmers_(nullptr) {}
+    KeyStoringMap(unsigned k, bool use_fingerprints = false)
+            : base(k), kmers_(nullptr), use_fingerprints_(use_fingerprints) {}
 
     KeyStoringMap(KeyStoringMap&& other)
-            : base(std::move(other)), kmers_(std::move(other.kmers_)) {}
+            : base(std::move(other)), kmers_(std::move(other.kmers_)),
+              use_fingerprints_(other.use_fingerprints_),
+              fingerprints_(std::move(other.fingerprints_)) {}
 
     KMer true_kmer(KeyWithHash kwh) const {
         VERIFY(this->valid(kwh));
@@ -94,6 +270,7 @@ public:
     void clear() {
         base::clear();
         kmers_.reset(nullptr);
+        fingerprints_.clear();
     }
 
     kmer_iterator kmer_begin() {
@@ -114,11 +291,12 @@ public:
         if (!base::valid(kwh))
             return false;
 
+        KMer kmer = kwh.is_minimal() ? kwh.key() : !kwh.key();
+        if (!fingerprints_.empty() && fingerprints_[kwh.idx()] != fingerprint(kmer))
+            return false;
+
         auto it = this->kmers_->begin() + kwh.idx();
-        if (!kwh.is_minimal())
-            return (typename traits_t::raw_equal_to()(!kwh.key(), *it));
-        else
-            return (typename traits_t::raw_equal_to()(kwh.key(), *it));
+        return (typename traits_t::raw_equal_to()(kmer, *it));
     }
 
     /**
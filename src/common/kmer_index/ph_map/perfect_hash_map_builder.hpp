@@ -92,6 +92,10 @@ struct CQFHashMapBuilder {
 };
 
 struct KeyStoringIndexBuilder {
+    // Memory limit to arrange the stored k-mers with, half of the free memory if not set
+    KeyStoringIndexBuilder(size_t arrange_mem_limit = 0)
+            : arrange_mem_limit_(arrange_mem_limit) {}
+
     template<class K, class V, class traits, class StoringType, class Counter>
     void BuildIndex(KeyStoringMap<K, V, traits, StoringType> &index,
                     Counter& counter, size_t bucket_num,
@@ -99,11 +103,13 @@ struct KeyStoringIndexBuilder {
         auto res = phm_builder_.BuildIndex(index, counter, bucket_num, thread_num, true);
         VERIFY(!index.kmers_.get());
         index.kmers_file_ = res.final_kmers();
-        index.SortUniqueKMers();
+        index.SortUniqueKMers(arrange_mem_limit_);
+        index.FillFingerprints();
     }
 
   private:
     PerfectHashMapBuilder phm_builder_;
+    size_t arrange_mem_limit_;
 };
 
 struct KeyIteratingIndexBuilder {
@@ -115,6 +121,14 @@ struct KeyIteratingIndexBuilder {
         index.kmers_ = res.final_kmers();
     }
 
+    // For the index built from the storage directly: merges its buckets and keeps them for k-mer iteration
+    template<class K, class V, class traits, class StoringType, class Seq>
+    void AttachKMers(KeyIteratingMap<K, V, traits, StoringType> &index,
+                     kmers::KMerDiskStorage<Seq> &storage) const {
+        storage.merge();
+        index.kmers_ = storage.final_kmers();
+    }
+
   private:
     PerfectHashMapBuilder phm_builder_;
 };
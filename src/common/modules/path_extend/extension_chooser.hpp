@@ -10,6 +10,7 @@
 #define EXTENSION_HPP_
 
 #include "pe_utils.hpp"
+#include "path_occurrence_index.hpp"
 #include "weight_counter.hpp"
 
 #include "alignment/rna/ss_coverage.hpp"
@@ -971,8 +972,11 @@ public:
         : ExtensionChooser(g),
           filtering_threshold_(filtering_threshold),
           min_significant_overlap_(min_significant_overlap),
-          cov_map_(read_paths_cov_map)
+          index_(read_paths_cov_map)
     {
+        first_long_edge_ = index_.FirstPositions([&](EdgeId e) {
+            return g_.length(e) >= min_significant_overlap_;
+        });
         DEBUG("Created LongReadsRNAExtensionChooser with params: filtering_threshold_ = " << filtering_threshold_ << ", min_significant_overlap_ = " << min_significant_overlap_);
     }
 
@@ -996,25 +1000,19 @@ public:
         }
 
         std::set<EdgeId> filtered_candidates;
-        auto support_paths = cov_map_.GetCoveringPaths(path.Back());
-        DEBUG("Found " << support_paths.size() << " supporting paths");
-        for (auto it = support_paths.begin(); it != support_paths.end(); ++it) {
-            auto supporting_path = *it;
-            auto positions = supporting_path->FindAll(path.Back());
-
-            for (size_t i = 0; i < positions.size(); ++i) {
-                if ((int) positions[i] < (int) supporting_path->Size() - 1
-                    && EqualBegins(path, path.Size() - 1, *supporting_path, positions[i], false)) {
-                    DEBUG("Supporting path matches, Checking unique path_back for " << supporting_path->GetId());
-
-                    if (UniqueBackPath(*supporting_path, positions[i])) {
-                        DEBUG("Success");
-
-                        EdgeId next = supporting_path->At(positions[i] + 1);
-                        weights_candidates[next] += supporting_path->GetWeight();
-                        filtered_candidates.insert(next);
-                    }
-                }
+        std::vector<PathOccurrenceIndex::OccurrenceId> matches;
+        index_.Matches(path, path.Size() - 1, matches);
+        DEBUG("Found " << matches.size() << " matching positions of supporting paths");
+        for (auto id : matches) {
+            const auto &occ = index_[id];
+            DEBUG("Supporting path matches, Checking unique path_back for " << occ.path->GetId());
+
+            if (occ.pos >= first_long_edge_[occ.path_idx]) {
+                DEBUG("Success");
+
+                EdgeId next = occ.path->At(occ.pos + 1);
+                weights_candidates[next] += occ.path->GetWeight();
+                filtered_candidates.insert(next);
             }
         }
         DEBUG("Supported candidates");
@@ -1040,16 +1038,6 @@ public:
 
 private:
 
-    bool UniqueBackPath(const BidirectionalPath& path, size_t pos) const {
-        int int_pos = (int) pos;
-        while (int_pos >= 0) {
-            if (g_.length(path.At(int_pos)) >= min_significant_overlap_)
-                return true;
-            int_pos--;
-        }
-        return false;
-    }
-
     std::vector<std::pair<EdgeId, double> > MapToSortVector(const std::map<EdgeId, double>& map) const {
         std::vector<std::pair<EdgeId, double> > result(map.begin(), map.end());
         std::sort(result.begin(), result.end(), EdgeWithWeightCompareReverse<EdgeId>);
@@ -1058,7 +1046,9 @@ private:
 
     double filtering_threshold_;
     size_t min_significant_overlap_;
-    const GraphCoverageMap& cov_map_;
+    PathOccurrenceIndex index_;
+    //first position of an edge not shorter than min_significant_overlap_ for every indexed path
+    std::vector<size_t> first_long_edge_;
 
     DECL_LOGGER("LongReadsRNAExtensionChooser");
 };
@@ -1080,8 +1070,12 @@ public:
               cov_map_(read_paths_cov_map),
               unique_edge_analyzer_(g, cov_map_, filtering_threshold,
                                     unique_edge_priority_threshold,
-                                    max_repeat_length, uneven_depth)
+                                    max_repeat_length, uneven_depth),
+              index_(cov_map_)
     {
+        first_unique_edge_ = index_.FirstPositions([&](EdgeId e) {
+            return unique_edge_analyzer_.IsUnique(e) && g_.length(e) >= min_significant_overlap_;
+        });
     }
 
     /* Choose extension as correct only if we have reads that traverse a unique edge from the path and this extension.
@@ -1099,24 +1093,19 @@ public:
             weights_cands.emplace(edge.e_, 0.0);
         }
         std::set<EdgeId> filtered_cands;
-        auto support_paths = cov_map_.GetCoveringPaths(path.Back());
-        DEBUG("Found " << support_paths.size() << " covering paths!!!");
-        for (auto it = support_paths.begin(); it != support_paths.end(); ++it) {
-            auto positions = (*it)->FindAll(path.Back());
-            for (size_t i = 0; i < positions.size(); ++i) {
-                if ((int) positions[i] < (int) (*it)->Size() - 1
-                        && EqualBegins(path, (int) path.Size() - 1, **it,
-                                       positions[i], false)) {
-                    DEBUG("Checking unique path_back for " << (*it)->GetId());
-
-                    if (UniqueBackPath(**it, positions[i])) {
-                        DEBUG("Success");
-
-                        EdgeId next = (*it)->At(positions[i] + 1);
-                        weights_cands[next] += (*it)->GetWeight();
-                        filtered_cands.insert(next);
-                    }
-                }
+        std::vector<PathOccurrenceIndex::OccurrenceId> matches;
+        index_.Matches(path, path.Size() - 1, matches);
+        DEBUG("Found " << matches.size() << " matching positions of covering paths");
+        for (auto id : matches) {
+            const auto &occ = index_[id];
+            DEBUG("Checking unique path_back for " << occ.path->GetId());
+
+            if (occ.pos >= first_unique_edge_[occ.path_idx]) {
+                DEBUG("Success");
+
+                EdgeId next = occ.path->At(occ.pos + 1);
+                weights_cands[next] += occ.path->GetWeight();
+                filtered_cands.insert(next);
             }
         }
         DEBUG("Candidates");
@@ -1152,16 +1141,6 @@ public:
 
 private:
 
-    bool UniqueBackPath(const BidirectionalPath& path, size_t pos) const {
-        int int_pos = (int) pos;
-        while (int_pos >= 0) {
-            if (unique_edge_analyzer_.IsUnique(path.At(int_pos)) > 0 && g_.length(path.At(int_pos)) >= min_significant_overlap_)
-                return true;
-            int_pos--;
-        }
-        return false;
-    }
-
     std::vector<std::pair<EdgeId, double>> MapToSortVector(const std::map<EdgeId, double>& map) const {
         std::vector<std::pair<EdgeId, double>> result(map.begin(), map.end());
         std::sort(result.begin(), result.end(), EdgeWithWeightCompareReverse<EdgeId>);
@@ -1173,6 +1152,9 @@ private:
     size_t min_significant_overlap_;
     const GraphCoverageMap& cov_map_;
     LongReadsUniqueEdgeAnalyzer unique_edge_analyzer_;
+    PathOccurrenceIndex index_;
+    //first position of a unique edge not shorter than min_significant_overlap_ for every indexed path
+    std::vector<size_t> first_unique_edge_;
 
     DECL_LOGGER("LongReadsExtensionChooser");
 };
@@ -1197,6 +1179,7 @@ public:
                                     unique_edge_priority_threshold,
                                     max_repeat_length, uneven_depth)
             , use_low_quality_matching_(use_low_quality_matching)
+            , index_(cov_map_)
     {}
 
     /// @returns the possible next edge of the path
@@ -1236,43 +1219,38 @@ public:
 
 private:
 
-    /// @return (there are covering paths that contains 'path[start_pos]')
-    std::pair<bool, std::set<EdgeWithDistance>> GetCandidates(const BidirectionalPath &path,
-                                             std::map<EdgeWithDistance, double> &weights_cands,
-                                             size_t start_pos,
+    /// @param occurrences covering path positions to check, followed by the candidate edges
+    std::set<EdgeWithDistance> GetCandidates(std::map<EdgeWithDistance, double> &weights_cands,
+                                             const std::vector<PathOccurrenceIndex::OccurrenceId> &occurrences,
                                              const std::function<std::pair<bool, size_t>(const BidirectionalPath&, size_t)> &comparator) const
     {
-        VERIFY(start_pos < path.Size());
         std::set<EdgeWithDistance> filtered_cands;
-        auto support_paths = cov_map_.GetCoveringPaths(path[start_pos]);
-        DEBUG("Found " << support_paths.size() << " covering paths!!!");
-        for (auto const & it : support_paths) {
-            for (auto pos : it->FindAll(path[start_pos])) {
-                if (pos + 1 < it->Size()) {
-                    auto tmp = comparator(*it, pos);
-                    auto& is_good_path = tmp.first;
-                    auto& matched_len = tmp.second;
-                    if (is_good_path) {
-                        auto gap = it->GapAt(pos + 1);
-                        EdgeWithDistance next = {it->At(pos + 1), gap.gap, std::move(gap.gap_seq)};
-                        weights_cands[next] += static_cast<double>(matched_len)*it->GetWeight();
-                        filtered_cands.insert(next);
-                    }
-                }
+        DEBUG("Found " << occurrences.size() << " positions of covering paths");
+        for (auto id : occurrences) {
+            const auto &occ = index_[id];
+            auto tmp = comparator(*occ.path, occ.pos);
+            auto& is_good_path = tmp.first;
+            auto& matched_len = tmp.second;
+            if (is_good_path) {
+                auto gap = occ.path->GapAt(occ.pos + 1);
+                EdgeWithDistance next = {occ.path->At(occ.pos + 1), gap.gap, std::move(gap.gap_seq)};
+                weights_cands[next] += static_cast<double>(matched_len)*occ.path->GetWeight();
+                filtered_cands.insert(next);
             }
         }
-        return {!support_paths.empty(), std::move(filtered_cands)};
+        return filtered_cands;
     }
 
     std::set<EdgeWithDistance> GetHighQualityCandidats(const BidirectionalPath &path, std::map<EdgeWithDistance, double> &weights_cands) const {
         auto start_pos = path.Size() - 1;
-        auto comparator = [&path, start_pos, th = this] (const BidirectionalPath &coverage_path, size_t pos) {
-            auto is_good_path = (FirstNotEqualPosition(path, start_pos, coverage_path, pos, false) == -1ul);
-            auto matched_len = start_pos + 1;
-            auto privilege_scalar = (th->HasUniqueEdge(path, 0, matched_len) ? 3 : 1);
-            return std::pair<bool, size_t>(is_good_path, matched_len * privilege_scalar);
+        std::vector<PathOccurrenceIndex::OccurrenceId> matches;
+        index_.Matches(path, start_pos, matches);
+        auto matched_len = start_pos + 1;
+        auto privilege_scalar = (HasUniqueEdge(path, 0, matched_len) ? 3 : 1);
+        auto comparator = [weight = matched_len * privilege_scalar] (const BidirectionalPath &, size_t) {
+            return std::pair<bool, size_t>(true, weight);
         };
-        return GetCandidates(path, weights_cands, start_pos, comparator).second;
+        return GetCandidates(weights_cands, matches, comparator);
     }
 
     std::set<EdgeWithDistance> GetLowQualityCandidats(const BidirectionalPath &path, std::map<EdgeWithDistance, double> &weights_cands) const {
@@ -1304,11 +1282,10 @@ private:
             DEBUG("iteration: " << i);
             auto pos = path.Size() - 1 - i;
             used_unique_edge = IsUniqueEdge(path[pos]);
-            auto tmp = GetCandidates(path, weights_cands, pos, get_comparator(pos));
-            auto& coverage_paths_are_found = tmp.first;
-            auto& filtered_cands = tmp.second;
+            auto filtered_cands = GetCandidates(weights_cands, index_.Occurrences(path[pos]), get_comparator(pos));
+            bool coverage_paths_are_found = cov_map_.GetCoverage(path[pos]) > 0;
             if (!filtered_cands.empty() || coverage_paths_are_found)
-                return std::move(filtered_cands);
+                return filtered_cands;
         }
         DEBUG("Fallback mode does not help");
         return {};
@@ -1339,6 +1316,7 @@ private:
     const GraphCoverageMap& cov_map_;
     LongReadsUniqueEdgeAnalyzer unique_edge_analyzer_;
     bool use_low_quality_matching_;
+    PathOccurrenceIndex index_;
 
     DECL_LOGGER("TrustedContigsExtensionChooser");
 };
@@ -80,6 +80,11 @@ bool LoopDetector::PathIsLoop(size_t edges) const {
     if (edges == 0 || path_.Size() <= 1)
         return false;
 
+    //path is a loop iff it has period 'edges' and its prefix of this size equals to the suffix
+    if (edges <= path_.Size())
+        return path_.EqualSubPaths(0, edges, path_.Size() - edges) &&
+               path_.EqualSubPaths(0, path_.Size() - edges, edges);
+
     for (size_t i = 0; i < edges; ++i) {
         EdgeId e = path_.At(i);
         for (int j = (int) path_.Size() - ((int) edges - (int) i); j >= 0; j -= (int) edges) {
@@ -100,13 +105,13 @@ size_t LoopDetector::LastLoopCount(size_t edges) const {
     if (edges == 0)
         return 0;
 
-    BidirectionalPath loop = path_.SubPath(path_.Size() - edges);
+    size_t loop_start = path_.Size() - edges;
     size_t count = 0;
     int i = (int) path_.Size() - (int) edges;
     int delta = -(int) edges;
 
     while (i >= 0) {
-        if (!path_.CompareFrom(i, loop)) {
+        if (!path_.EqualSubPaths(i, loop_start, edges)) {
             break;
         }
         ++count;
@@ -292,10 +292,7 @@ public:
         if (path.Size() <= 2) {
             return false;
         }
-        BidirectionalPath last = path.SubPath(path.Size() - 2);
-        int pos = path.FindFirst(last);
-        VERIFY(pos >= 0);
-        return size_t(pos) != path.Size() - 2;
+        return path.FindFirstOccurrenceOfTail(path.Size() - 2) != path.Size() - 2;
     }
 
     /// @returns whether there is more than one inclusion of the path tail that is not shorter than 'min_cycle_len'.
@@ -319,9 +316,7 @@ public:
         TRACE("last is pos " << i);
         if (i < 0) return -1;
 //Tail
-        BidirectionalPath last = path.SubPath(i);
-
-        int pos = path.FindFirst(last);
+        int pos = (int) path.FindFirstOccurrenceOfTail(i);
 // not cycle
         if (pos == i) pos = -1;
         TRACE("looking for 1sr IS cycle " << pos);
@@ -355,7 +350,7 @@ public:
         for (const auto &entry : visited_cycles_coverage_map_.GetEdgePaths(path.Back())) {
             const BidirectionalPath &cycle = *entry.first;
             DEBUG("checking  cycle ");
-            int pos = path.FindLast(cycle);
+            int pos = path.FindLastOccurrence(cycle);
             if (pos == -1)
                 continue;
 
@@ -373,7 +368,9 @@ public:
                 }
             }
             DEBUG("last_cycle_pos " << last_cycle_pos);
-            only_cycles_in_tail = only_cycles_in_tail && cycle.CompareFrom(0, path.SubPath(last_cycle_pos));
+            for (int i = last_cycle_pos; only_cycles_in_tail && i < (int) path.Size(); ++i) {
+                only_cycles_in_tail = i - last_cycle_pos < (int) cycle.Size() && cycle[i - last_cycle_pos] == path[i];
+            }
             if (only_cycles_in_tail) {
 // seems that most of this is useless, checking
                 VERIFY (last_cycle_pos == start_cycle_pos);
@@ -465,10 +462,9 @@ protected:
     bool TryUseEdge(BidirectionalPath &path, EdgeId e, const Gap &gap);
     bool DetectCycle(BidirectionalPath& path);
 
-    bool DetectCycleScaffolding(BidirectionalPath& path, EdgeId e) {
-        auto temp_path = BidirectionalPath::clone(path);
-        temp_path->PushBack(e);
-        return is_detector_.CheckCycledNonIS(*temp_path);
+    //same as is_detector_.CheckCycledNonIS for the path extended with e
+    bool DetectCycleScaffolding(const BidirectionalPath& path, EdgeId e) const {
+        return path.Size() >= 2 && path.ContainsPair(path.Back(), e);
     }
 
     virtual bool MakeSimpleGrowStep(BidirectionalPath& path, PathContainer* paths_storage = nullptr) = 0;
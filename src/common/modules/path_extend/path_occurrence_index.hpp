@@ -0,0 +1,152 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#pragma once
+
+#include "pe_utils.hpp"
+
+#include "parallel_hashmap/phmap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace path_extend {
+
+/**
+ * Immutable index of the edge occurrences in the paths of a coverage map (e.g. long reads mapped to the graph).
+ * Only occurrences followed by another edge of the same path are indexed, since the extension choosers
+ * are interested in the next edge. Occurrences are numbered in (path id, position) order, which is the
+ * order of GraphCoverageMap::GetCoveringPaths + BidirectionalPath::FindAll traversal.
+ * Every occurrence is additionally keyed by the hash of the up to context_ edges ending at it,
+ * so the reads with the same begin as a given path are looked up without scanning all the covering ones.
+ * Index is a snapshot: paths must not be changed after it is built.
+ */
+class PathOccurrenceIndex {
+public:
+    typedef uint32_t OccurrenceId;
+
+    struct Occurrence {
+        const BidirectionalPath *path;
+        size_t path_idx;
+        size_t pos;
+    };
+
+    static constexpr size_t NO_POSITION = std::numeric_limits<size_t>::max();
+
+    explicit PathOccurrenceIndex(const GraphCoverageMap &cov_map, size_t context = 4)
+            : context_(context) {
+        VERIFY(context_ > 0);
+        phmap::flat_hash_set<const BidirectionalPath*> paths;
+        for (const auto &entry : cov_map) {
+            for (const auto &path_cov : entry.second)
+                paths.insert(path_cov.first);
+        }
+        paths_.assign(paths.begin(), paths.end());
+        std::sort(paths_.begin(), paths_.end(), [](const BidirectionalPath *p1, const BidirectionalPath *p2) {
+            return p1->GetId() < p2->GetId();
+        });
+
+        for (size_t i = 0; i < paths_.size(); ++i) {
+            const BidirectionalPath &path = *paths_[i];
+            for (size_t pos = 0; pos + 1 < path.Size(); ++pos) {
+                VERIFY(occurrences_.size() < std::numeric_limits<OccurrenceId>::max());
+                OccurrenceId id = OccurrenceId(occurrences_.size());
+                occurrences_.push_back({&path, i, pos});
+                by_edge_[path.At(pos)].push_back(id);
+                by_context_[ContextKey(path, pos, std::min(context_, pos + 1))].push_back(id);
+            }
+        }
+    }
+
+    const std::vector<const BidirectionalPath*> &paths() const {
+        return paths_;
+    }
+
+    const Occurrence &operator[](OccurrenceId id) const {
+        return occurrences_[id];
+    }
+
+    //all the occurrences of e followed by another edge
+    const std::vector<OccurrenceId> &Occurrences(EdgeId e) const {
+        auto it = by_edge_.find(e);
+        return it == by_edge_.end() ? empty_ : it->second;
+    }
+
+    //for every path, the first position of an edge satisfying pred or NO_POSITION
+    template<class Pred>
+    std::vector<size_t> FirstPositions(Pred pred) const {
+        std::vector<size_t> result(paths_.size(), NO_POSITION);
+        for (size_t i = 0; i < paths_.size(); ++i) {
+            for (size_t pos = 0; pos < paths_[i]->Size(); ++pos) {
+                if (pred(paths_[i]->At(pos))) {
+                    result[i] = pos;
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Finds occurrences o of path[end_pos] with EqualBegins(path, end_pos, *o.path, o.pos, false),
+     * i.e. the paths agree backwards until one of them starts. Result is in occurrence id order.
+     */
+    void Matches(const BidirectionalPath &path, size_t end_pos,
+                 std::vector<OccurrenceId> &result) const {
+        VERIFY(end_pos < path.Size());
+        result.clear();
+        size_t len = end_pos + 1;
+        if (len < context_) {
+            //path is shorter than the context, it may end anywhere inside the read
+            for (OccurrenceId id : Occurrences(path.At(end_pos))) {
+                if (IsMatch(path, end_pos, id))
+                    result.push_back(id);
+            }
+            return;
+        }
+
+        //either the read starts within the last context_ edges of the path or they are fully equal
+        for (size_t c = 1; c <= context_; ++c) {
+            auto it = by_context_.find(ContextKey(path, end_pos, c));
+            if (it == by_context_.end())
+                continue;
+            for (OccurrenceId id : it->second) {
+                if ((c == context_ || occurrences_[id].pos + 1 == c) && IsMatch(path, end_pos, id))
+                    result.push_back(id);
+            }
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+
+private:
+    static uint64_t Mix(uint64_t h, uint64_t v) {
+        return h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+    }
+
+    static uint64_t ContextKey(const BidirectionalPath &path, size_t end_pos, size_t len) {
+        uint64_t h = len;
+        for (size_t i = end_pos + 1 - len; i <= end_pos; ++i)
+            h = Mix(h, path.At(i).int_id());
+        return h;
+    }
+
+    bool IsMatch(const BidirectionalPath &path, size_t end_pos, OccurrenceId id) const {
+        const Occurrence &occ = occurrences_[id];
+        return EqualBegins(path, end_pos, *occ.path, occ.pos, false);
+    }
+
+    size_t context_;
+    std::vector<const BidirectionalPath*> paths_;
+    std::vector<Occurrence> occurrences_;
+    phmap::flat_hash_map<EdgeId, std::vector<OccurrenceId>> by_edge_;
+    phmap::flat_hash_map<uint64_t, std::vector<OccurrenceId>> by_context_;
+    const std::vector<OccurrenceId> empty_;
+};
+
+}
@@ -7,6 +7,7 @@
 
 #include "scaff_supplementary.hpp"
 #include "assembly_graph/dijkstra/dijkstra_helper.hpp"
+#include "utils/parallel/openmp_wrapper.h"
 
 #include <algorithm>
 
@@ -87,40 +88,81 @@ bool ScaffoldingUniqueEdgeAnalyzer::ConservativeByLength(EdgeId e) {
     return graph_.length(e) >= length_cutoff_;
 }
 
-map<EdgeId, size_t> ScaffoldingUniqueEdgeAnalyzer::FillNextEdgeVoting(BidirectionalPathMap<size_t>& active_paths, int direction) const {
-    map<EdgeId, size_t> voting;
-    for (const auto &pair: active_paths) {
-        int current_pos = int(pair.second) + direction;
-        auto path_iter = pair.first;
+void ScaffoldingUniqueEdgeAnalyzer::FillNextEdgeVoting(std::vector<ActivePath> &active_paths, int direction,
+                                                       std::vector<std::pair<EdgeId, size_t>> &voting) const {
+    voting.clear();
+    for (auto &active : active_paths) {
         //not found
-        active_paths[path_iter] = path_iter->Size();
-        while (current_pos >= 0 && current_pos < (int) path_iter->Size()) {
-            if (graph_.length(path_iter->At(current_pos)) >= length_cutoff_) {
-                voting[path_iter->At(current_pos)] += size_t(round(path_iter->GetWeight()));
-                active_paths[path_iter] = size_t(current_pos);
-                break;
-            }
-            current_pos += direction;
+        if (direction > 0 ? active.idx + 1 >= active.long_positions->size() : active.idx == 0) {
+            active.idx = active.long_positions->size();
+            continue;
+        }
+        active.idx += direction;
+        voting.emplace_back(active.path->At((*active.long_positions)[active.idx]), active.weight);
+    }
+
+    //sum up the votes per edge, in the order of edges
+    std::sort(voting.begin(), voting.end());
+    size_t merged = 0;
+    for (size_t i = 0; i < voting.size(); ++i) {
+        if (merged > 0 && voting[merged - 1].first == voting[i].first)
+            voting[merged - 1].second += voting[i].second;
+        else
+            voting[merged++] = voting[i];
+    }
+    voting.resize(merged);
+}
+
+ScaffoldingUniqueEdgeAnalyzer::LongEdgePositions
+ScaffoldingUniqueEdgeAnalyzer::IndexLongEdgePositions(const GraphCoverageMap &long_reads_cov_map) const {
+    LongEdgePositions long_positions;
+    for (const auto &entry : long_reads_cov_map) {
+        if (graph_.length(entry.first) < length_cutoff_)
+            continue;
+        for (const auto &path_entry : entry.second)
+            long_positions.try_emplace(path_entry.first);
+    }
+
+    std::vector<LongEdgePositions::value_type*> paths;
+    paths.reserve(long_positions.size());
+    for (auto &entry : long_positions)
+        paths.push_back(&entry);
+
+#   pragma omp parallel for schedule(guided)
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const BidirectionalPath &path = *paths[i]->first;
+        auto &positions = paths[i]->second;
+        for (size_t pos = 0; pos < path.Size(); ++pos) {
+            if (graph_.length(path.At(pos)) >= length_cutoff_)
+                positions.push_back(pos);
         }
     }
-    return voting;
+    return long_positions;
 }
 
 bool ScaffoldingUniqueEdgeAnalyzer::ConservativeByPaths(EdgeId e, const GraphCoverageMap &long_reads_cov_map,
+                                                        const LongEdgePositions &long_positions,
                                                         const pe_config::LongReads &lr_config, int direction) const {
     BidirectionalPathSet all_set = long_reads_cov_map.GetCoveringPaths(e);
-    BidirectionalPathMap<size_t> active_paths;
+    std::vector<ActivePath> active_paths;
     size_t loop_weight = 0;
     size_t nonloop_weight = 0;
     DEBUG ("Checking " << graph_.int_id(e) <<" dir "<< direction );
     for (auto path_iter: all_set) {
-        auto pos = path_iter->FindAll(e);
-        if (pos.size() > 1)
+        //e is long, so its occurrences are among the indexed positions
+        const auto &positions = long_positions.at(path_iter);
+        size_t occurrences = 0, idx = 0;
+        for (size_t i = 0; i < positions.size(); ++i) {
+            if (path_iter->At(positions[i]) == e && occurrences++ == 0)
+                idx = i;
+        }
+        VERIFY(occurrences > 0);
+        if (occurrences > 1)
 //TODO:: path weight should be size_t?
             loop_weight += size_t(round(path_iter->GetWeight()));
         else {
             if (path_iter->Size() > 1) nonloop_weight += size_t(round(path_iter->GetWeight()));
-            active_paths[path_iter] = pos[0];
+            active_paths.push_back({path_iter, &positions, idx, size_t(round(path_iter->GetWeight()))});
         }
     }
 //TODO: small plasmid, paths a-b-a, b-a-b ?
@@ -132,10 +174,11 @@ bool ScaffoldingUniqueEdgeAnalyzer::ConservativeByPaths(EdgeId e, const GraphCov
             DEBUG (graph_.int_id(e) << " loop/nonloop weight " << loop_weight << " " << nonloop_weight);
 
     EdgeId prev_unique = e;
+    std::vector<std::pair<EdgeId, size_t>> voting;
     while (active_paths.size() > 0) {
         size_t alt = 0;
         size_t maxx = 0;
-        map<EdgeId, size_t> voting = FillNextEdgeVoting(active_paths, direction);
+        FillNextEdgeVoting(active_paths, direction, voting);
 
         if (voting.size() == 0)
             break;
@@ -156,13 +199,10 @@ bool ScaffoldingUniqueEdgeAnalyzer::ConservativeByPaths(EdgeId e, const GraphCov
             return false;
         } else {
             DEBUG("cur " << graph_.int_id(prev_unique) << " next " << graph_.int_id(next_unique) << " sz " << active_paths.size());
-            for (auto iter = active_paths.begin(); iter != active_paths.end();) {
-                if (iter->second >= iter->first->Size() || iter->first->At(iter->second) != next_unique) {
-                    iter = active_paths.erase(iter);
-                } else {
-                    iter++;
-                }
-            }
+            active_paths.erase(std::remove_if(active_paths.begin(), active_paths.end(), [&](const ActivePath &active) {
+                return active.idx >= active.long_positions->size() ||
+                       active.path->At((*active.long_positions)[active.idx]) != next_unique;
+            }), active_paths.end());
             prev_unique = next_unique;
             DEBUG(active_paths.size() << " "<< graph_.int_id(next_unique));
         }
@@ -173,8 +213,10 @@ bool ScaffoldingUniqueEdgeAnalyzer::ConservativeByPaths(EdgeId e, const GraphCov
 
 bool ScaffoldingUniqueEdgeAnalyzer::ConservativeByPaths(EdgeId e,
                                                         const GraphCoverageMap &long_reads_cov_map,
+                                                        const LongEdgePositions &long_positions,
                                                         const pe_config::LongReads &lr_config) const{
-    return (ConservativeByPaths(e, long_reads_cov_map, lr_config, 1) && ConservativeByPaths(e, long_reads_cov_map, lr_config, -1));
+    return (ConservativeByPaths(e, long_reads_cov_map, long_positions, lr_config, 1) &&
+            ConservativeByPaths(e, long_reads_cov_map, long_positions, lr_config, -1));
 }
 
 
@@ -193,32 +235,46 @@ void ScaffoldingUniqueEdgeAnalyzer::CheckCorrectness(ScaffoldingUniqueEdgeStorag
     }
 }
 
-set<VertexId> ScaffoldingUniqueEdgeAnalyzer::GetChildren(VertexId v, map<VertexId, set<VertexId>> &dijkstra_cash_) const {
+const std::vector<VertexId> &ScaffoldingUniqueEdgeAnalyzer::GetChildren(VertexId v, ChildrenCache &dijkstra_cash_) const {
     using omnigraph::DijkstraHelper;
     using debruijn_graph::Graph;
+    const std::vector<VertexId> *children = nullptr;
+    auto get = [&children](const auto &entry) { children = &entry.second; };
+    if (dijkstra_cash_.if_contains(v, get))
+        return *children;
+
     DijkstraHelper<Graph>::BoundedDijkstra dijkstra(
             DijkstraHelper<Graph>::CreateBoundedDijkstra(graph_, max_dijkstra_depth_, max_dijkstra_vertices_));
     dijkstra.Run(v);
 
-    if (!dijkstra_cash_.count(v)) {
-        dijkstra_cash_[v].insert(v); // FIXME: is this really necessary?
-        for (auto entry : dijkstra.reached())
-            dijkstra_cash_[v].insert(entry.first);
-    }
-    return dijkstra_cash_[v];
+    std::vector<VertexId> reached;
+    reached.push_back(v); // FIXME: is this really necessary?
+    for (const auto &entry : dijkstra.reached())
+        reached.push_back(entry.first);
+    std::sort(reached.begin(), reached.end());
+    reached.erase(std::unique(reached.begin(), reached.end()), reached.end());
+
+    //nodes are stable, entry might be already added by another thread
+    dijkstra_cash_.try_emplace_l(v, [](auto &) {}, std::move(reached));
+    dijkstra_cash_.if_contains(v, get);
+    return *children;
 }
 
-bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(EdgeId e1, EdgeId e2, map<VertexId, set<VertexId>> &dijkstra_cash_) const {
-    auto s1 = GetChildren(graph_.EdgeEnd(e1), dijkstra_cash_);
-    auto s2 = GetChildren(graph_.EdgeEnd(e2), dijkstra_cash_);
-    if (s1.find(graph_.EdgeStart(e2)) != s1.end()) {
+bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(EdgeId e1, EdgeId e2, ChildrenCache &dijkstra_cash_) const {
+    const auto &s1 = GetChildren(graph_.EdgeEnd(e1), dijkstra_cash_);
+    const auto &s2 = GetChildren(graph_.EdgeEnd(e2), dijkstra_cash_);
+    if (std::binary_search(s1.begin(), s1.end(), graph_.EdgeStart(e2))) {
         return true;
     }
-    if (s2.find(graph_.EdgeStart(e1)) != s2.end()) {
+    if (std::binary_search(s2.begin(), s2.end(), graph_.EdgeStart(e1))) {
         return true;
     }
-    for (VertexId v: s1) {
-        if (s2.find(v) != s2.end()) {
+    for (auto it1 = s1.begin(), it2 = s2.begin(); it1 != s1.end() && it2 != s2.end(); ) {
+        if (*it1 < *it2) {
+            ++it1;
+        } else if (*it2 < *it1) {
+            ++it2;
+        } else {
             DEBUG("bulge-like structure, edges "<< graph_.int_id(e1) << " " << graph_.int_id(e2));
             return true;
         }
@@ -226,8 +282,8 @@ bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(EdgeId e1, EdgeId e2, map
     return false;
 }
 
-bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(const vector<pair<EdgeId, double>> &next_weights) const {
-    map <VertexId, set<VertexId>> dijkstra_cash_;
+bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(const vector<pair<EdgeId, double>> &next_weights,
+                                                       ChildrenCache &dijkstra_cash_) const {
     for (size_t i = 0; i < next_weights.size(); i ++) {
         for (size_t j = i + 1; j < next_weights.size(); j++) {
             if (next_weights[i].second * overwhelming_majority_ > next_weights[j].second
@@ -241,10 +297,11 @@ bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(const vector<pair<EdgeId,
     return true;
 }
 
-bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(EdgeId from, size_t lib_index) const{
+bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(EdgeId from,
+                                                       const omnigraph::de::PairedInfoIndexT<Graph> &clustered_index,
+                                                       ChildrenCache &dijkstra_cash_) const {
     DEBUG("processing unique edge " << graph_.int_id(from));
-    const auto &clustered_indices = gp_.get<omnigraph::de::PairedInfoIndicesT<Graph>>("clustered_indices");
-    auto next_edges = clustered_indices[lib_index].Get(from);
+    auto next_edges = clustered_index.Get(from);
     vector<pair<EdgeId, double>> next_weights;
     for (auto hist_pair: next_edges) {
         if (hist_pair.first == from || hist_pair.first == graph_.conjugate(from))
@@ -263,19 +320,29 @@ bool ScaffoldingUniqueEdgeAnalyzer::FindCommonChildren(EdgeId from, size_t lib_i
         DEBUG(next_weights.size() << " continuations");
         next_weights.resize(max_different_edges_);
     }
-    return FindCommonChildren(next_weights);
+    return FindCommonChildren(next_weights, dijkstra_cash_);
 }
 
 
 void ScaffoldingUniqueEdgeAnalyzer::ClearLongEdgesWithPairedLib(size_t lib_index,
                                                                 ScaffoldingUniqueEdgeStorage &storage) const {
-    set<EdgeId> to_erase;
-    for (EdgeId edge: storage) {
-        if (!FindCommonChildren(edge, lib_index)) {
-            to_erase.insert(edge);
-            to_erase.insert(graph_.conjugate(edge));
+    const auto &clustered_index = gp_.get<omnigraph::de::PairedInfoIndicesT<Graph>>("clustered_indices")[lib_index];
+    std::vector<EdgeId> edges(storage.begin(), storage.end());
+    ChildrenCache dijkstra_cash;
+    std::vector<std::vector<EdgeId>> to_erase_local(omp_get_max_threads());
+
+#   pragma omp parallel for schedule(guided)
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (!FindCommonChildren(edges[i], clustered_index, dijkstra_cash)) {
+            auto &to_erase = to_erase_local[omp_get_thread_num()];
+            to_erase.push_back(edges[i]);
+            to_erase.push_back(graph_.conjugate(edges[i]));
         }
     }
+
+    set<EdgeId> to_erase;
+    for (const auto &local : to_erase_local)
+        to_erase.insert(local.begin(), local.end());
     for (auto iter = storage.begin(); iter != storage.end(); ){
         if (to_erase.find(*iter) != to_erase.end()){
             iter = storage.erase(iter);
@@ -289,11 +356,22 @@ void ScaffoldingUniqueEdgeAnalyzer::ClearLongEdgesWithPairedLib(size_t lib_index
 void ScaffoldingUniqueEdgeAnalyzer::FillUniqueEdgesWithLongReads(GraphCoverageMap &long_reads_cov_map,
                                                                  ScaffoldingUniqueEdgeStorage &unique_storage_pb,
                                                                  const pe_config::LongReads &lr_config) {
+    LongEdgePositions long_positions = IndexLongEdgePositions(long_reads_cov_map);
+    std::vector<EdgeId> edges;
     for (EdgeId e : graph_.edges()) {
-        if (ConservativeByLength(e) && ConservativeByPaths(e, long_reads_cov_map, lr_config)) {
-            unique_storage_pb.unique_edges_.insert(e);
-        }
+        if (ConservativeByLength(e))
+            edges.push_back(e);
     }
+
+    std::vector<std::vector<EdgeId>> unique_local(omp_get_max_threads());
+#   pragma omp parallel for schedule(guided)
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (ConservativeByPaths(edges[i], long_reads_cov_map, long_positions, lr_config))
+            unique_local[omp_get_thread_num()].push_back(edges[i]);
+    }
+
+    for (const auto &local : unique_local)
+        unique_storage_pb.unique_edges_.insert(local.begin(), local.end());
     CheckCorrectness(unique_storage_pb);
 }
 
@@ -16,6 +16,9 @@
 #include "pipeline/graph_pack.hpp"
 #include "utils/logger/logger.hpp"
 
+#include <parallel_hashmap/phmap.h>
+
+#include <mutex>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -93,14 +96,37 @@ class ScaffoldingUniqueEdgeAnalyzer {
     static const size_t max_dijkstra_depth_ = 1000;
     static const size_t max_dijkstra_vertices_ = 1000;
     static const size_t overwhelming_majority_ = 10;
-    std::set<VertexId> GetChildren(VertexId v, std::map<VertexId, std::set<VertexId>> &dijkstra_cash) const;
-    bool FindCommonChildren(EdgeId e1, EdgeId e2, std::map<VertexId, std::set<VertexId>> &dijkstra_cash) const;
-    bool FindCommonChildren(const std::vector<std::pair<EdgeId, double>> &next_weights) const;
-    bool FindCommonChildren(EdgeId from, size_t lib_index) const;
-    std::map<EdgeId, size_t> FillNextEdgeVoting(BidirectionalPathMap<size_t>& active_paths, int direction) const;
+
+    //Vertices reachable by bounded dijkstra, sorted. Shared between the threads, entries are never erased
+    typedef phmap::parallel_node_hash_map<VertexId, std::vector<VertexId>,
+                                          phmap::priv::hash_default_hash<VertexId>,
+                                          phmap::priv::hash_default_eq<VertexId>,
+                                          std::allocator<std::pair<const VertexId, std::vector<VertexId>>>,
+                                          4, std::mutex> ChildrenCache;
+    //Positions of the edges not shorter than length_cutoff_ in every long read path
+    typedef phmap::flat_hash_map<const BidirectionalPath*, std::vector<size_t>> LongEdgePositions;
+
+    struct ActivePath {
+        const BidirectionalPath *path;
+        const std::vector<size_t> *long_positions;
+        size_t idx; //in long_positions
+        size_t weight;
+    };
+
+    const std::vector<VertexId> &GetChildren(VertexId v, ChildrenCache &dijkstra_cash) const;
+    bool FindCommonChildren(EdgeId e1, EdgeId e2, ChildrenCache &dijkstra_cash) const;
+    bool FindCommonChildren(const std::vector<std::pair<EdgeId, double>> &next_weights,
+                            ChildrenCache &dijkstra_cash) const;
+    bool FindCommonChildren(EdgeId from, const omnigraph::de::PairedInfoIndexT<debruijn_graph::Graph> &clustered_index,
+                            ChildrenCache &dijkstra_cash) const;
+    void FillNextEdgeVoting(std::vector<ActivePath> &active_paths, int direction,
+                            std::vector<std::pair<EdgeId, size_t>> &voting) const;
+    LongEdgePositions IndexLongEdgePositions(const GraphCoverageMap &long_reads_cov_map) const;
     bool ConservativeByPaths(EdgeId e, const GraphCoverageMap &long_reads_cov_map,
+                             const LongEdgePositions &long_positions,
                              const pe_config::LongReads &lr_config) const;
     bool ConservativeByPaths(EdgeId e, const GraphCoverageMap &long_reads_cov_map,
+                             const LongEdgePositions &long_positions,
                              const pe_config::LongReads &lr_config, int direction) const;
     bool ConservativeByLength(EdgeId e);
     void CheckCorrectness(ScaffoldingUniqueEdgeStorage& unique_storage_pb);
@@ -172,14 +172,30 @@ public:
 
     }
 
-    void operator()(EdgeId edge, const std::vector<EdgeId>& path) {
+    //every split but the last one creates a vertex and two edges,
+    //every gluing and both compressions create an edge (conjugates included)
+    static size_t MaxNewVertexIds(const std::vector<EdgeId> &path) {
+        return 2 * (path.size() - 1);
+    }
+
+    static size_t MaxNewEdgeIds(const std::vector<EdgeId> &path) {
+        return 4 * (path.size() - 1) + 2 * path.size() + 4;
+    }
+
+    //calls the callbacks, returns false if the bulge should be kept
+    bool Accept(EdgeId edge, const std::vector<EdgeId>& path) {
         if (opt_callback_ && opt_callback_(edge, path)) {
-                return;
+                return false;
         }
 
         if (removal_handler_)
             removal_handler_(edge);
+        return true;
+    }
 
+    //only touches the graph, so bulges with disjoint neighbourhoods can be glued concurrently
+    //(see ObservableGraph::LogModifications)
+    void Glue(EdgeId edge, const std::vector<EdgeId>& path) {
         VertexId start = g_.EdgeStart(edge);
         VertexId end = g_.EdgeEnd(edge);
 
@@ -195,6 +211,11 @@ public:
         g_.CompressVertex(end);
     }
 
+    void operator()(EdgeId edge, const std::vector<EdgeId>& path) {
+        if (Accept(edge, path))
+            Glue(edge, path);
+    }
+
 };
 
 template<class Graph>
@@ -404,8 +425,8 @@ private:
     typedef typename Graph::VertexId VertexId;
     typedef InterestingFinderPtr<Graph, EdgeId> CandidateFinderPtr;
     typedef SmartSetIterator<Graph, EdgeId, CoverageComparator<Graph>> SmartEdgeSet;
-    typedef phmap::flat_hash_set<EdgeId> EdgeSet;
-    
+    typedef phmap::flat_hash_set<VertexId> VertexSet;
+
     size_t buff_size_;
     double buff_cov_diff_;
     double buff_cov_rel_diff_;
@@ -473,28 +494,39 @@ private:
         return smart_set;
     }
 
-    bool CheckInteracting(const BulgeInfo &info, const EdgeSet &involved_edges) const {
-        if (involved_edges.count(info.e))
-            return true;
+    //gluing of the bulge only touches the edges incident to its vertices (start, end and
+    //the inner vertices of alternative) and compression of its start and end also touches
+    //the edges incident to their neighbours, so bulges with disjoint sets of these vertices
+    //(up to conjugation) do not interfere and can be glued concurrently
+    std::vector<VertexId> TouchedVertices(const BulgeInfo &info) const {
+        const Graph &g = this->g();
+        VertexId start = g.EdgeStart(info.e);
+        std::vector<VertexId> touched = {start};
         for (EdgeId e : info.alternative)
-            if (involved_edges.count(e))
+            touched.push_back(g.EdgeEnd(e));
+        for (EdgeId e : g.IncomingEdges(start))
+            touched.push_back(g.EdgeStart(e));
+        for (EdgeId e : g.OutgoingEdges(g.EdgeEnd(info.e)))
+            touched.push_back(g.EdgeEnd(e));
+        return touched;
+    }
+
+    bool CheckInteracting(const std::vector<VertexId> &touched, const VertexSet &involved_vertices) const {
+        for (VertexId v : touched)
+            if (involved_vertices.count(v))
                 return true;
         return false;
     }
 
-    void AccountEdge(EdgeId e, EdgeSet& involved_edges) const {
-        TRACE("Pushing edge " << this->g().str(e));
-        involved_edges.insert(e);
-        EdgeId conj = this->g().conjugate(e);
-        TRACE("Pushing edge " << this->g().str(conj));
-        involved_edges.insert(conj);
+    void AccountVertex(VertexId v, VertexSet& involved_vertices) const {
+        TRACE("Pushing vertex " << this->g().str(v));
+        involved_vertices.insert(v);
+        involved_vertices.insert(this->g().conjugate(v));
     }
 
-    void AccountEdges(const BulgeInfo& info, EdgeSet& involved_edges) const {
-        AccountEdge(info.e, involved_edges);
-        for (EdgeId e : info.alternative) {
-            AccountEdge(e, involved_edges);
-        }
+    void AccountVertices(const std::vector<VertexId> &touched, VertexSet& involved_vertices) const {
+        for (VertexId v : touched)
+            AccountVertex(v, involved_vertices);
     }
 
     //returns false if time to stop
@@ -577,25 +609,25 @@ private:
         return merged_bulges;
     }
 
-    SmartEdgeSet RetainIndependentBulges(std::vector<BulgeInfo>& bulges) const {
+    void RetainIndependentBulges(std::vector<BulgeInfo>& bulges, SmartEdgeSet& interacting_edges) const {
         DEBUG("Looking for independent bulges");
         size_t total_cnt = bulges.size();
         utils::perf_counter perf;
 
         std::vector<BulgeInfo> filtered;
         filtered.reserve(bulges.size());
-        //fixme switch to involved vertices to bring fully parallel glueing closer
-        EdgeSet involved_edges;
-        SmartEdgeSet interacting_edges(this->g(), false, CoverageComparator<Graph>(this->g()));
+        VertexSet involved_vertices;
+        VERIFY(interacting_edges.IsEnd());
 
         for (BulgeInfo& info : bulges) {
             TRACE("Analyzing interactions of " << info.str(this->g()));
-            if (CheckInteracting(info, involved_edges)) {
+            auto touched = TouchedVertices(info);
+            if (CheckInteracting(touched, involved_vertices)) {
                 TRACE("Interacting");
                 interacting_edges.push(info.e);
             } else {
                 TRACE("Independent");
-                AccountEdges(info, involved_edges);
+                AccountVertices(touched, involved_vertices);
                 filtered.push_back(std::move(info));
             }
         }
@@ -605,8 +637,6 @@ private:
         DEBUG("Independent cnt " << bulges.size());
         DEBUG("Interacting cnt " << interacting_edges.size());
         VERIFY(bulges.size() + interacting_edges.size() == total_cnt);
-
-        return interacting_edges;
     }
 
     size_t BasicProcessBulges(SmartEdgeSet& edges) {
@@ -624,27 +654,87 @@ private:
         return triggered;
     }
 
-    size_t ProcessBulges(const std::vector<BulgeInfo>& independent_bulges, SmartEdgeSet& interacting_edges) {
-        DEBUG("Processing bulges");
+    size_t GlueIndependentBulges(const std::vector<BulgeInfo>& independent_bulges) {
+        DEBUG("Gluing independent bulges");
         utils::perf_counter perf;
+        Graph &g = this->g();
 
-        size_t triggered = 0;
-
+        //callbacks are called sequentially before the gluing
+        std::vector<const BulgeInfo*> accepted;
+        size_t vertex_id_cnt = 0, edge_id_cnt = 0;
         for (const BulgeInfo& info : independent_bulges) {
-            TRACE("Processing bulge " << info.str(this->g()));
-            triggered++;
-            gluer_(info.e, info.alternative);
+            if (gluer_.Accept(info.e, info.alternative)) {
+                accepted.push_back(&info);
+                vertex_id_cnt += BulgeGluer<Graph>::MaxNewVertexIds(info.alternative);
+                edge_id_cnt += BulgeGluer<Graph>::MaxNewEdgeIds(info.alternative);
+            }
+        }
+
+        //ids are reserved in the order of bulges, so the result does not depend on the number of threads
+        std::vector<typename Graph::ModificationLog> logs;
+        logs.reserve(accepted.size());
+        auto vertex_ids = g.FreeVertexIds(vertex_id_cnt);
+        auto edge_ids = g.FreeEdgeIds(edge_id_cnt);
+        auto vertex_it = vertex_ids.begin();
+        auto edge_it = edge_ids.begin();
+        for (const BulgeInfo *info : accepted) {
+            auto vertex_end = vertex_it + BulgeGluer<Graph>::MaxNewVertexIds(info->alternative);
+            auto edge_end = edge_it + BulgeGluer<Graph>::MaxNewEdgeIds(info->alternative);
+            logs.emplace_back(std::vector<VertexId>(vertex_it, vertex_end), std::vector<EdgeId>(edge_it, edge_end));
+            vertex_it = vertex_end;
+            edge_it = edge_end;
         }
 
+        #pragma omp parallel for schedule(guided)
+        for (size_t i = 0; i < accepted.size(); ++i) {
+            TRACE("Processing bulge " << accepted[i]->str(g));
+            g.LogModifications(&logs[i]);
+            gluer_.Glue(accepted[i]->e, accepted[i]->alternative);
+            g.LogModifications(nullptr);
+        }
         DEBUG("Independent bulges glued in " << perf.time() << " seconds");
-        perf.reset();
+
+        //graph action handlers (indices, smart iterators) are not thread-safe
+        for (auto &log : logs)
+            g.ReplayLog(log);
+
+        DEBUG("Gluing events replayed in " << perf.time() << " seconds");
+        return independent_bulges.size();
+    }
+
+    //interacting bulges are re-analyzed in rounds: alternatives for all the remaining
+    //edges are searched in parallel, then the independent subset is glued and the rest
+    //is postponed to the next round
+    size_t ProcessInteractingBulges(SmartEdgeSet& interacting_edges) {
+        size_t triggered = 0;
+        while (interacting_edges.size() >= SMALL_BUFFER_THR) {
+            DEBUG("Re-analyzing interacting bulges " << interacting_edges.size());
+            std::vector<EdgeId> edge_buffer;
+            edge_buffer.reserve(interacting_edges.size());
+            for (; !interacting_edges.IsEnd(); ++interacting_edges)
+                edge_buffer.push_back(*interacting_edges);
+
+            auto bulges = MergeBuffers(FindBulges(edge_buffer));
+            RetainIndependentBulges(bulges, interacting_edges);
+            triggered += GlueIndependentBulges(bulges);
+        }
 
         DEBUG("Processing remaining interacting bulges " << interacting_edges.size());
+        utils::perf_counter perf;
         triggered += BasicProcessBulges(interacting_edges);
         DEBUG("Interacting edges processed in " << perf.time() << " seconds");
         return triggered;
     }
 
+    size_t ProcessBulges(const std::vector<EdgeId>& edge_buffer) {
+        DEBUG("Processing bulges");
+        auto bulges = MergeBuffers(FindBulges(edge_buffer));
+        SmartEdgeSet interacting_edges(this->g(), false, CoverageComparator<Graph>(this->g()));
+        RetainIndependentBulges(bulges, interacting_edges);
+        size_t triggered = GlueIndependentBulges(bulges);
+        return triggered + ProcessInteractingBulges(interacting_edges);
+    }
+
 public:
 
     typedef std::function<bool(EdgeId edge, const std::vector<EdgeId>& path)> BulgeCallbackF;
@@ -717,9 +807,7 @@ public:
                 inner_triggered = BasicProcessBulges(edges);
                 DEBUG("Small buffer processed in " << perf.time() << " seconds");
             } else {
-                auto bulges = MergeBuffers(FindBulges(edge_buffer));
-                auto interacting_edges = RetainIndependentBulges(bulges);
-                inner_triggered = ProcessBulges(bulges, interacting_edges);
+                inner_triggered = ProcessBulges(edge_buffer);
             }
 
             proceed |= (inner_triggered > 0);
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 #include "visualization/visualization.hpp"
 #include "compressor.hpp"
@@ -27,19 +29,25 @@ class ComplexTipFinder {
     size_t edge_length_treshold_;
     size_t max_path_length_;
 
-    double GetTipCoverage(const GraphComponent<Graph>& component) const {
+    //edges are sorted
+    bool Contains(const std::vector<EdgeId> &edges, EdgeId e) const {
+        return std::binary_search(edges.begin(), edges.end(), e);
+    }
+
+    double GetTipCoverage(const std::vector<EdgeId> &edges) const {
         double cov = std::numeric_limits<double>::max();
-        for (auto edge : component.edges()) {
+        for (auto edge : edges) {
             cov = std::min(cov, g_.coverage(edge));
         }
         return cov;
     }
 
-    double GetOutwardCoverage(const GraphComponent<Graph>& component) const {
+    double GetOutwardCoverage(const std::vector<VertexId> &vertices,
+                              const std::vector<EdgeId> &edges) const {
         double cov = 0.0;
-        for (auto v : component.vertices()) {
+        for (auto v : vertices) {
             for (auto edge : g_.IncidentEdges(v)) {
-                if (!component.contains(edge)) {
+                if (!Contains(edges, edge)) {
                     cov = std::max(cov, g_.coverage(edge));
                 }
             }
@@ -47,27 +55,24 @@ class ComplexTipFinder {
         return cov;
     }
 
-    double GetRelativeTipCoverage(const GraphComponent<Graph>& component) const {
-        return GetTipCoverage(component) / GetOutwardCoverage(component);
-    }
-
-    bool ComponentCheck(const GraphComponent<Graph>& component) const {
-        if (component.empty() || component.e_size() == 0)
+    bool ComponentCheck(const std::vector<VertexId> &vertices,
+                        const std::vector<EdgeId> &edges) const {
+        if (vertices.empty() || edges.empty())
             return false;
 
         //check if usual tip
-        if (component.vertices().size() == 2) {
+        if (vertices.size() == 2) {
             DEBUG("Component is a tip! Exiting...");
             return false;
         }
 
         //checking edge lengths
-        if (std::any_of(component.e_begin(), component.e_end(), [&](EdgeId e) {return g_.length(e) > edge_length_treshold_;})) {
+        if (std::any_of(edges.begin(), edges.end(), [&](EdgeId e) {return g_.length(e) > edge_length_treshold_;})) {
             DEBUG("Tip contains too long edges");
             return false;
         }
 
-        if (math::ge(GetRelativeTipCoverage(component), relative_coverage_treshold_)) {
+        if (math::ge(GetTipCoverage(edges) / GetOutwardCoverage(vertices, edges), relative_coverage_treshold_)) {
             DEBUG("Tip is too high covered with respect to external edges");
             return false;
         }
@@ -84,91 +89,230 @@ public:
               edge_length_treshold_(max_edge_length), max_path_length_(max_path_length)
     { }
 
-    GraphComponent<Graph> operator()(VertexId v) const {
-        GraphComponent<Graph> empty(g_);
-        VERIFY(empty.empty());
+    /**
+     * Fills (sorted) edges of the complex tip starting at vertex v.
+     * @return false if there is no complex tip to be removed
+     */
+    bool Find(VertexId v, DominatedSetWorkspace<Graph> &workspace, std::vector<EdgeId> &edges) const {
+        edges.clear();
         if (g_.IncomingEdgeCount(v) != 0) {
-            return empty;
-        }
-
-        DominatedSetFinder<Graph> finder(g_, v, max_path_length_);
-        if (finder.FillDominated()) {
-            auto ranges = finder.dominated();
-            auto dom_component = finder.AsGraphComponent();
-            std::set<EdgeId> component_edges(dom_component.edges());
-            for (auto v : dom_component.exits()) {
-                size_t current_path_length = ranges[v].end_pos;
-                for (auto e : g_.OutgoingEdges(v)) {
-                    if (current_path_length + g_.length(e) > max_path_length_) {
-                        DEBUG("Component contains too long paths");
-                        return empty;
-                    }
-                    component_edges.insert(e);
+            return false;
+        }
+
+        DominatedSetFinder<Graph> finder(g_, v, &workspace, max_path_length_);
+        if (!finder.FillDominated()) {
+            DEBUG("Failed to find dominated component");
+            return false;
+        }
+
+        //edges induced by dominated set plus all edges going out of its exits
+        for (VertexId u : finder.dominated_vertices()) {
+            bool exit = false;
+            for (EdgeId e : g_.OutgoingEdges(u))
+                exit |= !finder.contains(g_.EdgeEnd(e));
+
+            size_t current_path_length = finder.range(u).end_pos;
+            for (EdgeId e : g_.OutgoingEdges(u)) {
+                if (!exit) {
+                    if (finder.contains(g_.EdgeEnd(e)))
+                        edges.push_back(e);
+                    continue;
+                }
+                if (current_path_length + g_.length(e) > max_path_length_) {
+                    DEBUG("Component contains too long paths");
+                    edges.clear();
+                    return false;
                 }
+                edges.push_back(e);
             }
-            auto extended_component = GraphComponent<Graph>::FromEdges(g_, component_edges);
-            if (ComponentCheck(extended_component))
-                return extended_component;
-            else
-                return empty;
-        } else {
-            DEBUG("Failed to find dominated component");
-            return empty;
         }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        std::vector<VertexId> vertices;
+        vertices.reserve(2 * edges.size());
+        for (EdgeId e : edges) {
+            vertices.push_back(g_.EdgeStart(e));
+            vertices.push_back(g_.EdgeEnd(e));
+        }
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+        if (!ComponentCheck(vertices, edges)) {
+            edges.clear();
+            return false;
+        }
+        return true;
+    }
+
+    GraphComponent<Graph> operator()(VertexId v) const {
+        DominatedSetWorkspace<Graph> workspace(/*flat*/false);
+        std::vector<EdgeId> edges;
+        if (!Find(v, workspace, edges))
+            return GraphComponent<Graph>(g_);
+        return GraphComponent<Graph>::FromEdges(g_, edges);
     }
 
 private:
     DECL_LOGGER("ComplexTipClipper")
 };
 
+/**
+ * Candidate complex tips are found in parallel over vertex chunks (each
+ * thread reuses its own dominated set workspace). Then the candidates are
+ * removed in vertex order. A candidate is removed as is unless its
+ * neighbourhood was affected by previous removals, in that case it is
+ * re-validated against the current graph.
+ */
 template<class Graph>
-class ComplexTipClipper : public PersistentProcessingAlgorithm<Graph, typename Graph::VertexId> {
+class ComplexTipClipper : public PersistentAlgorithmBase<Graph> {
     typedef typename Graph::VertexId VertexId;
     typedef typename Graph::EdgeId EdgeId;
-    typedef PersistentProcessingAlgorithm<Graph, VertexId> base;
+    typedef PersistentAlgorithmBase<Graph> base;
     typedef typename ComponentRemover<Graph>::HandlerF HandlerF;
 
+    struct Candidate {
+        VertexId start;
+        std::vector<EdgeId> edges;
+
+        bool operator<(const Candidate &that) const {
+            return start < that.start;
+        }
+    };
+
     std::filesystem::path pics_folder_;
     ComplexTipFinder<Graph> finder_;
     ComponentRemover<Graph> component_remover_;
+    size_t chunk_cnt_;
+    std::vector<DominatedSetWorkspace<Graph>> workspaces_;
+    //vertices which neighbourhood was changed during commit phase
+    std::vector<bool> affected_;
+
+    std::vector<Candidate> FindCandidates() {
+        auto chunks = IterationHelper<Graph, VertexId>(this->g()).Chunks(chunk_cnt_);
+        VERIFY(chunks.size() > 1);
+        std::vector<std::vector<Candidate>> of_interest(chunks.size() - 1);
+        workspaces_.resize(omp_get_max_threads());
+
+        #pragma omp parallel for schedule(guided)
+        for (size_t i = 0; i < chunks.size() - 1; ++i) {
+            auto &workspace = workspaces_[omp_get_thread_num()];
+            std::vector<EdgeId> edges;
+            for (auto it = chunks[i], end = chunks[i + 1]; it != end; ++it) {
+                if (finder_.Find(*it, workspace, edges))
+                    of_interest[i].push_back({*it, std::move(edges)});
+            }
+        }
+
+        std::vector<Candidate> candidates;
+        for (auto &chunk : of_interest)
+            std::move(chunk.begin(), chunk.end(), std::back_inserter(candidates));
+        std::sort(candidates.begin(), candidates.end());
+        return candidates;
+    }
+
+    void MarkAffected(VertexId v) {
+        size_t id = this->g().int_id(v);
+        if (id >= affected_.size())
+            affected_.resize(std::max(id + 1, 2 * affected_.size()), false);
+        affected_[id] = true;
+    }
+
+    bool IsAffected(VertexId v) const {
+        size_t id = this->g().int_id(v);
+        return id < affected_.size() && affected_[id];
+    }
+
+    //edges deleted by an earlier removal have no endpoints to check
+    bool IsAffected(const std::vector<EdgeId> &edges) const {
+        for (EdgeId e : edges) {
+            if (!this->g().contains(e))
+                return true;
+            if (IsAffected(this->g().EdgeStart(e)) || IsAffected(this->g().EdgeEnd(e)))
+                return true;
+        }
+        return false;
+    }
+
+    //removal might delete or compress component vertices (and their
+    //conjugates) changing the edges incident to their neighbours
+    void MarkNeighbourhood(const std::vector<EdgeId> &edges) {
+        const Graph &g = this->g();
+        for (EdgeId e : edges) {
+            for (VertexId v : {g.EdgeStart(e), g.EdgeEnd(e)}) {
+                MarkAffected(v);
+                MarkAffected(g.conjugate(v));
+                for (EdgeId incident : g.IncidentEdges(v)) {
+                    for (VertexId u : {g.EdgeStart(incident), g.EdgeEnd(incident)}) {
+                        MarkAffected(u);
+                        MarkAffected(g.conjugate(u));
+                    }
+                }
+            }
+        }
+    }
+
+    bool Remove(VertexId v, const std::vector<EdgeId> &edges) {
+        if (!pics_folder_.empty()) {
+            visualization::visualization_utils::WriteComponentSinksSources(GraphComponent<Graph>::FromEdges(this->g(), edges),
+                                                      pics_folder_ / (std::to_string(this->g().int_id(v)) //+ "_" + std::to_string(candidate_cnt)
+                                                      + ".dot"));
+        }
+
+        VERIFY(edges.size());
+        DEBUG("Detected tip component edge cnt: " << edges.size());
+        MarkNeighbourhood(edges);
+        component_remover_.DeleteComponent(edges.begin(), edges.end());
+        DEBUG("Complex tip removed");
+        return true;
+    }
 
 public:
-    //track_changes=false leads to every iteration run from scratch
     ComplexTipClipper(Graph& g, double relative_coverage,
                       size_t max_edge_len, size_t max_path_len,
                       size_t chunk_cnt,
                       const std::filesystem::path &pics_folder = "" ,
                       HandlerF removal_handler = nullptr) :
-            base(g, nullptr, false, adt::identity(), /*track changes*/false),
+            base(g),
             pics_folder_(pics_folder),
             finder_(g, relative_coverage, max_edge_len, max_path_len),
-            component_remover_(g, removal_handler) {
+            component_remover_(g, removal_handler),
+            chunk_cnt_(chunk_cnt) {
         if (!pics_folder_.empty()) {
             create_directory(pics_folder_);
         }
-        this->interest_el_finder_ = std::make_shared<ParallelInterestingElementFinder<Graph, VertexId>>(
-                [&](VertexId v) {return !finder_(v).empty();}, chunk_cnt);
     }
 
-    bool Process(VertexId v) override {
-        DEBUG("Processing vertex " << this->g().str(v));
-        auto component = finder_(v);
-        if (component.empty()) {
-            DEBUG("Failed to detect complex tip starting with vertex " << this->g().str(v));
-            return false;
-        }
+    size_t Run(bool /*force_primary_launch*/ = false,
+               double /*iter_run_progress*/ = 1.) override {
+        std::vector<Candidate> candidates = FindCandidates();
+        DEBUG(candidates.size() << " candidate complex tips found");
 
-        if (!pics_folder_.empty()) {
-            visualization::visualization_utils::WriteComponentSinksSources(component,
-                                                      pics_folder_ / (std::to_string(this->g().int_id(v)) //+ "_" + std::to_string(candidate_cnt)
-                                                      + ".dot"));
+        affected_.assign(this->g().max_vid() + 1, false);
+        size_t triggered = 0;
+        std::vector<EdgeId> edges;
+        for (const Candidate &candidate : candidates) {
+            VertexId v = candidate.start;
+            if (!this->g().contains(v))
+                continue;
+
+            DEBUG("Processing vertex " << this->g().str(v));
+            if (!IsAffected(v) && !IsAffected(candidate.edges)) {
+                triggered += Remove(v, candidate.edges);
+                continue;
+            }
+
+            DEBUG("Neighbourhood changed, re-validating");
+            if (!finder_.Find(v, workspaces_.front(), edges)) {
+                DEBUG("Failed to detect complex tip starting with vertex " << this->g().str(v));
+                continue;
+            }
+            triggered += Remove(v, edges);
         }
+        affected_.clear();
+        std::vector<DominatedSetWorkspace<Graph>>().swap(workspaces_);
 
-        VERIFY(component.e_size() && component.v_size());
-        DEBUG("Detected tip component edge cnt: " << component.e_size());
-        component_remover_.DeleteComponent(component.e_begin(), component.e_end());
-        DEBUG("Complex tip removed");
-        return true;
+        return triggered;
     }
 
 private:
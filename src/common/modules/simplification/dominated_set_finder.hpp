@@ -7,9 +7,102 @@
 
 #pragma once
 
-#include <queue>
+#include <map>
+#include <vector>
+#include <limits>
 
 namespace omnigraph {
+
+/**
+ * Scratch for DominatedSetFinder. Flat workspace keeps arrays indexed by
+ * vertex id with an epoch stamp, so reset is O(1) and one workspace per
+ * thread could serve any number of consecutive searches without
+ * reallocation. Its size is proportional to the maximal vertex id though, so
+ * one-off searches should use the sparse (map-based) workspace instead.
+ */
+template<class Graph>
+class DominatedSetWorkspace {
+    typedef typename Graph::VertexId VertexId;
+
+    bool flat_;
+
+    std::vector<unsigned> stamp_;
+    std::vector<Range> ranges_;
+    unsigned epoch_ = 0;
+
+    std::map<VertexId, Range> sparse_ranges_;
+
+    std::vector<VertexId> dominated_;
+    std::vector<VertexId> queue_;
+    size_t queue_head_ = 0;
+
+    void Ensure(size_t id) {
+        if (id < stamp_.size())
+            return;
+        size_t sz = std::max(id + 1, 2 * stamp_.size());
+        stamp_.resize(sz, 0);
+        ranges_.resize(sz);
+    }
+
+public:
+    explicit DominatedSetWorkspace(bool flat = true)
+            : flat_(flat) {}
+
+    void Reset() {
+        if (flat_ && ++epoch_ == 0) {
+            std::fill(stamp_.begin(), stamp_.end(), 0);
+            epoch_ = 1;
+        }
+        sparse_ranges_.clear();
+        dominated_.clear();
+        queue_.clear();
+        queue_head_ = 0;
+    }
+
+    bool contains(VertexId v) const {
+        if (!flat_)
+            return sparse_ranges_.count(v);
+        size_t id = v.int_id();
+        return id < stamp_.size() && stamp_[id] == epoch_;
+    }
+
+    const Range &range(VertexId v) const {
+        VERIFY_DEV(contains(v));
+        return flat_ ? ranges_[v.int_id()] : sparse_ranges_.find(v)->second;
+    }
+
+    //does nothing if vertex is already there
+    void emplace(VertexId v, Range r) {
+        if (!flat_) {
+            if (sparse_ranges_.emplace(v, r).second)
+                dominated_.push_back(v);
+            return;
+        }
+        size_t id = v.int_id();
+        Ensure(id);
+        if (stamp_[id] == epoch_)
+            return;
+        stamp_[id] = epoch_;
+        ranges_[id] = r;
+        dominated_.push_back(v);
+    }
+
+    //in the order of addition
+    const std::vector<VertexId> &dominated() const {
+        return dominated_;
+    }
+
+    //only available for sparse workspace
+    const std::map<VertexId, Range> &ranges() const {
+        VERIFY(!flat_);
+        return sparse_ranges_;
+    }
+
+    void push(VertexId v) { queue_.push_back(v); }
+    bool queue_empty() const { return queue_head_ == queue_.size(); }
+    VertexId pop() { return queue_[queue_head_++]; }
+};
+
 template<class Graph>
 class DominatedSetFinder {
     typedef typename Graph::VertexId VertexId;
@@ -21,12 +114,13 @@ class DominatedSetFinder {
     size_t max_count_;
 
     size_t cnt_;
-    std::map<VertexId, Range> dominated_;
+    DominatedSetWorkspace<Graph> own_workspace_;
+    DominatedSetWorkspace<Graph> &ws_;
 
     bool CheckCanBeProcessed(VertexId v) const {
         DEBUG("Check if vertex " << g_.str(v) << " is dominated close neighbour");
         for (EdgeId e : g_.IncomingEdges(v)) {
-            if (dominated_.count(g_.EdgeStart(e)) == 0) {
+            if (!ws_.contains(g_.EdgeStart(e))) {
                 DEBUG("Blocked by external vertex " << g_.int_id(g_.EdgeStart(e)) << " that starts edge " << g_.int_id(e));
                 DEBUG("Check fail");
                 return false;
@@ -36,13 +130,13 @@ class DominatedSetFinder {
         return true;
     }
 
-    void UpdateCanBeProcessed(VertexId v, std::queue<VertexId> &can_be_processed) const {
+    void UpdateCanBeProcessed(VertexId v) const {
         DEBUG("Updating can be processed");
         for (EdgeId e : g_.OutgoingEdges(v)) {
             DEBUG("Considering edge " << g_.str(e));
             VertexId neighbour_v = g_.EdgeEnd(e);
             if (CheckCanBeProcessed(neighbour_v)) {
-                can_be_processed.push(neighbour_v);
+                ws_.push(neighbour_v);
             }
         }
     }
@@ -55,9 +149,9 @@ class DominatedSetFinder {
         VERIFY(!dominated_only || CheckCanBeProcessed(v));
         for (EdgeId e : g_.IncomingEdges(v)) {
             //in case of dominated_only == false
-            if (dominated_.count(g_.EdgeStart(e)) == 0)
+            if (!ws_.contains(g_.EdgeStart(e)))
                 continue;
-            Range range = dominated_.find(g_.EdgeStart(e))->second;
+            Range range = ws_.range(g_.EdgeStart(e));
             range.shift((int) g_.length(e));
             DEBUG("Edge " << g_.str(e) << " provide distance range " << range);
             if (range.start_pos < min)
@@ -83,27 +177,36 @@ class DominatedSetFinder {
 public:
     DominatedSetFinder(const Graph& g, VertexId v, size_t max_length = -1ul,
                        size_t max_count = -1ul)
+            : DominatedSetFinder(g, v, nullptr, max_length, max_count) {}
+
+    //workspace might be shared between consecutive finders (but not between threads),
+    //own sparse workspace is used if not provided
+    DominatedSetFinder(const Graph& g, VertexId v, DominatedSetWorkspace<Graph> *workspace,
+                       size_t max_length = -1ul, size_t max_count = -1ul)
             : g_(g),
               start_vertex_(v),
               max_length_(max_length),
               max_count_(max_count),
-              cnt_(0) {
-
+              cnt_(0),
+              own_workspace_(/*flat*/false),
+              ws_(workspace ? *workspace : own_workspace_) {
+        ws_.Reset();
     }
 
+    DominatedSetFinder(const DominatedSetFinder&) = delete;
+    DominatedSetFinder &operator=(const DominatedSetFinder&) = delete;
+
     //true if no thresholds exceeded
     bool FillDominated() {
         DEBUG("Adding starting vertex " << g_.str(start_vertex_) << " to dominated set");
-        dominated_.emplace(start_vertex_, Range(0, 0));
+        ws_.emplace(start_vertex_, Range(0, 0));
         cnt_++;
-        std::queue<VertexId> can_be_processed;
-        UpdateCanBeProcessed(start_vertex_, can_be_processed);
-        while (!can_be_processed.empty()) {
+        UpdateCanBeProcessed(start_vertex_);
+        while (!ws_.queue_empty()) {
             if (++cnt_ > max_count_) {
                 return false;
             }
-            VertexId v = can_be_processed.front();
-            can_be_processed.pop();
+            VertexId v = ws_.pop();
             Range r = NeighbourDistanceRange(v);
             if (r.start_pos > max_length_) {
                 return false;
@@ -111,19 +214,32 @@ public:
             //Currently dominated vertices cannot have edge to start vertex
             if (CheckNoEdgeToStart(v)) {
                 DEBUG("Adding vertex " << g_.str(v) << " to dominated set");
-                dominated_.emplace(v, r);
-                UpdateCanBeProcessed(v, can_be_processed);
+                ws_.emplace(v, r);
+                UpdateCanBeProcessed(v);
             }
         }
         return true;
     }
 
+    bool contains(VertexId v) const {
+        return ws_.contains(v);
+    }
+
+    const Range &range(VertexId v) const {
+        return ws_.range(v);
+    }
+
+    const std::vector<VertexId> &dominated_vertices() const {
+        return ws_.dominated();
+    }
+
+    //only available if the finder uses sparse workspace
     const std::map<VertexId, Range> &dominated() const {
-        return dominated_;
+        return ws_.ranges();
     }
 
     GraphComponent<Graph> AsGraphComponent() const {
-        return GraphComponent<Graph>::FromVertices(g_, utils::key_set(dominated_));
+        return GraphComponent<Graph>::FromVertices(g_, ws_.dominated());
     }
 
     //little meaning if FillDominated returned false
@@ -132,7 +248,7 @@ public:
         for (VertexId v : utils::key_set(border)) {
             for (EdgeId e : g_.OutgoingEdges(v)) {
                 VertexId e_end = g_.EdgeEnd(e);
-                if (dominated_.count(e_end) == 0) {
+                if (!ws_.contains(e_end)) {
                     border[e_end] = NeighbourDistanceRange(e_end, false);
                 }
             }
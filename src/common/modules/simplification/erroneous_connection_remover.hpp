@@ -19,9 +19,14 @@
 #include "assembly_graph/graph_support/basic_edge_conditions.hpp"
 #include "math/xmath.h"
 #include "assembly_graph/dijkstra/dijkstra_helper.hpp"
+#include "assembly_graph/paths/path_processor.hpp"
 #include "assembly_graph/core/coverage.hpp"
 #include "assembly_graph/graph_support/detail_coverage.hpp"
 #include "modules/simplification/topological_edge_conditions.hpp"
+#include "adt/bag.hpp"
+#include "utils/parallel/openmp_wrapper.h"
+
+#include <parallel_hashmap/phmap.h>
 
 namespace omnigraph {
 
@@ -86,80 +91,259 @@ inline bool IsSimpleBulge(const Graph &g, typename Graph::EdgeId e){
            edge_count >= 2;
 }
 
+/**
+ * Search for simple alternative paths between the ends of an edge. Paths are traversed
+ * in the same order and under the same limits as in ProcessPaths, the answers agree with
+ * MostCoveredSimpleAlternativePathChooser. Unlike generic enumeration, partial paths
+ * which are not simple or can not beat the best path found so far are cut off, and
+ * the Dijkstra run is shared by the queries from the same start vertex.
+ * Instance is reusable, but not thread-safe.
+ */
 template<class Graph>
-inline bool IsAlternativePathExist(const Graph &g, typename Graph::EdgeId e){
+class AlternativePathSearch {
+    typedef typename Graph::EdgeId EdgeId;
     typedef typename Graph::VertexId VertexId;
+    typedef PathProcessor<Graph> Processor;
+    typedef typename DijkstraHelper<Graph>::BoundedDijkstra DijkstraT;
+
+    const Graph &g_;
+    DijkstraT dijkstra_;
+    VertexId dijkstra_start_;
+    //maximal coverage of edges leaving the vertices reached by dijkstra
+    double max_coverage_;
+
+    VertexId start_;
+    EdgeId forbidden_;
+    EdgeId compulsory_;
+    bool first_suitable_;
+
+    std::vector<EdgeId> reversed_path_;
+    phmap::flat_hash_set<EdgeId> used_;
+    adt::bag<VertexId> vertex_cnts_;
+    std::vector<std::vector<EdgeId>> incoming_;
+    size_t call_cnt_;
+    double unnormalized_coverage_;
+    size_t path_length_;
+
+    bool found_;
+    double best_coverage_;
+    bool best_contains_compulsory_;
+
+    void RunDijkstra(VertexId start) {
+        if (dijkstra_start_ == start)
+            return;
+        dijkstra_.Run(start);
+        dijkstra_start_ = start;
+        max_coverage_ = 0.;
+        for (const auto &entry : dijkstra_.reached())
+            for (EdgeId e : g_.OutgoingEdges(entry.first))
+                max_coverage_ = std::max(max_coverage_, g_.coverage(e));
+    }
+
+    bool Usable(EdgeId e) const {
+        return e != forbidden_ && e != g_.conjugate(forbidden_) && e != g_.conjugate(e) &&
+               !used_.count(e) && !used_.count(g_.conjugate(e));
+    }
+
+    //coverage of the path can not exceed neither average coverage of its suffix
+    //nor the maximal coverage of the rest edges
+    bool Promising() const {
+        if (first_suitable_ || !found_)
+            return true;
+        double bound = max_coverage_;
+        if (path_length_ > 0)
+            bound = std::max(bound, unnormalized_coverage_ / (double) path_length_);
+        return !math::ls(bound, best_coverage_);
+    }
+
+    //same summation order as in AvgCoverage
+    double PathCoverage() const {
+        double unnormalized_coverage = 0;
+        size_t path_length = 0;
+        for (auto it = reversed_path_.rbegin(); it != reversed_path_.rend(); ++it) {
+            size_t length = g_.length(*it);
+            path_length += length;
+            unnormalized_coverage += g_.coverage(*it) * (double) length;
+        }
+        return unnormalized_coverage / (double) path_length;
+    }
 
-    MostCoveredSimpleAlternativePathChooser<Graph> path_chooser(g, e);
-
-    VertexId start = g.EdgeStart(e);
-    TRACE("Start " << g.str(start));
-    VertexId end = g.EdgeEnd(e);
-    TRACE("End " << g.str(end));
+    void HandlePath() {
+        double coverage = PathCoverage();
+        if (first_suitable_) {
+            if (math::gr(coverage, 0.)) {
+                found_ = true;
+                best_coverage_ = coverage;
+            }
+            return;
+        }
+        if (!found_ || coverage > best_coverage_) {
+            found_ = true;
+            best_coverage_ = coverage;
+            best_contains_compulsory_ = used_.count(compulsory_);
+        }
+    }
 
-    ProcessPaths(g, 0, std::numeric_limits<std::size_t>::max(), start, end, path_chooser);
+    void Push(EdgeId e, VertexId start_v) {
+        size_t length = g_.length(e);
+        path_length_ += length;
+        unnormalized_coverage_ += g_.coverage(e) * (double) length;
+        reversed_path_.push_back(e);
+        used_.insert(e);
+        vertex_cnts_.put(start_v);
+    }
 
-    const auto &path = path_chooser.most_covered_path();
-    double path_coverage = path_chooser.max_coverage();
-    if (!path.empty() && math::gr(path_coverage, 0.)) {
-        VERIFY(g.EdgeStart(path[0]) == start);
-        VERIFY(g.EdgeEnd(path.back()) == end);
+    void Pop() {
+        EdgeId e = reversed_path_.back();
+        size_t length = g_.length(e);
+        path_length_ -= length;
+        unnormalized_coverage_ -= g_.coverage(e) * (double) length;
+        reversed_path_.pop_back();
+        used_.erase(e);
+        vertex_cnts_.take(g_.EdgeStart(e));
+    }
 
+    bool CanGo(VertexId start_v) {
+        if (call_cnt_ >= Processor::VERTEX_USAGE_ENABLE_THRESHOLD &&
+                vertex_cnts_.mult(start_v) >= Processor::MAX_VERTEX_USAGE)
+            return false;
         return true;
     }
-    else
+
+    //returns true iff search should be stopped
+    bool Go(VertexId v) {
+        if (++call_cnt_ >= Processor::MAX_CALL_CNT)
+            return true;
+
+        if (v == start_ && !reversed_path_.empty()) {
+            HandlePath();
+            if (first_suitable_ && found_)
+                return true;
+        }
+
+        //incoming edges are kept per depth to avoid reallocations,
+        //outer vector might grow during the recursive calls
+        size_t depth = reversed_path_.size();
+        if (incoming_.size() <= depth)
+            incoming_.resize(depth + 1);
+        auto &incoming = incoming_[depth];
+        incoming.clear();
+        std::copy_if(g_.in_begin(v), g_.in_end(v), std::back_inserter(incoming), [&] (EdgeId e) {
+            return dijkstra_.DistanceCounted(g_.EdgeStart(e));
+        });
+
+        std::sort(incoming.begin(), incoming.end(),
+                  [&] (EdgeId e1, EdgeId e2) {
+                      auto first = dijkstra_.GetDistance(g_.EdgeStart(e1));
+                      auto second = dijkstra_.GetDistance(g_.EdgeStart(e2));
+                      if (first != second) {
+                          return first < second;
+                      }
+                      return g_.coverage(e1) > g_.coverage(e2);
+                  });
+
+        for (size_t i = 0; i < incoming_[depth].size(); ++i) {
+            EdgeId e = incoming_[depth][i];
+            VertexId start_v = g_.EdgeStart(e);
+            if (!Usable(e) || !CanGo(start_v))
+                continue;
+            Push(e, start_v);
+            bool stop = Promising() && Go(start_v);
+            Pop();
+            if (stop)
+                return true;
+        }
         return false;
-}
+    }
 
-template<class Graph>
-inline bool IsAlternativeInclusivePathExist(const Graph &g, typename Graph::EdgeId forbidden_edge, typename Graph::EdgeId compulsory_edge){
-    typedef typename Graph::VertexId VertexId;
+    void Search(EdgeId forbidden, EdgeId compulsory, bool first_suitable) {
+        forbidden_ = forbidden;
+        compulsory_ = compulsory;
+        first_suitable_ = first_suitable;
+        found_ = false;
+        best_coverage_ = 0.;
+        best_contains_compulsory_ = false;
+        if (forbidden == g_.conjugate(forbidden))
+            return;
 
-    MostCoveredSimpleAlternativePathChooser<Graph> path_chooser(g, forbidden_edge);
+        start_ = g_.EdgeStart(forbidden);
+        VertexId end = g_.EdgeEnd(forbidden);
+        RunDijkstra(start_);
+        if (!dijkstra_.DistanceCounted(end))
+            return;
 
-    VertexId start = g.EdgeStart(forbidden_edge);
-    TRACE("Start " << g.str(start));
-    VertexId end = g.EdgeEnd(forbidden_edge);
-    TRACE("End " << g.str(end));
+        call_cnt_ = 0;
+        unnormalized_coverage_ = 0.;
+        path_length_ = 0;
+        vertex_cnts_.put(end);
+        Go(end);
+        vertex_cnts_.take(end);
+        VERIFY(reversed_path_.empty() && vertex_cnts_.size() == 0);
+    }
 
-    ProcessPaths(g, 0, std::numeric_limits<std::size_t>::max(), start, end, path_chooser);
+public:
+    AlternativePathSearch(const Graph &g)
+            : g_(g),
+              dijkstra_(DijkstraHelper<Graph>::CreateBoundedDijkstra(g, std::numeric_limits<size_t>::max(),
+                                                                     Processor::MAX_DIJKSTRA_VERTICES)),
+              max_coverage_(0.) {
+    }
 
-    const auto &path = path_chooser.most_covered_path();
-    double path_coverage = path_chooser.max_coverage();
-    if (!path.empty() && math::gr(path_coverage, 0.)) {
-        VERIFY(g.EdgeStart(path[0]) == start);
-        VERIFY(g.EdgeEnd(path.back()) == end);
+    //should be called whenever the graph might have been changed
+    void Reset() {
+        dijkstra_start_ = VertexId();
+    }
 
-        if (std::find(path.begin(), path.end(), compulsory_edge) != path.end()){
-            return true;
-        }
+    //checks if there is a simple path of positive coverage between the ends of e, other than e itself
+    bool AlternativeExists(EdgeId e) {
+        Search(e, EdgeId(), /*first suitable*/true);
+        return found_;
     }
-    return false;
+
+    //checks if the most covered simple alternative for forbidden_edge passes through compulsory_edge
+    bool BestAlternativeContains(EdgeId forbidden_edge, EdgeId compulsory_edge) {
+        Search(forbidden_edge, compulsory_edge, /*first suitable*/false);
+        return found_ && math::gr(best_coverage_, 0.) && best_contains_compulsory_;
+    }
+};
+
+template<class Graph>
+inline bool IsAlternativePathExist(const Graph &g, typename Graph::EdgeId e){
+    return AlternativePathSearch<Graph>(g).AlternativeExists(e);
 }
 
 template<class Graph>
-inline bool IsReachableBulge(const Graph &g, typename Graph::EdgeId e){
+inline bool IsAlternativeInclusivePathExist(const Graph &g, typename Graph::EdgeId forbidden_edge, typename Graph::EdgeId compulsory_edge){
+    return AlternativePathSearch<Graph>(g).BestAlternativeContains(forbidden_edge, compulsory_edge);
+}
+
+template<class Graph>
+inline bool IsReachableBulge(const Graph &g, typename Graph::EdgeId e, AlternativePathSearch<Graph> &search){
     typedef typename Graph::EdgeId EdgeId;
-    typedef typename Graph::VertexId VertexId;
 
-    bool res = IsAlternativePathExist(g, e);
-    if (res)
-        return res;
-    else{
-        VertexId start = g.EdgeStart(e), end = g.EdgeEnd(e);
-        std::vector<EdgeId> incident;
-        utils::push_back_all(incident, g.IncomingEdges(end));
-        utils::push_back_all(incident, g.OutgoingEdges(start));
-        for (auto it = incident.begin(); it != incident.end(); ++it){
-            res = IsAlternativeInclusivePathExist(g, *it, e);
-            if (res){
-                return res;
-            }
-        }
+    search.Reset();
+    if (search.AlternativeExists(e))
+        return true;
+
+    //edges sharing the start with e go first to reuse the dijkstra run,
+    //e itself is skipped since its alternatives can not pass through it
+    for (EdgeId out_e : g.OutgoingEdges(g.EdgeStart(e))) {
+        if (out_e != e && search.BestAlternativeContains(out_e, e))
+            return true;
+    }
+    for (EdgeId in_e : g.IncomingEdges(g.EdgeEnd(e))) {
+        if (in_e != e && search.BestAlternativeContains(in_e, e))
+            return true;
     }
     return false;
 }
 
+template<class Graph>
+inline bool IsReachableBulge(const Graph &g, typename Graph::EdgeId e){
+    AlternativePathSearch<Graph> search(g);
+    return IsReachableBulge(g, e, search);
+}
+
 //todo move to rnaSPAdes project
 template<class Graph>
 class NotBulgeECCondition : public EdgeCondition<Graph> {
@@ -167,11 +351,17 @@ class NotBulgeECCondition : public EdgeCondition<Graph> {
     typedef typename Graph::VertexId VertexId;
     typedef EdgeCondition<Graph> base;
 
+    //one search state per thread, shared by the copies of the condition
+    std::shared_ptr<std::vector<AlternativePathSearch<Graph>>> searches_;
+
 public:
 
     NotBulgeECCondition(const Graph &g)
-            : base(g) {
-
+            : base(g),
+              searches_(std::make_shared<std::vector<AlternativePathSearch<Graph>>>()) {
+        searches_->reserve(omp_get_max_threads());
+        for (size_t i = 0; i < (size_t) omp_get_max_threads(); ++i)
+            searches_->emplace_back(g);
     }
 
     bool Check(EdgeId e) const {
@@ -183,7 +373,9 @@ public:
                  << " incoming e = " << this->g().IncomingEdgeCount(this->g().EdgeEnd(e)));
         }
 //        return !IsSimpleBulge(this->g(), e);
-        return !IsReachableBulge(this->g(), e);
+        size_t thread = omp_get_thread_num();
+        VERIFY(thread < searches_->size());
+        return !IsReachableBulge(this->g(), e, (*searches_)[thread]);
     }
 
 private:
@@ -290,6 +290,8 @@ class RelativeCovDisconnectionCondition : public EdgeCondition<Graph> {
     //Total length of highly-covered neighbourhood
     // We believe that if high-covered component is small it is likely to be repeat or loop
     const size_t min_neighbourhood_size_;
+    //coverage bound depends on the edge and is passed per search
+    const HighCoverageComponentFinder<Graph> neighbourhood_finder_;
 public:
     RelativeCovDisconnectionCondition(const Graph& g,
                                       double diff_mult,
@@ -297,7 +299,8 @@ public:
             base(g),
             rel_helper_(g, diff_mult),
             diff_mult_(diff_mult),
-            min_neighbourhood_size_(min_neighbourhood_size) {
+            min_neighbourhood_size_(min_neighbourhood_size),
+            neighbourhood_finder_(g, 0., min_neighbourhood_size) {
     }
 
     bool Check(EdgeId e) const override {
@@ -306,8 +309,7 @@ public:
         DEBUG("Max local coverage incoming  - " << rel_helper_.MaxCoverage(this->g().IncomingEdges(v)));
         DEBUG("Max local coverage outgoing  - " << rel_helper_.MaxCoverage(this->g().OutgoingEdges(v)));
         return rel_helper_.AnyHighlyCoveredOnBothSides(v, this->g().coverage(e)) &&
-                HighCoverageComponentFinder<Graph>(this->g(), this->g().coverage(e) * diff_mult_, min_neighbourhood_size_)
-                       .CumulativeEdgeLength(v) >= min_neighbourhood_size_;
+                neighbourhood_finder_.CumulativeEdgeLength(v, this->g().coverage(e) * diff_mult_) >= min_neighbourhood_size_;
     }
 
 private:
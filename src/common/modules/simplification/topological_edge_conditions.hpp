@@ -8,7 +8,13 @@
 #pragma once
 
 #include "assembly_graph/graph_support/basic_edge_conditions.hpp"
+#include "assembly_graph/core/action_handlers.hpp"
 #include "assembly_graph/core/directions.hpp"
+#include "assembly_graph/core/graph_iterators.hpp"
+#include "adt/concurrent_dsu.hpp"
+#include "utils/parallel/openmp_wrapper.h"
+
+#include <memory>
 
 namespace omnigraph {
 
@@ -169,14 +175,235 @@ public:
 
 };
 
+/**
+ * Partition of graph vertices into regions connected by short (< uniqueness_length) edges
+ * with numbers of long edges entering and leaving each region. Initial labelling is built
+ * in parallel with union-find, afterwards graph changes only invalidate the regions of
+ * affected vertices, which are lazily recomputed on the next query.
+ * Regions with more than max_size vertices are not aggregated and reported as large.
+ */
+template<class Graph>
+class ShortEdgeRegions : public GraphActionHandler<Graph> {
+    typedef typename Graph::VertexId VertexId;
+    typedef typename Graph::EdgeId EdgeId;
+    typedef GraphActionHandler<Graph> base;
+    static constexpr size_t NO_REGION = -1ul;
+
+public:
+    struct Region {
+        size_t size = 0;
+        size_t in_long = 0;
+        size_t out_long = 0;
+        size_t dead_ends = 0;
+        bool stale = false;
+        //number of vertices labeled with the region, the slot is reused once it drops to zero
+        size_t labels = 0;
+    };
+
+private:
+    size_t uniqueness_length_;
+    size_t max_size_;
+    std::vector<size_t> label_;
+    std::vector<Region> regions_;
+    std::vector<size_t> free_;
+    std::vector<VertexId> queue_;
+
+    bool IsShort(EdgeId e) const {
+        return this->g().length(e) < uniqueness_length_;
+    }
+
+    void Account(VertexId v, Region &region) const {
+        const Graph &g = this->g();
+        if (g.OutgoingEdgeCount(v) == 0 || g.IncomingEdgeCount(v) == 0)
+            region.dead_ends += 1;
+        for (EdgeId e : g.OutgoingEdges(v))
+            if (!IsShort(e))
+                region.out_long += 1;
+        for (EdgeId e : g.IncomingEdges(v))
+            if (!IsShort(e))
+                region.in_long += 1;
+    }
+
+    void Build(size_t chunk_cnt) {
+        const Graph &g = this->g();
+        size_t n = g.max_vid() + 1;
+        dsu::ConcurrentDSU dsu(n);
+        auto chunks = IterationHelper<Graph, VertexId>(g).Chunks(chunk_cnt);
+
+        #pragma omp parallel for schedule(guided)
+        for (size_t i = 0; i < chunks.size() - 1; ++i) {
+            for (auto it = chunks[i], end = chunks[i + 1]; it != end; ++it) {
+                for (EdgeId e : g.OutgoingEdges(*it))
+                    if (IsShort(e))
+                        dsu.unite(g.int_id(*it), g.int_id(g.EdgeEnd(e)));
+            }
+        }
+
+        //regions are indexed by the ids of the dsu roots
+        label_.assign(n, NO_REGION);
+        regions_.assign(n, Region());
+        #pragma omp parallel for schedule(guided)
+        for (size_t i = 0; i < chunks.size() - 1; ++i) {
+            for (auto it = chunks[i], end = chunks[i + 1]; it != end; ++it) {
+                size_t id = g.int_id(*it);
+                size_t root = dsu.find_set(id);
+                label_[id] = root;
+                Region &region = regions_[root];
+                if (id == root)
+                    region.size = region.labels = dsu.set_size(root);
+                if (dsu.set_size(root) > max_size_)
+                    continue;
+
+                Region local;
+                Account(*it, local);
+                #pragma omp atomic
+                region.in_long += local.in_long;
+                #pragma omp atomic
+                region.out_long += local.out_long;
+                #pragma omp atomic
+                region.dead_ends += local.dead_ends;
+            }
+        }
+
+        free_.clear();
+        for (size_t r = n; r > 0; --r) {
+            if (!regions_[r - 1].labels)
+                free_.push_back(r - 1);
+        }
+        DEBUG("Short edge regions built for " << g.size() << " vertices");
+    }
+
+    void Release(size_t region) {
+        if (region == NO_REGION)
+            return;
+        VERIFY(regions_[region].labels > 0);
+        if (--regions_[region].labels == 0)
+            free_.push_back(region);
+    }
+
+    void Invalidate(VertexId v) {
+        size_t id = this->g().int_id(v);
+        if (id >= label_.size() || label_[id] == NO_REGION)
+            return;
+        regions_[label_[id]].stale = true;
+        Release(label_[id]);
+        label_[id] = NO_REGION;
+    }
+
+    void SetLabel(VertexId v, size_t region) {
+        size_t id = this->g().int_id(v);
+        if (id >= label_.size())
+            label_.resize(this->g().max_vid() + 1, NO_REGION);
+        Release(label_[id]);
+        regions_[region].labels += 1;
+        label_[id] = region;
+    }
+
+    bool Visit(VertexId v, size_t region) {
+        size_t id = this->g().int_id(v);
+        if (id < label_.size() && label_[id] == region)
+            return false;
+        SetLabel(v, region);
+        queue_.push_back(v);
+        return true;
+    }
+
+    //collects the region of v anew, stops as soon as it turns out to be large
+    size_t Relabel(VertexId v) {
+        const Graph &g = this->g();
+        size_t r;
+        if (free_.empty()) {
+            r = regions_.size();
+            regions_.emplace_back();
+        } else {
+            r = free_.back();
+            free_.pop_back();
+            regions_[r] = Region();
+        }
+        Region region;
+
+        queue_.clear();
+        Visit(v, r);
+        for (size_t i = 0; i < queue_.size() && queue_.size() <= max_size_; ++i) {
+            VertexId u = queue_[i];
+            Account(u, region);
+            for (EdgeId e : g.OutgoingEdges(u))
+                if (IsShort(e))
+                    Visit(g.EdgeEnd(e), r);
+            for (EdgeId e : g.IncomingEdges(u))
+                if (IsShort(e))
+                    Visit(g.EdgeStart(e), r);
+        }
+        region.size = queue_.size();
+        region.labels = regions_[r].labels;
+        regions_[r] = region;
+        return r;
+    }
+
+    void InvalidateEnds(EdgeId e) {
+        Invalidate(this->g().EdgeStart(e));
+        Invalidate(this->g().EdgeEnd(e));
+    }
+
+public:
+    ShortEdgeRegions(const Graph &g, size_t uniqueness_length, size_t max_size,
+                     size_t chunk_cnt = omp_get_max_threads())
+            : base(g, "ShortEdgeRegions"),
+              uniqueness_length_(uniqueness_length),
+              max_size_(max_size) {
+        Build(chunk_cnt);
+    }
+
+    size_t uniqueness_length() const {
+        return uniqueness_length_;
+    }
+
+    size_t region_id(VertexId v) {
+        size_t id = this->g().int_id(v);
+        if (id < label_.size() && label_[id] != NO_REGION && !regions_[label_[id]].stale)
+            return label_[id];
+        return Relabel(v);
+    }
+
+    const Region &region(size_t region_id) const {
+        return regions_[region_id];
+    }
+
+    bool large(const Region &region) const {
+        return region.size > max_size_;
+    }
+
+    //number of region slots allocated, freed slots are reused by the relabeled regions
+    size_t slots() const {
+        return regions_.size();
+    }
+
+    void HandleAdd(EdgeId e) override {
+        InvalidateEnds(e);
+    }
+
+    void HandleDelete(EdgeId e) override {
+        InvalidateEnds(e);
+    }
+
+    void HandleDelete(VertexId v) override {
+        Invalidate(v);
+    }
+
+private:
+    DECL_LOGGER("ShortEdgeRegions");
+};
+
 template<class Graph>
 class MultiplicityCounter {
 private:
     typedef typename Graph::VertexId VertexId;
     typedef typename Graph::EdgeId EdgeId;
+    typedef ShortEdgeRegions<Graph> Regions;
     const Graph &graph_;
     size_t uniqueness_length_;
     size_t max_depth_;
+    std::shared_ptr<Regions> regions_;
 
     bool search(VertexId a, VertexId start, EdgeId e, size_t depth,
                 std::set<VertexId> &was, std::pair<size_t, size_t> &result) const {
@@ -221,6 +448,37 @@ private:
         return true;
     }
 
+    bool search(VertexId start, EdgeId e, std::pair<size_t, size_t> &result) const {
+        std::set<VertexId> was;
+        return search(start, start, e, 0, was, result);
+    }
+
+    //Same as search, but answered from the precomputed region of start.
+    //Recursion stack of search consists of distinct vertices of the region,
+    //so depth limit can only be hit in regions of more than max_depth vertices.
+    bool RegionSearch(VertexId start, EdgeId e, std::pair<size_t, size_t> &result) const {
+        if (graph_.length(e) < uniqueness_length_)
+            return search(start, e, result);
+
+        size_t r = regions_->region_id(start);
+        auto region = regions_->region(r);
+        if (regions_->large(region))
+            return search(start, e, result);
+        if (region.dead_ends > 0)
+            return false;
+
+        result = {region.in_long, region.out_long};
+        for (VertexId v : {graph_.EdgeStart(e), graph_.EdgeEnd(e)}) {
+            if (v != start && regions_->region_id(v) == r)
+                return false;
+        }
+        if (graph_.EdgeEnd(e) == start)
+            result.first--;
+        if (graph_.EdgeStart(e) == start)
+            result.second--;
+        return true;
+    }
+
 public:
     MultiplicityCounter(const Graph &graph, size_t uniqueness_length,
                         size_t max_depth)
@@ -229,10 +487,18 @@ public:
               max_depth_(max_depth) {
     }
 
+    //regions should be built for the same uniqueness length and max_depth as a size limit
+    MultiplicityCounter(const Graph &graph, std::shared_ptr<Regions> regions,
+                        size_t max_depth)
+            : graph_(graph),
+              uniqueness_length_(regions->uniqueness_length()),
+              max_depth_(max_depth),
+              regions_(std::move(regions)) {
+    }
+
     size_t count(EdgeId e, VertexId start) const {
         std::pair<size_t, size_t> result;
-        std::set<VertexId> was;
-        bool valid = search(start, start, e, 0, was, result);
+        bool valid = regions_ ? RegionSearch(start, e, result) : search(start, e, result);
         if (!valid) {
             return (size_t) (-1);
         }
@@ -278,7 +544,7 @@ public:
             :
     //todo why 8???
             base(g),
-            multiplicity_counter_(g, uniqueness_length, 8),
+            multiplicity_counter_(g, std::make_shared<ShortEdgeRegions<Graph>>(g, uniqueness_length, 8), 8),
             plausiblity_condition_(plausiblity_condition) {
 
     }
@@ -8,12 +8,20 @@
 
 #include "distance_estimation.hpp"
 #include "pair_info_bounds.hpp"
-#include "assembly_graph/paths/path_processor.hpp"
+#include "utils/parallel/openmp_wrapper.h"
 
 namespace omnigraph::de {
 
 using namespace debruijn_graph;
 
+GraphDistanceFinder::GraphDistanceFinder(const Graph &graph, size_t insert_size, size_t read_length, size_t delta) :
+        graph_(graph), insert_size_(insert_size), gap_((int) (insert_size - 2 * read_length)),
+        delta_((double) delta) {
+    path_lengths_.reserve(omp_get_max_threads());
+    for (size_t i = 0; i < (size_t) omp_get_max_threads(); ++i)
+        path_lengths_.emplace_back(graph);
+}
+
 std::vector<size_t> GraphDistanceFinder::GetGraphDistancesLengths(EdgeId e1, EdgeId e2) const {
     LengthMap m;
     m.insert({e2, {}});
@@ -24,9 +32,12 @@ std::vector<size_t> GraphDistanceFinder::GetGraphDistancesLengths(EdgeId e1, Edg
 }
 
 void GraphDistanceFinder::FillGraphDistancesLengths(EdgeId e1, LengthMap &second_edges) const {
-    std::vector<size_t> path_lower_bounds;
     size_t path_upper_bound = PairInfoPathLengthUpperBound(graph_.k(), insert_size_, delta_);
-    PathProcessor <Graph> paths_proc(graph_, graph_.EdgeEnd(e1), path_upper_bound);
+    size_t tid = omp_get_thread_num();
+    VERIFY(tid < path_lengths_.size());
+    auto &path_lengths = path_lengths_[tid];
+    // lengths of all the paths from e1 are found in one sweep instead of enumerating the paths to every e2
+    path_lengths.Run(graph_.EdgeEnd(e1), path_upper_bound);
 
     for (auto &entry : second_edges) {
         EdgeId e2 = entry.first;
@@ -35,20 +46,17 @@ void GraphDistanceFinder::FillGraphDistancesLengths(EdgeId e1, LengthMap &second
 
         TRACE("Bounds for paths are " << path_lower_bound << " " << path_upper_bound);
 
-        DistancesLengthsCallback<Graph> callback(graph_);
-        paths_proc.Process(graph_.EdgeStart(e2), path_lower_bound, path_upper_bound, callback);
-        GraphLengths lengths = callback.distances();
-        for (size_t j = 0; j < lengths.size(); ++j) {
+        GraphLengths lengths;
+        if (e1 == e2)
+            lengths.push_back(0);
+        path_lengths.Lengths(graph_.EdgeStart(e2), path_lower_bound, path_upper_bound, lengths);
+        for (size_t j = (e1 == e2) ? 1 : 0; j < lengths.size(); ++j) {
             lengths[j] += graph_.length(e1);
             TRACE("Resulting distance set for " <<
                                                 " edge " << graph_.int_id(e2) <<
                                                 " #" << j << " length " << lengths[j]);
         }
 
-        if (e1 == e2)
-            lengths.push_back(0);
-
-        std::sort(lengths.begin(), lengths.end());
         entry.second = lengths;
     }
 }
@@ -14,6 +14,7 @@
 #include "concurrent_pair_info_buffer.hpp"
 
 #include "assembly_graph/core/graph.hpp"
+#include "assembly_graph/paths/path_length_sets.hpp"
 
 #include "math/xmath.h"
 
@@ -28,9 +29,7 @@ class GraphDistanceFinder {
     typedef std::map<debruijn_graph::EdgeId, GraphLengths> LengthMap;
 
 public:
-    GraphDistanceFinder(const debruijn_graph::Graph &graph, size_t insert_size, size_t read_length, size_t delta) :
-            graph_(graph), insert_size_(insert_size), gap_((int) (insert_size - 2 * read_length)),
-            delta_((double) delta) { }
+    GraphDistanceFinder(const debruijn_graph::Graph &graph, size_t insert_size, size_t read_length, size_t delta);
 
     std::vector<size_t> GetGraphDistancesLengths(debruijn_graph::EdgeId e1, debruijn_graph::EdgeId e2) const;
 
@@ -43,6 +42,8 @@ private:
     const size_t insert_size_;
     const int gap_;
     const double delta_;
+    // per-thread workspaces
+    mutable std::vector<PathLengthSets<debruijn_graph::Graph>> path_lengths_;
 };
 
 class AbstractDistanceEstimator {
@@ -14,6 +14,7 @@
 #include "split_path_constructor.hpp"
 #include "paired_info/paired_info_helpers.hpp"
 #include "assembly_graph/paths/path_utils.hpp"
+#include "assembly_graph/paths/path_length_sets.hpp"
 #include "assembly_graph/core/graph_iterators.hpp"
 #include <math.h>
 
@@ -52,10 +53,12 @@ bool AddNonIntersectingInfo(omnigraph::de::PairedInfoIndexT<Graph>& clustered_in
 template<class Graph>
 class PairInfoImprover {
     typedef typename Graph::EdgeId EdgeId;
+    typedef typename Graph::VertexId VertexId;
     typedef std::vector<omnigraph::de::PairInfo<EdgeId> > PairInfos;
     typedef std::pair<EdgeId, EdgeId> EdgePair;
     typedef omnigraph::de::PairedInfoIndexT<Graph> Index;
     typedef omnigraph::de::ConcurrentClusteredPairedInfoBuffer<Graph> Buffer;
+    typedef omnigraph::PathLengthSets<Graph> LengthSets;
 
   public:
     PairInfoImprover(const Graph& g,
@@ -79,8 +82,20 @@ class PairInfoImprover {
              << "; contradictional = " << extra_paired_info_count);
     }
 
-    bool IsConsistent(EdgeId /*e*/, EdgeId e1, EdgeId e2,
-                      const omnigraph::de::Point& p1, const omnigraph::de::Point& p2) const {
+    // Checks for a path between e1 and e2 with length in [min_length, max_length]. Path lengths from
+    // the end of e1 are found for all lengths up to sweep_length at once and reused by further checks
+    bool PathExists(EdgeId e1, EdgeId e2, size_t min_length, size_t max_length,
+                    size_t sweep_length, LengthSets &path_lengths) const {
+        VertexId start = graph_.EdgeEnd(e1);
+        if (path_lengths.start() != start || path_lengths.max_length() < max_length)
+            path_lengths.Run(start, std::max(sweep_length, max_length));
+
+        return path_lengths.Contains(graph_.EdgeStart(e2), min_length, max_length);
+    }
+
+    bool IsConsistent(EdgeId e1, EdgeId e2,
+                      const omnigraph::de::Point& p1, const omnigraph::de::Point& p2,
+                      size_t sweep_length, LengthSets &path_lengths) const {
         if (math::le(p1.d, 0.f) || math::le(p2.d, 0.f) || math::gr(p1.d, p2.d))
             return true;
 
@@ -96,14 +111,14 @@ class PairInfoImprover {
             if (graph_.EdgeEnd(e1) == graph_.EdgeStart(e2))
                 return true;
 
-            auto paths = GetAllPathsBetweenEdges(graph_, e1, e2, 0, (size_t) ceil(pi_dist - first_length + var));
-            return (paths.size() > 0);
+            return PathExists(e1, e2, 0, (size_t) std::max(ceil(pi_dist - first_length + var), 0.),
+                              sweep_length, path_lengths);
         } else {
             if (math::gr(p2.d, p1.d + omnigraph::de::DEDistance(first_length))) {
-                auto paths = GetAllPathsBetweenEdges(graph_, e1, e2,
-                                                     (size_t) floor(pi_dist - first_length - var),
-                                                     (size_t)  ceil(pi_dist - first_length + var));
-                return (paths.size() > 0);
+                return PathExists(e1, e2,
+                                  (size_t) floor(pi_dist - first_length - var),
+                                  (size_t)  ceil(pi_dist - first_length + var),
+                                  sweep_length, path_lengths);
             }
             return false;
         }
@@ -112,9 +127,22 @@ class PairInfoImprover {
     }
 
     // Checking the consistency of two edge pairs (e, e_1) and (e, e_2) for all pairs (base_edge, <some_edge>)
-    void FindInconsistent(EdgeId base_edge, Buffer& to_remove) const {
+    void FindInconsistent(EdgeId base_edge, Buffer& to_remove, LengthSets &path_lengths) const {
+        // Paths checked for (e1, e2) are never longer than
+        // max (p2.d + p2.var) - min (p1.d - p1.var) - length(e1)
+        double max_right = 0.;
+        for (auto i : index_.Get(base_edge))
+            for (auto p : i.second)
+                max_right = std::max(max_right, double(p.d + p.var));
+
         for (auto i1 : index_.Get(base_edge)) {
             auto e1 = i1.first;
+            double min_left = max_right;
+            for (auto p1 : i1.second)
+                if (math::gr(p1.d, 0.f))
+                    min_left = std::min(min_left, double(p1.d - p1.var));
+            size_t sweep_length = (size_t) std::max(ceil(max_right - min_left - (double) graph_.length(e1)), 0.);
+
             for (auto i2 : index_.Get(base_edge)) {
                 auto e2 = i2.first;
                 if (e1 == e2)
@@ -122,7 +150,7 @@ class PairInfoImprover {
 
                 for (auto p1 : i1.second) {
                     for (auto p2 : i2.second) {
-                        if (IsConsistent(base_edge, e1, e2, p1, p2))
+                        if (IsConsistent(e1, e2, p1, p2, sweep_length, path_lengths))
                             continue;
 
                         to_remove.Add(base_edge, e1, p1.lt(p2) ? p1 : p2);
@@ -140,11 +168,12 @@ class PairInfoImprover {
 
         #pragma omp parallel for schedule(guided) num_threads(nthreads)
         for (size_t i = 0; i < ranges.size(); ++i) {
+            LengthSets path_lengths(graph_);
             for (EdgeId e : ranges[i]) {
                 if (graph_.length(e) < max_repeat_length_ || !index_.contains(e))
                     continue;
 
-                FindInconsistent(e, buf);
+                FindInconsistent(e, buf, path_lengths);
             }
         }
 
@@ -161,7 +190,7 @@ class PairInfoImprover {
         size_t cnt = 0;
         for (auto I = omnigraph::de::half_pair_begin(to_remove);
             I != omnigraph::de::half_pair_end(to_remove); ++I) {
-            cnt += DeleteIfExist(I.first(), I.second(), *I);
+            cnt += index_.Remove(I.first(), I.second(), *I);
         }
 
         DEBUG("Size of index " << index_.size());
@@ -208,17 +237,6 @@ class PairInfoImprover {
         return cnt;
     }
 
-    template<class Histogram>
-    size_t DeleteIfExist(EdgeId e1, EdgeId e2, const Histogram &infos) {
-        size_t cnt = 0;
-        for (auto point : infos) {
-            cnt += index_.Remove(e1, e2, point);
-            TRACE("cnt += " << cnt);
-        }
-
-        return cnt;
-    }
-
     const Graph& graph_;
     Index& index_;
     const io::SequencingLibrary<config::LibraryData>& lib_;
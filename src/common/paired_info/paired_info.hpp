@@ -359,6 +359,37 @@ public:
         return removed;
     }
 
+    /**
+     * @brief Removes the set of entries of the pair from the index, and their conjugates.
+     *        Should be used instead of point-by-point removal.
+     * @warning Don't use it on unclustered index, because hashmaps require set_deleted_item
+     * @return The number of deleted entries
+     */
+    template<class Histogram>
+    size_t Remove(EdgeId e1, EdgeId e2, const Histogram &points) {
+        EdgePair minep, maxep;
+        std::tie(minep, maxep) = this->MinMaxConjugatePair({ e1, e2 });
+
+        auto i1 = this->storage_.find(minep.first);
+        if (i1 == this->storage_.end())
+            return 0;
+        auto i2 = i1->second.find(minep.second);
+        if (i2 == i1->second.end())
+            return 0;
+
+        size_t res = 0;
+        size_t length = this->graph_.length(e1);
+        for (const auto &p : points)
+            res += i2->second->erase(Traits::Shrink(p, length));
+        size_t removed = (this->IsSelfConj(e1, e2) ? res : 2 * res);
+        this->size_ -= removed;
+
+        Prune(maxep.first, maxep.second);
+        Prune(minep.first, minep.second);
+
+        return removed;
+    }
+
     /**
      * @brief Removes the whole histogram from the index, and its conjugate.
      * @warning Don't use it on unclustered index, because hashmaps require set_deleted_item
@@ -121,10 +121,7 @@ public:
 
                     sub_res.push_back(cur_pi);
                     total_length -= graph_.length(common_part[j]);
-                    for (size_t ind = 0; ind + 1 < i; ++ind) {
-                        if (cur_pi == pair_infos[ind])
-                            pair_info_used[ind] = true;
-                    }
+                    MarkUsed(pair_infos, i - 1, cur_pi, pair_info_used);
                 }
             }
 
@@ -136,6 +133,26 @@ public:
     }
 
 private:
+    // Marks infos equal to pi among the first cnt ones. Infos are sorted by decreasing distance,
+    // and distances are compared approximately, so equal ones are found around the
+    // binary search position instead of the linear scan
+    static void MarkUsed(const std::vector<PairInfo> &pair_infos, size_t cnt,
+                         const PairInfo &pi, std::vector<bool> &pair_info_used) {
+        auto begin = pair_infos.begin(), end = pair_infos.begin() + cnt;
+        auto pos = std::partition_point(begin, end, [&](const PairInfo &info) {
+            return info.point.d > pi.point.d;
+        });
+
+        for (auto it = pos; it != begin && math::eq((it - 1)->point.d, pi.point.d); --it) {
+            if (pi == *(it - 1))
+                pair_info_used[it - 1 - begin] = true;
+        }
+        for (auto it = pos; it != end && math::eq(it->point.d, pi.point.d); ++it) {
+            if (pi == *it)
+                pair_info_used[it - begin] = true;
+        }
+    }
+
     const Graph &graph_;
 };
 
@@ -38,8 +38,10 @@ void ClearQuality(GraphPack& gp) {
 
 void EnsureIndex(GraphPack& gp) {
     auto &index = gp.get_mutable<EdgeIndex<Graph>>();
-    if (index.IsAttached())
+    if (index.IsAttached()) {
+        index.Compact();
         return;
+    }
 
     INFO("Index refill");
     index.Refill();
@@ -20,20 +20,65 @@
 #include <string>
 #include <memory>
 #include <cstring>
+#include <algorithm>
 
 // Silence bogus gcc warnings
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wconversion"
 
+namespace seq {
+namespace impl {
+
+// ACGTacgt0123 -> 0123, everything else is mapped the same way as dignucl() does
+struct NuclEncodeTable {
+    char code[256];
+
+    constexpr NuclEncodeTable()
+            : code() {
+        for (unsigned i = 0; i < 256; ++i) {
+            char c = char(i);
+            if (c >= 0 && c < 4) {
+                code[i] = c;
+                continue;
+            }
+            if ('a' <= c && c <= 't')
+                c = char(c - 'a' + 'A');
+            code[i] = (c <= 'C' ? (c == 'A' ? 0 : 1) : (c == 'G' ? 2 : 3));
+        }
+    }
+};
+
+// Packed byte (4 nucleotides, first one in the lowest bits) -> 4 ACGT symbols
+struct NuclDecodeTable {
+    char nucls[256][4];
+
+    constexpr NuclDecodeTable()
+            : nucls() {
+        for (unsigned i = 0; i < 256; ++i)
+            for (unsigned j = 0; j < 4; ++j)
+                nucls[i][j] = "ACGT"[(i >> (2 * j)) & 3];
+    }
+};
+
+inline constexpr NuclEncodeTable NUCL_ENCODE{};
+inline constexpr NuclDecodeTable NUCL_DECODE{};
+
+}
+}
+
+class SequenceBuilder;
+
 class Sequence {
+    friend class SequenceBuilder;
+
     // Type to store Seq in Sequences
     typedef seq::seq_element_type ST;
     // Number of bits in ST
-    const static size_t STBits = sizeof(ST) << 3;
+    static constexpr size_t STBits = sizeof(ST) << 3;
     // Number of nucleotides in ST
-    const static size_t STN = (STBits >> 1);
+    static constexpr size_t STN = (STBits >> 1);
     // Number of bits in STN (for faster div and mod)
-    const static size_t STNBits = log_<STN, 2>::value;
+    static constexpr size_t STNBits = log_<STN, 2>::value;
 
     class ManagedNuclBuffer final : public llvm::ThreadSafeRefCountedBase<ManagedNuclBuffer>,
                                     protected llvm::TrailingObjects<ManagedNuclBuffer, ST> {
@@ -78,52 +123,84 @@ class Sequence {
 
         VERIFY(is_dignucl(s[0]) || is_nucl(s[0]));
 
-        // Which symbols does our string contain : 0123 or ACGT?
-        bool digit_str = is_dignucl(s[0]);
-
-        // data -- one temporary variable corresponding to the i-th array element
-        // and some counters
-        ST data = 0;
-        size_t cnt = 0;
+        // Both 0123 and ACGT strings are handled by the same table. Each
+        // element is filled in one go, STN nucleotides at a time.
+        const char *code = seq::impl::NUCL_ENCODE.code;
         size_t cur = 0;
-
-        if (rc) {
-            for (int i = (int) size_ - 1; i >= 0; --i) {
-                //VERIFY(is_dignucl(s[i]) || is_nucl(s[i]));
-                char c = complement(digit_str ? s[(unsigned) i] : dignucl(s[(unsigned) i]));
-
-                data = data | (ST(c) << cnt);
-                cnt += 2;
-
-                if (cnt == STBits) {
-                    bytes[cur++] = data;
-                    cnt = 0;
-                    data = 0;
-                }
-            }
-        } else {
-            for (size_t i = 0; i < size_; ++i) {
-                //VERIFY(is_dignucl(s[i]) || is_nucl(s[i]));
-                char c = digit_str ? s[i] : dignucl(s[i]);
-
-                data = data | (ST(c) << cnt);
-                cnt += 2;
-
-                if (cnt == STBits) {
-                    bytes[cur++] = data;
-                    cnt = 0;
-                    data = 0;
-                }
+        for (size_t i = 0; i < size_; i += STN, ++cur) {
+            size_t n = std::min(STN, size_ - i);
+            ST data = 0;
+            if (rc) {
+                for (size_t j = 0; j < n; ++j)
+                    data |= ST(code[(uint8_t) s[size_ - 1 - i - j]] ^ 3) << (j << 1);
+            } else {
+                for (size_t j = 0; j < n; ++j)
+                    data |= ST(code[(uint8_t) s[i + j]]) << (j << 1);
             }
+            bytes[cur] = data;
         }
 
-        if (cnt != 0)
-            bytes[cur++] = data;
-
         for (; cur < bytes_size; ++cur)
             bytes[cur] = 0;
     }
 
+    static ST NuclMask(size_t n) {
+        return n >= STN ? ~ST(0) : (ST(1) << (n << 1)) - 1;
+    }
+
+    // Reverses the order of nucleotides inside the element
+    static ST ReverseNucls(ST w) {
+        w = ((w >> 2) & 0x3333333333333333ULL) | ((w & 0x3333333333333333ULL) << 2);
+        w = ((w >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((w & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        return __builtin_bswap64(w);
+    }
+
+    // Nucleotides [pos, pos + STN) of the underlying buffer (not the view!)
+    // packed into a single element. Never reads past the end of the view.
+    ST RawWord(size_t pos) const {
+        static_assert(sizeof(ST) == 8, "Packed nucleotide helpers assume 64-bit elements");
+        const ST *bytes = data_->data();
+        size_t idx = pos >> STNBits, shift = (pos & (STN - 1)) << 1;
+        ST w = bytes[idx] >> shift;
+        if (shift && idx < ((from_ + size_ - 1) >> STNBits))
+            w |= bytes[idx + 1] << (STBits - shift);
+        return w;
+    }
+
+    // Nucleotides [pos, pos + n) of the sequence, where n = min(STN, size() - pos),
+    // with nucleotide pos in the lowest bits. Bits above 2 * n are unspecified.
+    ST Word(size_t pos) const {
+        VERIFY_DEV(pos < size_);
+        if (!rtl_)
+            return RawWord(from_ + pos);
+
+        size_t n = std::min(STN, size_ - pos);
+        ST w = ReverseNucls(RawWord(from_ + size_ - pos - n));
+        return ~(w >> (STBits - (n << 1)));
+    }
+
+    // ORs the nucleotides of the sequence into zero-initialized packed buffer
+    // dst starting from nucleotide position dst_pos
+    void CopyTo(ST *dst, size_t dst_pos) const {
+        for (size_t i = 0; i < size_; i += STN) {
+            size_t n = std::min(STN, size_ - i);
+            ST w = Word(i) & NuclMask(n);
+            size_t p = dst_pos + i, idx = p >> STNBits, shift = (p & (STN - 1)) << 1;
+            dst[idx] |= w << shift;
+            if (shift && shift + (n << 1) > STBits)
+                dst[idx + 1] |= w >> (STBits - shift);
+        }
+    }
+
+    // Decodes n lowest nucleotides of the element into ACGT symbols
+    static void DecodeWord(ST w, size_t n, char *out) {
+        size_t j = 0;
+        for (; j + 4 <= n; j += 4, w >>= 8)
+            memcpy(out + j, seq::impl::NUCL_DECODE.nucls[w & 0xFF], 4);
+        for (; j < n; ++j, w >>= 2)
+            out[j] = nucl2(char(w & 3));
+    }
+
     inline bool ReadHeader(std::istream &file);
     inline bool WriteHeader(std::ostream &file) const;
 
@@ -134,6 +211,26 @@ class Sequence {
     Sequence(const Sequence &seq, size_t from, size_t size, bool rtl)
             : size_(size), from_(from), rtl_(rtl), data_(seq.data_) {}
 
+    // Takes a copy of already packed nucleotides
+    Sequence(size_t size, const ST *bytes)
+            : size_(size), from_(0), rtl_(false), data_(ManagedNuclBuffer::create(size)) {
+        std::copy(bytes, bytes + DataSize(size), data_->data());
+    }
+
+    // Zero-initialized sequence of given size ready to be filled via CopyTo()
+    static Sequence Zeroed(size_t size) {
+        Sequence res(size, 0);
+        std::fill(res.data_->data(), res.data_->data() + DataSize(size), ST(0));
+        return res;
+    }
+
+    // Sequence packed from scratch: from_ == 0, !rtl_ and the buffer holds nothing beyond the view
+    Sequence Packed() const {
+        Sequence res = Zeroed(size_);
+        CopyTo(res.data_->data(), 0);
+        return res;
+    }
+
 public:
     /**
      * Sequence initialization (arbitrary size string)
@@ -215,10 +312,9 @@ public:
         if (data_ == that.data_ && from_ == that.from_ && rtl_ == that.rtl_)
             return true;
 
-        for (size_t i = 0; i < size_; ++i) {
-            if (this->operator[](i) != that[i]) {
+        for (size_t i = 0; i < size_; i += STN) {
+            if ((Word(i) ^ that.Word(i)) & NuclMask(size_ - i))
                 return false;
-            }
         }
         return true;
     }
@@ -227,14 +323,15 @@ public:
         return !(operator==(that));
     }
 
-    /**
-     * @todo Might be optimized via int comparison (not so easy)
-     */
     bool operator<(const Sequence &that) const {
         size_t s = std::min(size_, that.size_);
-        for (size_t i = 0; i < s; ++i) {
-            if (this->operator[](i) != that[i]) {
-                return (this->operator[](i) < that[i]);
+        for (size_t i = 0; i < s; i += STN) {
+            ST lhs = Word(i), rhs = that.Word(i);
+            ST diff = (lhs ^ rhs) & NuclMask(s - i);
+            if (diff) {
+                // First mismatching nucleotide is the lowest one
+                unsigned shift = __builtin_ctzll(diff) & ~1u;
+                return ((lhs >> shift) & 3) < ((rhs >> shift) & 3);
             }
         }
         return (size_ < that.size_);
@@ -377,39 +474,42 @@ Sequence Sequence::Last(size_t count) const {
 }
 
 /**
- * @todo : must be KMP or hashing instead of this
+ * Bit-parallel search: every offset is checked against the first STN
+ * nucleotides of t in a single comparison, the rest is verified word-wise.
  */
 size_t Sequence::find(const Sequence &t, size_t from) const {
-    for (size_t i = from; i <= size() - t.size(); i++) {
-        if (Subseq(i, i + t.size()) == t) {
+    size_t m = t.size();
+    if (m > size_)
+        return -1ULL;
+    if (m == 0)
+        return from <= size_ ? from : -1ULL;
+
+    size_t head = std::min(STN, m);
+    ST mask = NuclMask(head), pattern = t.Word(0) & mask;
+    for (size_t i = from; i + m <= size_; ++i) {
+        if ((Word(i) ^ pattern) & mask)
+            continue;
+
+        bool match = true;
+        for (size_t j = head; match && j < m; j += STN)
+            match = ((Word(i + j) ^ t.Word(j)) & NuclMask(m - j)) == 0;
+        if (match)
             return i;
-        }
     }
     return -1ULL;
 }
 
-/**
- * @todo optimize
- */
 Sequence Sequence::operator+(const Sequence &s) const {
-    return Sequence(str() + s.str());
-    // TODO might be opposite to correct
-    //    int total = size_ + s.size_;
-    //    std::vector<Seq<4> > bytes((total + 3) >> 2);
-    //    for (size_t i = 0; i < size_; ++i) {
-    //        bytes[i / 4] = (bytes[i / 4] << operator [](i)); // TODO :-) use <<=
-    //    }
-    //    for (size_t i = 0, j = size_; i < s.size_; ++i, ++j) {
-    //        bytes[j / 4] = (bytes[j / 4]) << s[i];
-    //    }
-    //    return Sequence(new Data(bytes), 0, total, false);
+    Sequence res = Zeroed(size_ + s.size_);
+    CopyTo(res.data_->data(), 0);
+    s.CopyTo(res.data_->data(), size_);
+    return res;
 }
 
 std::string Sequence::str() const {
     std::string res(size_, '-');
-    for (size_t i = 0; i < size_; ++i) {
-        res[i] = nucl2(this->operator[](i));
-    }
+    for (size_t i = 0; i < size_; i += STN)
+        DecodeWord(Word(i), std::min(STN, size_ - i), &res[i]);
     return res;
 }
 
@@ -460,10 +560,8 @@ bool Sequence::BinRead(std::istream &file) {
 
 
 bool Sequence::BinWrite(std::ostream &file) const {
-    if (from_ != 0 || rtl_) {
-        Sequence clear(this->str());
-        return clear.BinWrite(file);
-    }
+    if (from_ != 0 || rtl_)
+        return Packed().BinWrite(file);
 
     WriteHeader(file);
 
@@ -477,46 +575,66 @@ bool Sequence::BinWrite(std::ostream &file) const {
  * @section DESCRIPTION
  *
  * Class was created for build sequence. It is included method: size(), append()
+ * Nucleotides are kept packed in the same way as in Sequence, so appending
+ * a Sequence is done word-wise and BuildSequence() does not need to re-encode.
  */
 
 class SequenceBuilder {
-    std::vector<char> buf_;
+    typedef Sequence::ST ST;
+
+    std::vector<ST> buf_;
+    size_t size_ = 0;
+
+    void Grow(size_t size) {
+        buf_.resize(Sequence::DataSize(size), ST(0));
+    }
 public:
+    SequenceBuilder &append(const Sequence &s) {
+        Grow(size_ + s.size());
+        s.CopyTo(buf_.data(), size_);
+        size_ += s.size();
+        return *this;
+    }
+
     template<typename S>
     SequenceBuilder &append(const S &s) {
-        for (size_t i = 0; i < s.size(); ++i) {
-            buf_.push_back(s[i]);
+        Grow(size_ + s.size());
+        for (size_t i = 0; i < s.size(); ++i, ++size_) {
+            buf_[size_ >> Sequence::STNBits] |= ST(s[i]) << ((size_ & (Sequence::STN - 1)) << 1);
         }
         return *this;
     }
 
     SequenceBuilder &append(char c) {
-        buf_.push_back(c);
+        VERIFY_DEV(is_dignucl(c));
+        Grow(size_ + 1);
+        buf_[size_ >> Sequence::STNBits] |= ST(c) << ((size_ & (Sequence::STN - 1)) << 1);
+        size_ += 1;
         return *this;
     }
 
     Sequence BuildSequence() {
-        return Sequence(buf_);
+        return Sequence(size_, buf_.data());
     }
 
     size_t size() const {
-        return buf_.size();
+        return size_;
     }
 
     void clear() {
-        return buf_.clear();
+        buf_.clear();
+        size_ = 0;
     }
 
     char operator[](const size_t index) const {
-        VERIFY_DEV(index < buf_.size());
-        return buf_[index];
+        VERIFY_DEV(index < size_);
+        return (buf_[index >> Sequence::STNBits] >> ((index & (Sequence::STN - 1)) << 1)) & 3;
     }
 
     std::string str() const {
-        std::string s(buf_.size(), '-');
-        for (size_t i = 0; i < s.size(); ++i) {
-            s[i] = nucl(buf_[i]);
-        }
+        std::string s(size_, '-');
+        for (size_t i = 0; i < size_; i += Sequence::STN)
+            Sequence::DecodeWord(buf_[i >> Sequence::STNBits], std::min(Sequence::STN, size_ - i), &s[i]);
         return s;
     }
 };
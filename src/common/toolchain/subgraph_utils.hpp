@@ -18,7 +18,8 @@ namespace toolchain {
 class ComponentExpander {
     const debruijn_graph::Graph &g_;
 
-    bool IsInnerVertex(debruijn_graph::VertexId v, const std::set<debruijn_graph::EdgeId> &edges) const {
+    bool IsInnerVertex(debruijn_graph::VertexId v,
+                       const omnigraph::GraphComponent<debruijn_graph::Graph>::EdgeSet &edges) const {
         auto in_f = [&edges](debruijn_graph::EdgeId e) {
             return edges.count(e);
         };
@@ -31,7 +32,7 @@ public:
 
     omnigraph::GraphComponent<debruijn_graph::Graph> Expand(const omnigraph::GraphComponent<debruijn_graph::Graph> &component) const {
         INFO("Expanding component to include incident edges of all 'inner' vertices");
-        std::set<debruijn_graph::EdgeId> expanded_edges(component.edges());
+        std::set<debruijn_graph::EdgeId> expanded_edges(component.edges().begin(), component.edges().end());
         for (debruijn_graph::VertexId v : component.vertices()) {
             if (IsInnerVertex(v, component.edges())) {
                 utils::insert_all(expanded_edges, g_.IncidentEdges(v));
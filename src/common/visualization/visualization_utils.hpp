@@ -48,7 +48,7 @@ void DrawComponentsOfShortEdges(const Graph &g, const std::filesystem::path &out
             output_dir / (std::to_string(min_length) + "_" + std::to_string(sinks) + "_" + std::to_string(sources) + "_" + "pics_polymorphic/");
     create_directory(pics_folder_);
     INFO("Writing pics with components consisting of short edges to " + static_cast<std::string>(pics_folder_));
-    auto splitter = LongEdgesExclusiveSplitter<Graph>(g, min_length);
+    auto splitter = ParallelLongEdgesExclusiveSplitter<Graph>(g, min_length);
     while (splitter->HasNext()) {
         GraphComponent<Graph> component = splitter->Next();
         if (component.v_size() > 3 && component.exits().size() == sinks &&
@@ -238,9 +238,10 @@ void ParallelExtractCDSSubgraphs(const graph_pack::GraphPack &gp,
         INFO("'Closing' gathered component");
         toolchain::ComponentExpander expander(graph);
         gc = expander.Expand(gc);
-        flattened_relevant_edges[i] = subgraph_extractor.ProcessPartialCDS(flattened_part_genes[i],
-                                                                            utils::get(cds_len_ests, flattened_ids[i]),
-                                                                            &flattened_stop_poss[i]).edges();
+        utils::insert_all(flattened_relevant_edges[i],
+                          subgraph_extractor.ProcessPartialCDS(flattened_part_genes[i],
+                                                               utils::get(cds_len_ests, flattened_ids[i]),
+                                                               &flattened_stop_poss[i]).edges());
     }
     INFO("Done searching subgraphs");
 
@@ -12,24 +12,72 @@
 #include "kmer_stat.hpp"
 #include "valid_kmer_generator.hpp"
 
+#include "utils/parallel/openmp_wrapper.h"
+
+#include <algorithm>
+#include <array>
 #include <string>
 #include <vector>
-#include <queue>
 
 using namespace hammer;
 
 using positions_t = std::array<uint16_t, 4>;
 
+namespace {
+
+// Correction is kept as a chain of substitutions in the per-read edit arena
+const uint32_t NO_EDIT = -1U;
+
+struct edit {
+    uint32_t pos; char nucl; uint32_t prev;
+};
+
 struct state {
-    state(size_t p, std::string s, double pen, KMer l, positions_t c)
-            : pos(p), str(s), penalty(pen), last(l), cpos(c) {}
+    size_t pos; double penalty; KMer last; positions_t cpos; uint32_t edits;
+};
 
-    size_t pos; std::string str; double penalty; KMer last; positions_t cpos;
+// Same order the former std::priority_queue used: the best (the least penalized) state on top
+struct state_less {
+    bool operator()(const state &lhs, const state &rhs) const {
+        return lhs.penalty < rhs.penalty ||
+               (lhs.penalty == rhs.penalty && lhs.pos < rhs.pos);
+    }
+};
+
+// Read as seen by the search: either the read itself or its reverse complement
+class strand_view {
+    const std::string &seq_;
+    const std::string &qual_;
+    bool rc_;
+
+    size_t idx(size_t pos) const {
+        return rc_ ? seq_.size() - 1 - pos : pos;
+    }
+
+  public:
+    strand_view(const std::string &seq, const std::string &qual, bool rc)
+            : seq_(seq), qual_(qual), rc_(rc) {}
+
+    char nucl(size_t pos) const {
+        return rc_ ? nucl_complement(seq_[idx(pos)]) : seq_[idx(pos)];
+    }
+
+    char qual(size_t pos) const {
+        return qual_[idx(pos)];
+    }
+
+    // k-mer ending at pos, all its nucleotides should be valid
+    KMer kmer(size_t pos) const {
+        return rc_ ? !KMer(seq_, idx(pos), K, /* raw */ true)
+                   : KMer(seq_, pos - K + 1, K, /* raw */ true);
+    }
+
+    void apply(std::string &seq, const std::vector<edit> &edits, uint32_t e) const {
+        for (; e != NO_EDIT; e = edits[e].prev)
+            seq[idx(edits[e].pos)] = rc_ ? nucl_complement(edits[e].nucl) : edits[e].nucl;
+    }
 };
 
-std::ostream& operator<<(std::ostream &os, const state &state) {
-    os << "[pos: " << state.pos << ", last: " << state.last << " penalty: " << state.penalty << "]";
-    return os;
 }
 
 std::ostream& operator<<(std::ostream &os, const positions_t &pos) {
@@ -37,53 +85,90 @@ std::ostream& operator<<(std::ostream &os, const positions_t &pos) {
     return os;
 }
 
-namespace std {
-template<>
-struct less<state> {
-    bool operator()(const state &lhs, const state &rhs) const {
-        return lhs.penalty < rhs.penalty ||
-               (lhs.penalty == rhs.penalty && lhs.pos < rhs.pos);
+struct ReadCorrector::Workspace {
+    // Best-first beam, a binary heap. Its size is bounded by the size threshold plus one step worth of candidates
+    std::vector<state> corrections;
+    // Candidates produced from the single state: an extension and up to 4 substitutions, never all at once
+    std::array<state, 4> candidates;
+    size_t ncandidates = 0;
+    std::vector<edit> edits;
+
+    void push(const state &s) {
+        corrections.push_back(s);
+        std::push_heap(corrections.begin(), corrections.end(), state_less());
+    }
+
+    state pop() {
+        std::pop_heap(corrections.begin(), corrections.end(), state_less());
+        state s = corrections.back();
+        corrections.pop_back();
+        return s;
+    }
+
+    void add_candidate(const state &s) {
+        candidates[ncandidates++] = s;
+        std::push_heap(candidates.begin(), candidates.begin() + ncandidates, state_less());
     }
-};
-};
 
-static void FlushCandidates(std::priority_queue<state>& corrections, std::priority_queue<state> &candidates,
-                            size_t size_limit) {
-    if (candidates.empty())
-        return;
-
-    if (corrections.size() > size_limit) {
-        corrections.emplace(candidates.top());
-    } else {
-        while (!candidates.empty()) {
-            corrections.emplace(candidates.top());
-            candidates.pop();
+    void flush_candidates(size_t size_limit) {
+        if (!ncandidates)
+            return;
+
+        if (corrections.size() > size_limit) {
+            push(candidates.front());
+        } else {
+            for (; ncandidates; --ncandidates) {
+                std::pop_heap(candidates.begin(), candidates.begin() + ncandidates, state_less());
+                push(candidates[ncandidates - 1]);
+            }
         }
+
+        ncandidates = 0;
     }
 
-    std::priority_queue<state>().swap(candidates);
+    uint32_t add_edit(size_t pos, char nucl, uint32_t prev) {
+        edits.push_back({ (uint32_t)pos, nucl, prev });
+        return (uint32_t)(edits.size() - 1);
+    }
+};
+
+ReadCorrector::ReadCorrector(const KMerData& data, bool correct_stats, unsigned nthreads)
+        : data_(data),
+          changed_reads_(0), changed_nucleotides_(0), uncorrected_nucleotides_(0), total_nucleotides_(0),
+          correct_stats_(correct_stats) {
+    for (unsigned i = 0; i < std::max(nthreads, 1u); ++i)
+        workspaces_.emplace_back(new Workspace());
 }
 
-std::string ReadCorrector::CorrectReadRight(const std::string &seq, const std::string &qual,
-                                            size_t right_pos) {
+ReadCorrector::~ReadCorrector() = default;
+
+void ReadCorrector::CorrectReadRight(std::string &seq, const std::string &qual,
+                                     size_t right_pos, bool rc, Workspace &ws) {
     const size_t read_size = seq.size();
-    std::priority_queue<state> corrections, candidates;
+    strand_view read(seq, qual, rc);
     positions_t cpos{{(uint16_t)-1, (uint16_t)-1U, (uint16_t)-1U, (uint16_t)-1U}};
 
     const size_t size_thr = size_t(100 * log2(read_size - right_pos)) + 1;
     const double penalty_thr = -(double)(read_size - right_pos) * 15.0 / 100;
     const size_t pos_thr = 8;
 
-    corrections.emplace(right_pos, seq,
-                        0.0, KMer(seq, right_pos - K + 1, K, /* raw */ true),
-                        cpos);
-    while (!corrections.empty()) {
-        state correction = corrections.top(); corrections.pop();
+    ws.corrections.clear();
+    ws.corrections.reserve(size_thr + ws.candidates.size() + 1);
+    ws.ncandidates = 0;
+    ws.edits.clear();
+
+    ws.push({ right_pos, 0.0, read.kmer(right_pos), cpos, NO_EDIT });
+    while (!ws.corrections.empty()) {
+        state correction = ws.pop();
         size_t pos = correction.pos + 1;
-        if (pos == read_size)
-            return correction.str;
+        if (pos == read_size) {
+            read.apply(seq, ws.edits, correction.edits);
+            return;
+        }
 
-        char c = correction.str[pos];
+        // Corrections are made only at the positions already passed
+        char c = read.nucl(pos);
+        char q = read.qual(pos);
 
         // See, whether it's enough to perform single nucl extension
         bool extended = false;
@@ -92,36 +177,36 @@ std::string ReadCorrector::CorrectReadRight(const std::string &seq, const std::s
             size_t idx = data_.checking_seq_idx(last);
             if (idx != -1ULL) {
                 const KMerStat &kmer_data = data_[idx];
-                candidates.emplace(pos, correction.str,
+                ws.add_candidate({ pos,
                                    correction.penalty - (kmer_data.good() ?
                                                          0.0 :
-                                                         (qual[pos] >= 20 ? 1.0 : 2.0)),
-                                    last, cpos);
-                if (kmer_data.good() && qual[pos] >= 20)
+                                                         (q >= 20 ? 1.0 : 2.0)),
+                                   last, cpos, correction.edits });
+                if (kmer_data.good() && q >= 20)
                     extended = true;
             } else {
-                candidates.emplace(pos, correction.str,
-                                   correction.penalty - (qual[pos] >= 20 ? 2.0 : 3.0),
-                                   last, cpos);
+                ws.add_candidate({ pos,
+                                   correction.penalty - (q >= 20 ? 2.0 : 3.0),
+                                   last, cpos, correction.edits });
             }
         }
 
         // Ok, it's possible to extend using solely solid k-mer, do not try any other corrections.
         if (extended) {
-            FlushCandidates(corrections, candidates, size_thr);
+            ws.flush_candidates(size_thr);
             continue;
         }
 
         // Do not allow too many corrections
         if (correction.penalty < penalty_thr) {
-            FlushCandidates(corrections, candidates, size_thr);
+            ws.flush_candidates(size_thr);
             continue;
         }
 
         // Do not allow clustered corrections
         if (pos - correction.cpos.front() < pos_thr) {
             // INFO("Cluster " << pos << "," << correction.cpos);
-            FlushCandidates(corrections, candidates, size_thr);
+            ws.flush_candidates(size_thr);
             continue;
         }
 
@@ -141,21 +226,18 @@ std::string ReadCorrector::CorrectReadRight(const std::string &seq, const std::s
 
             const KMerStat &kmer_data = data_[idx];
             if (kmer_data.good()) {
-                std::string corrected = correction.str; corrected[pos] = ncc;
                 double penalty = correction.penalty - (is_nucl(c) ?
-                                                       (qual[pos] >= 20 ? 5.0 : 1.0) :
+                                                       (q >= 20 ? 5.0 : 1.0) :
                                                        0.0);
-                candidates.emplace(pos, corrected, penalty, last, cpos);
+                ws.add_candidate({ pos, penalty, last, cpos, ws.add_edit(pos, ncc, correction.edits) });
             }
         }
 
-        FlushCandidates(corrections, candidates, size_thr);
+        ws.flush_candidates(size_thr);
     }
 
 #   pragma omp atomic
     uncorrected_nucleotides_ += read_size - right_pos;
-
-    return seq;
 }
 
 bool ReadCorrector::CorrectOneRead(Read & r,
@@ -204,9 +286,13 @@ bool ReadCorrector::CorrectOneRead(Read & r,
         //std::string seq2 = seq;
         //INFO(seq2.insert(lleft_pos, "[").insert(lright_pos + 2, "]"));
 
-        std::string newseq = CorrectReadRight(seq, qual, lright_pos);
-        newseq = ReverseComplement(CorrectReadRight(ReverseComplement(newseq), Reverse(qual),
-                                                    read_size - 1 - lleft_pos));
+        size_t thread = omp_get_thread_num();
+        VERIFY(thread < workspaces_.size());
+        Workspace &ws = *workspaces_[thread];
+
+        std::string newseq = seq;
+        CorrectReadRight(newseq, qual, lright_pos, /* rc */ false, ws);
+        CorrectReadRight(newseq, qual, read_size - 1 - lleft_pos, /* rc */ true, ws);
 
         unsigned corrected = 0;
         for (size_t i = 0; i < read_size; ++i)
@@ -15,21 +15,24 @@ class Read;
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <cstddef>
 
 class ReadCorrector {
+  struct Workspace;
+
   const KMerData &data_;
   size_t changed_reads_;
   size_t changed_nucleotides_;
   size_t uncorrected_nucleotides_;
   size_t total_nucleotides_;
   bool   correct_stats_;
+  // Per-thread search buffers, reused between the reads
+  std::vector<std::unique_ptr<Workspace>> workspaces_;
 
  public:
-    ReadCorrector(const KMerData& data, bool correct_stats = false)
-            : data_(data),
-              changed_reads_(0), changed_nucleotides_(0), uncorrected_nucleotides_(0), total_nucleotides_(0),
-              correct_stats_(correct_stats) {}
+  ReadCorrector(const KMerData& data, bool correct_stats = false, unsigned nthreads = 1);
+  ~ReadCorrector();
 
   size_t changed_reads() const {
     return changed_reads_;
@@ -51,8 +54,10 @@ class ReadCorrector {
                       bool correct_threshold, bool discard_singletons, bool discard_bad);
 
   private:
-    std::string CorrectReadRight(const std::string &seq, const std::string &qual,
-                                 size_t right_pos);
+    // Corrects seq to the right of right_pos (to the left of read_size - 1 - right_pos
+    // when rc is set, the search then runs over the reverse complement of seq) in place.
+    void CorrectReadRight(std::string &seq, const std::string &qual,
+                          size_t right_pos, bool rc, Workspace &ws);
 };
 
 #endif
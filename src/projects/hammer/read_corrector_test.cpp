@@ -0,0 +1,302 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#include "read_corrector.hpp"
+
+#include "globals.hpp"
+#include "kmer_data.hpp"
+#include "valid_kmer_generator.hpp"
+
+#include "kmer_index/kmer_mph/kmer_index_builder.hpp"
+#include "kmer_index/kmer_mph/kmer_splitter.hpp"
+#include "utils/filesystem/temporary.hpp"
+#include "utils/logger/log_writers.hpp"
+#include "utils/logger/logger.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <map>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+std::vector<uint32_t> * Globals::subKMerPositions = NULL;
+KMerData *Globals::kmer_data = NULL;
+int Globals::iteration_no = 0;
+
+char Globals::char_offset = 0;
+bool Globals::char_offset_user = true;
+
+double Globals::quality_probs[256] = { 0 };
+double Globals::quality_lprobs[256] = { 0 };
+double Globals::quality_rprobs[256] = { 0 };
+double Globals::quality_lrprobs[256] = { 0 };
+
+using namespace hammer;
+
+namespace {
+
+class VectorKMerSplitter : public kmers::KMerSortingSplitter<KMer> {
+    std::vector<KMer> kmers_;
+
+  public:
+    VectorKMerSplitter(const std::filesystem::path &work_dir, std::vector<KMer> kmers)
+            : KMerSortingSplitter<KMer>(work_dir, hammer::K), kmers_(std::move(kmers)) {}
+
+    RawKMers Split(size_t num_files, unsigned) override {
+        auto out = PrepareBuffers(num_files, 1, 1 << 20);
+        for (const KMer &kmer : kmers_) {
+            if (push_back_internal(kmer, 0))
+                DumpBuffers(out);
+        }
+        DumpBuffers(out);
+        ClearBuffers();
+
+        return out;
+    }
+};
+
+// Loads the k-mers into data the same way the stored k-mer data is read back
+void FillKMerData(KMerData &data, const std::map<KMer, bool, KMer::less2> &kmers,
+                  const std::filesystem::path &work_dir) {
+    std::vector<KMer> keys;
+    for (const auto &entry : kmers)
+        keys.push_back(entry.first);
+
+    HammerKMerIndex index;
+    auto storage = kmers::KMerDiskCounter<KMer>(work_dir, VectorKMerSplitter(work_dir, keys)).Count(4, 1);
+    kmers::KMerIndexBuilder<HammerKMerIndex>(1).BuildIndex(index, storage);
+
+    size_t sz = keys.size();
+    std::vector<KMerStat> stats(sz);
+    std::vector<KMer::DataType> raw(sz * KMer::GetDataSize(K));
+    for (const auto &entry : kmers) {
+        size_t idx = index.seq_idx(entry.first);
+        ASSERT_LT(idx, sz);
+        if (entry.second)
+            stats[idx].mark_good();
+        std::copy(entry.first.data(), entry.first.data() + KMer::GetDataSize(K),
+                  raw.begin() + idx * KMer::GetDataSize(K));
+    }
+
+    std::stringstream ss;
+    ss.write((char*)&sz, sizeof(sz));
+    ss.write((char*)stats.data(), sz * sizeof(stats[0]));
+    size_t empty = 0;
+    ss.write((char*)&empty, sizeof(empty));
+    index.serialize(ss);
+    ss.write((char*)&sz, sizeof(sz));
+    ss.write((char*)raw.data(), raw.size() * sizeof(raw[0]));
+    data.binary_read(ss, "");
+}
+
+// Reference: the correction search as it was done with the full read copies in every state
+struct reference_state {
+    reference_state(size_t p, std::string s, double pen, KMer l, std::array<uint16_t, 4> c)
+            : pos(p), str(s), penalty(pen), last(l), cpos(c) {}
+
+    size_t pos; std::string str; double penalty; KMer last; std::array<uint16_t, 4> cpos;
+
+    bool operator<(const reference_state &rhs) const {
+        return penalty < rhs.penalty ||
+               (penalty == rhs.penalty && pos < rhs.pos);
+    }
+};
+
+typedef std::priority_queue<reference_state> reference_queue;
+
+void FlushCandidates(reference_queue &corrections, reference_queue &candidates, size_t size_limit) {
+    if (candidates.empty())
+        return;
+
+    if (corrections.size() > size_limit) {
+        corrections.emplace(candidates.top());
+    } else {
+        while (!candidates.empty()) {
+            corrections.emplace(candidates.top());
+            candidates.pop();
+        }
+    }
+
+    reference_queue().swap(candidates);
+}
+
+std::string ReferenceCorrectRight(const KMerData &data, const std::string &seq, const std::string &qual,
+                                  size_t right_pos) {
+    const size_t read_size = seq.size();
+    reference_queue corrections, candidates;
+    std::array<uint16_t, 4> cpos{{(uint16_t)-1, (uint16_t)-1U, (uint16_t)-1U, (uint16_t)-1U}};
+
+    const size_t size_thr = size_t(100 * log2(read_size - right_pos)) + 1;
+    const double penalty_thr = -(double)(read_size - right_pos) * 15.0 / 100;
+    const size_t pos_thr = 8;
+
+    corrections.emplace(right_pos, seq, 0.0, KMer(seq, right_pos - K + 1, K, /* raw */ true), cpos);
+    while (!corrections.empty()) {
+        reference_state correction = corrections.top(); corrections.pop();
+        size_t pos = correction.pos + 1;
+        if (pos == read_size)
+            return correction.str;
+
+        char c = correction.str[pos];
+
+        bool extended = false;
+        if (is_nucl(c)) {
+            KMer last = correction.last << dignucl(c);
+            size_t idx = data.checking_seq_idx(last);
+            if (idx != -1ULL) {
+                const KMerStat &kmer_data = data[idx];
+                candidates.emplace(pos, correction.str,
+                                   correction.penalty - (kmer_data.good() ? 0.0 : (qual[pos] >= 20 ? 1.0 : 2.0)),
+                                   last, cpos);
+                if (kmer_data.good() && qual[pos] >= 20)
+                    extended = true;
+            } else {
+                candidates.emplace(pos, correction.str,
+                                   correction.penalty - (qual[pos] >= 20 ? 2.0 : 3.0),
+                                   last, cpos);
+            }
+        }
+
+        if (extended || correction.penalty < penalty_thr || pos - correction.cpos.front() < pos_thr) {
+            FlushCandidates(corrections, candidates, size_thr);
+            continue;
+        }
+
+        std::array<uint16_t, 4> cpos = correction.cpos;
+        std::copy(cpos.begin() + 1, cpos.end(), cpos.begin());
+        cpos.back() = (uint16_t)pos;
+        for (char cc = 0; cc < 4; ++cc) {
+            char ncc = nucl(cc);
+            if (c == ncc)
+                continue;
+
+            KMer last = correction.last << cc;
+            size_t idx = data.checking_seq_idx(last);
+            if (idx == -1ULL || !data[idx].good())
+                continue;
+
+            std::string corrected = correction.str; corrected[pos] = ncc;
+            double penalty = correction.penalty - (is_nucl(c) ? (qual[pos] >= 20 ? 5.0 : 1.0) : 0.0);
+            candidates.emplace(pos, corrected, penalty, last, cpos);
+        }
+
+        FlushCandidates(corrections, candidates, size_thr);
+    }
+
+    return seq;
+}
+
+std::string ReferenceCorrect(const KMerData &data, const std::string &seq, const std::string &qual) {
+    size_t read_size = seq.size();
+    size_t lleft_pos = -1ULL, lright_pos = -1ULL, solid_len = 0;
+
+    ValidKMerGenerator<K> gen(seq.data(), qual.data(), read_size);
+    size_t left_pos = 0, right_pos = 0;
+    for (; gen.HasMore(); gen.Next()) {
+        size_t read_pos = gen.pos() - 1;
+        size_t idx = data.checking_seq_idx(gen.kmer());
+        if (idx == -1ULL || !data[idx].good())
+            continue;
+
+        if (read_pos != right_pos - K + 2) {
+            left_pos = read_pos;
+            right_pos = left_pos + K - 1;
+        } else
+            right_pos += 1;
+
+        if (right_pos - left_pos + 1 > solid_len) {
+            lleft_pos = left_pos;
+            lright_pos = right_pos;
+            solid_len = right_pos - left_pos + 1;
+        }
+    }
+
+    if (!solid_len || solid_len == read_size)
+        return seq;
+
+    std::string newseq = ReferenceCorrectRight(data, seq, qual, lright_pos);
+    return ReverseComplement(ReferenceCorrectRight(data, ReverseComplement(newseq), Reverse(qual),
+                                                   read_size - 1 - lleft_pos));
+}
+
+}
+
+TEST(ReadCorrector, SameAsFullCopySearch) {
+    const char *nucls = "ACGT";
+    std::mt19937 rand(42);
+    std::string genome;
+    for (size_t i = 0; i < 5000; ++i)
+        genome += nucls[rand() % 4];
+
+    // Genome k-mers are solid, some of the erroneous ones are present, but not solid
+    std::map<KMer, bool, KMer::less2> kmers;
+    auto add_kmers = [&](const std::string &s, bool good) {
+        for (ValidKMerGenerator<K> gen(s.data(), nullptr, s.size()); gen.HasMore(); gen.Next()) {
+            kmers.emplace(gen.kmer(), good);
+            kmers.emplace(!gen.kmer(), good);
+        }
+    };
+    add_kmers(genome, true);
+
+    std::vector<Read> reads;
+    const size_t read_len = 100;
+    for (size_t i = 0; i < 3000; ++i) {
+        size_t start = rand() % (genome.size() - read_len);
+        std::string seq = genome.substr(start, read_len), qual(read_len, 0);
+        if (rand() % 2)
+            seq = ReverseComplement(seq);
+        for (char &q : qual)
+            q = char(rand() % 5 ? 20 + rand() % 21 : 2 + rand() % 18);
+
+        // Isolated errors and bursts of low quality ones, the latter run into the clustered corrections limit
+        size_t pos = rand() % read_len;
+        bool burst = rand() % 3 == 0;
+        for (size_t errors = burst ? 4 + rand() % 3 : rand() % 4; errors > 0; --errors) {
+            seq[pos] = rand() % 20 ? nucls[(dignucl(seq[pos]) + 1 + rand() % 3) % 4] : 'N';
+            if (burst)
+                qual[pos] = char(2 + rand() % 18);
+            pos = (burst ? pos + 1 + rand() % 3 : rand()) % read_len;
+        }
+        if (rand() % 4 == 0)
+            add_kmers(seq, false);
+
+        reads.emplace_back("read" + std::to_string(i), seq, qual);
+    }
+
+    KMerData data;
+    auto work_dir = fs::tmp::make_temp_dir(std::filesystem::temp_directory_path(), "hammer_test");
+    FillKMerData(data, kmers, work_dir->dir());
+    ASSERT_EQ(kmers.size(), data.size());
+
+    ReadCorrector corrector(data);
+    size_t changed = 0;
+    for (Read &r : reads) {
+        std::string expected = ReferenceCorrect(data, r.getSequenceString(), r.getQualityString());
+        changed += expected != r.getSequenceString();
+        corrector.CorrectOneRead(r, false, false, false);
+        EXPECT_EQ(expected, r.getSequenceString()) << r.getName();
+    }
+    EXPECT_GT(changed, reads.size() / 4);
+}
+
+void create_console_logger() {
+    using namespace logging;
+
+    logger *lg = create_logger("");
+    lg->add_writer(std::make_shared<console_writer>());
+    attach_logger(lg);
+}
+
+GTEST_API_ int main(int argc, char **argv) {
+    create_console_logger();
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -44,6 +44,16 @@ inline HKMerDistanceResult hkmerDistance(const HKMer& left,
   return dist;
 }
 
+// Nucleotides of the runs packed into a word: hkmerDistance is finite
+// iff the keys of the hk-mers are equal
+inline uint32_t hkmerNuclKey(const HKMer& kmer) {
+  static_assert(K <= 16, "Key does not fit into 32 bits");
+  uint32_t key = 0;
+  for (uint32_t i = 0; i < K; ++i) {
+    key = (key << 2) | kmer[i].nucl;
+  }
+  return key;
+}
 
 
 };  // namespace hammer
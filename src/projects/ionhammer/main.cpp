@@ -34,8 +34,10 @@
 #include "quality_metrics.h"
 #include "version.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
+#include <numeric>
 
 #include <bamtools/api/BamReader.h>
 #include <bamtools/api/SamHeader.h>
@@ -157,9 +159,24 @@ class TKMerDataEstimator {
     INFO("Subclustering.");
     TGenomicHKMersEstimator genomicHKMersEstimator(Data, ClusterModel, cfg::get().center_type);
 
-#pragma omp parallel for num_threads(num_threads)
-    for (size_t i = 0; i < Classes.size(); ++i) {
-      auto& cluster = Classes[i];
+    // Largest clusters go first, so they do not set the wall-clock time at the end.
+    // Oversized ones are processed one by one with all the threads working on the cluster
+    std::vector<size_t> order(Classes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+      return Classes[lhs].size() > Classes[rhs].size();
+    });
+    const size_t kOversizedCluster = 4096;
+    size_t oversized = 0;
+    while (oversized < order.size() && Classes[order[oversized]].size() >= kOversizedCluster) {
+      genomicHKMersEstimator.ProceedCluster(Classes[order[oversized]], num_threads);
+      oversized += 1;
+    }
+    INFO("Oversized clusters processed: " << oversized);
+
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+    for (size_t i = oversized; i < order.size(); ++i) {
+      auto& cluster = Classes[order[i]];
       genomicHKMersEstimator.ProceedCluster(cluster);
     }
   }
@@ -19,6 +19,7 @@
 #include <bamtools/api/BamAlignment.h>
 #include <bamtools/api/SamHeader.h>
 #include "seqeval/BaseHypothesisEvaluator.h"
+#include "utils/parallel/openmp_wrapper.h"
 
 #include <algorithm>
 #include <cassert>
@@ -53,17 +54,25 @@ class ReadCorrector {
   mutable size_t skipped_reads = 0;
   mutable size_t queue_overflow_reads = 0;
 
-  inline bool Flush(std::priority_queue<State>& candidates,
-                    std::priority_queue<State>& corrections,
+  struct Workspace {
+    std::vector<State> corrections;
+    std::vector<State> candidates;
+    CorrectionBuffers buffers;
+  };
+  // per-thread, reused between the reads
+  mutable std::vector<Workspace> workspaces_;
+
+  inline bool Flush(std::vector<State>& candidates,
+                    std::vector<State>& corrections,
                     size_t limit,
                     size_t readSize) const {
 
     if (corrections.size() > limit) {
       auto top = pop_queue(candidates);
       if (!std::isinf(top.Penalty())) {
-        corrections.emplace(std::move(top));
+        push_queue(corrections, std::move(top));
       }
-      std::priority_queue<State>().swap(candidates);
+      candidates.clear();
       return true;
     } else {
       while (!candidates.empty()) {
@@ -72,7 +81,7 @@ class ReadCorrector {
           continue;
         }
         if (!std::isinf(top.Penalty())) {
-          corrections.emplace(std::move(top));
+          push_queue(corrections, std::move(top));
         }
       }
       return false;
@@ -89,31 +98,34 @@ class ReadCorrector {
       return read;
     }
 
-    std::priority_queue<State> corrections;
-    std::priority_queue<State> candidates;
-
-    CorrectionContext context(data, read, reverse);
+    size_t thread = omp_get_thread_num();
+    VERIFY(thread < workspaces_.size());
+    Workspace& ws = workspaces_[thread];
+    auto& corrections = ws.corrections;
+    auto& candidates = ws.candidates;
+    corrections.clear();
+    candidates.clear();
+    ws.buffers.reads.Clear();
+    ws.buffers.visited.Clear();
+
+    CorrectionContext context(data, read, reverse, ws.buffers);
     {
-      corrections.emplace(StateBuilder<PenaltyCalcer>::Initial(
+      push_queue(corrections, StateBuilder<PenaltyCalcer>::Initial(
           context, penalty_calcer, (uint)offset));
     }
 
-    std::map<uint, std::set<size_t> > visited;
     const size_t queue_limit =  (const size_t)(cfg::get().queue_limit_multiplier * log2(read.size() - offset + 1));//(const size_t)(100 * read.size());
 
     bool queue_overflow = false;
 
     while (!corrections.empty()) {
 
-      auto state = std::pop_queue(corrections);
+      auto state = pop_queue(corrections);
       assert(state.Position() <= read.size());
 
-      {
-        size_t hash = state.GetHKMer().GetHash();
-        if (visited[state.Position()].count(hash) && corrections.size()) {
-          continue;
-        }
-        visited[state.Position()].insert(hash);
+      if (ws.buffers.visited.Insert(state.Position(), state.GetHKMer().GetHash()) &&
+          corrections.size()) {
+        continue;
       }
 
       if (state.Position() < read.size()) {
@@ -126,13 +138,13 @@ class ReadCorrector {
       }
 
       if (state.Position() == read.size()) {
-        return state.Read()->ToString();
+        return ws.buffers.reads.ToString(state.Read());
       }
 
       //      //don't correct last kmer
       if ((state.Position() + context.GetHRun(state.Position()).len) ==
           read.size()) {
-        auto result = state.Read()->ToString();
+        auto result = ws.buffers.reads.ToString(state.Read());
         result += (context.GetHRun(state.Position()).str());
         return result;
       }
@@ -141,7 +153,7 @@ class ReadCorrector {
         SkipMayBeBadHRun<PenaltyCalcer> skipHRun(state,
                                                  context,
                                                  penalty_calcer);
-        candidates.emplace(skipHRun.State());
+        push_queue(candidates, skipHRun.State());
       }
 
       {
@@ -166,7 +178,8 @@ class ReadCorrector {
   ReadCorrector(const KMerData& kmer_data,
                  const PenaltyCalcerFactory& factory)
       : data(kmer_data)
-      , penalty_calcer_factory(factory) {}
+      , penalty_calcer_factory(factory)
+      , workspaces_(omp_get_max_threads()) {}
 
   ~ReadCorrector() {
     INFO("Skipped reads count: " << skipped_reads);
@@ -12,8 +12,11 @@
 #ifndef PROJECT_READ_CORRECTOR_INFO_H
 #define PROJECT_READ_CORRECTOR_INFO_H
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
-#include <queue>
+#include <string>
+#include <vector>
 #include "hkmer.hpp"
 
 namespace hammer {
@@ -21,10 +24,18 @@ namespace correction {
 
 using HRun = HomopolymerRun;
 
+// Binary heaps over reusable vectors, ordered the same way std::priority_queue orders them
 template <class Moveable>
-inline Moveable pop_queue(std::priority_queue<Moveable>& queue) {
-  Moveable result(std::move(const_cast<Moveable&&>(queue.top())));
-  queue.pop();
+inline void push_queue(std::vector<Moveable>& queue, Moveable&& value) {
+  queue.push_back(std::move(value));
+  std::push_heap(queue.begin(), queue.end(), std::less<Moveable>());
+}
+
+template <class Moveable>
+inline Moveable pop_queue(std::vector<Moveable>& queue) {
+  std::pop_heap(queue.begin(), queue.end(), std::less<Moveable>());
+  Moveable result(std::move(queue.back()));
+  queue.pop_back();
   return result;
 }
 
@@ -51,47 +62,116 @@ struct IonEvent {
   }
 };
 
-class CorrectedRead {
-private:
-  std::vector<HRun> runs_;
-  std::shared_ptr<CorrectedRead> previous_;
+// Corrected reads of all the search states. States share their prefixes: every run is
+// stored once as a node pointing to the previous one, so a read is just the index of its
+// last node. Nodes live until Clear(), which is called once per search.
+class CorrectedReads {
+ private:
+  struct Node {
+    uint32_t previous;
+    HRun run;
+  };
+  std::vector<Node> nodes_;
 
  public:
-  CorrectedRead() : previous_(nullptr) {}
-
-  CorrectedRead(std::shared_ptr<CorrectedRead> previous)
-      : previous_(previous) {}
+  static constexpr uint32_t kEmpty = -1U;
 
-  CorrectedRead(std::vector<HRun>&& runs,
-                 std::shared_ptr<CorrectedRead> previous)
-      : runs_(std::move(runs)), previous_(previous) {}
+  inline void Clear() { nodes_.clear(); }
 
-  inline void Add(const HRun hrun) { runs_.push_back(hrun); }
+  inline uint32_t Add(uint32_t read, const HRun hrun) {
+    nodes_.push_back({read, hrun});
+    return (uint32_t)(nodes_.size() - 1);
+  }
 
-  size_t Size() const {
-    size_t size = previous_ != nullptr ? previous_->Size() : 0;
-    for (auto hrun : runs_) {
-      size += hrun.len;
+  size_t Size(uint32_t read) const {
+    size_t size = 0;
+    for (; read != kEmpty; read = nodes_[read].previous) {
+      size += nodes_[read].run.len;
     }
     return size;
   }
 
-  inline void Fill(std::string& result) const {
-    if (previous_ != nullptr) {
-      previous_->Fill(result);
+  inline std::string ToString(uint32_t read) const {
+    std::string result(Size(read), 0);
+    size_t end = result.size();
+    for (; read != kEmpty; read = nodes_[read].previous) {
+      const HRun hrun = nodes_[read].run;
+      end -= hrun.len;
+      std::fill_n(result.begin() + end, hrun.len, ::nucl(hrun.nucl));
     }
+    return result;
+  }
+};
 
-    for (auto hrun : runs_) {
-      result += hrun.str();
+// (position, k-mer hash) pairs of the states already expanded by the search.
+// Open addressing with linear probing, Clear() just starts a new generation,
+// so the table is reused between the reads without touching its memory.
+class VisitedStates {
+ private:
+  struct Slot {
+    size_t hash;
+    uint32_t position;
+    uint32_t generation;
+  };
+  std::vector<Slot> slots_;
+  size_t size_ = 0;
+  uint32_t generation_ = 1;
+
+  static inline size_t Index(uint32_t position, size_t hash) {
+    // hash is xxh3 of the k-mer already
+    return hash ^ (position * 0x9E3779B97F4A7C15ULL);
+  }
+
+  void Grow() {
+    std::vector<Slot> slots(std::max(slots_.size() * 2, (size_t)64), Slot{0, 0, 0});
+    slots.swap(slots_);
+    size_ = 0;
+    for (const auto& slot : slots) {
+      if (slot.generation == generation_) {
+        Insert(slot.position, slot.hash);
+      }
     }
   }
 
-  inline std::string ToString() const {
-    std::string result;
-    result.reserve(Size() + 10);
-    Fill(result);
-    return result;
+ public:
+  inline void Clear() {
+    size_ = 0;
+    if (++generation_ == 0) {
+      for (auto& slot : slots_) {
+        slot.generation = 0;
+      }
+      generation_ = 1;
+    }
   }
+
+  // returns true iff the pair was inserted before
+  inline bool Insert(uint32_t position, size_t hash) {
+    if (2 * (size_ + 1) > slots_.size()) {
+      Grow();
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = Index(position, hash) & mask;; i = (i + 1) & mask) {
+      Slot& slot = slots_[i];
+      if (slot.generation != generation_) {
+        slot = {hash, position, generation_};
+        ++size_;
+        return false;
+      }
+      if (slot.hash == hash && slot.position == position) {
+        return true;
+      }
+    }
+  }
+};
+
+// Memory reused by the consecutive searches of one thread
+struct CorrectionBuffers {
+  CorrectedReads reads;
+  VisitedStates visited;
+  std::vector<IonEvent> proceeded;
+  std::vector<IonEvent> insertions;
+  std::vector<IonEvent> deletions;
+  std::vector<IonEvent> rest_events;
 };
 
 template <class PenaltyState>
@@ -104,7 +184,7 @@ class CorrectionState {
  private:
   PenaltyState penalty_state;
   HKMer kmer_;
-  std::shared_ptr<CorrectedRead> current_read_ = std::shared_ptr<CorrectedRead>(nullptr);
+  uint32_t current_read_ = CorrectedReads::kEmpty;
   int16_t cursor_ = 0;
   int16_t corrections_ = 0;
 
@@ -115,7 +195,7 @@ class CorrectionState {
 
   inline size_t TotalCorrections() const { return (size_t)corrections_; }
 
-  const CorrectedRead* Read() const { return current_read_.get(); }
+  uint32_t Read() const { return current_read_; }
 
   unsigned Position() const { return (unsigned)cursor_; }
 };
@@ -126,6 +206,7 @@ class CorrectionContext {
   std::vector<uint8_t> hrun_sizes_;
   const KMerData& data_;
   bool reversed_;
+  CorrectionBuffers& buffers_;
 
   inline void FillHRunSizes(const std::vector<char>& read,
                             std::vector<uint8_t>& hrun_sizes) const {
@@ -147,9 +228,10 @@ class CorrectionContext {
 
  public:
   CorrectionContext(const KMerData& data, const std::string& read,
-                     bool reverse)
+                     bool reverse, CorrectionBuffers& buffers)
       : data_(data)
-      , reversed_(reverse) {
+      , reversed_(reverse)
+      , buffers_(buffers) {
     read_.resize(read.size());
     for (size_t i = 0; i < read.size(); ++i) {
       read_[i] = dignucl(read[i]);
@@ -169,6 +251,8 @@ class CorrectionContext {
 
   inline bool IsReversed() const { return reversed_; }
 
+  inline CorrectionBuffers& Buffers() const { return buffers_; }
+
   inline HRun GetHRun(size_t offset) const {
     return HRun((uint8_t)read_[offset], (uint8_t)hrun_sizes_[offset]);
   }
@@ -201,7 +285,7 @@ class StateBuilder {
         penalty_calcer_(penalty_calcer),
         context_(context),
         next_() {
-    next_.current_read_.reset(new CorrectedRead(previous_.current_read_));
+    next_.current_read_ = previous_.current_read_;
     next_.kmer_ = previous_.kmer_;
     next_.penalty_state = previous_.penalty_state;
     next_.cursor_ = previous_.cursor_;
@@ -212,7 +296,7 @@ class StateBuilder {
     if (event.fixed_size_ != 0) {
       const HRun run = event.FixedHRun();
       next_.kmer_ <<= run;
-      next_.current_read_->Add(run);
+      next_.current_read_ = context_.Buffers().reads.Add(next_.current_read_, run);
     }
 
     next_.cursor_ = (int16_t)(next_.cursor_ + event.overserved_size_);
@@ -232,7 +316,6 @@ class StateBuilder {
     State state;
     state.penalty_state = PenaltyCalcer::CreateState(
         context.IsReversed(), (unsigned)context.GetRead().size());
-    state.current_read_.reset(new CorrectedRead());
     size_t offset = 0;
     size_t minSkip = 0;
 
@@ -251,7 +334,7 @@ class StateBuilder {
     while (offset < skip) {
       HRun run = context.GetHRun(offset);
       state.kmer_ <<= run;
-      state.current_read_->Add(context.GetHRun(offset));
+      state.current_read_ = context.Buffers().reads.Add(state.current_read_, run);
       penalty.UpdateInitial(state.penalty_state,
                             IonEvent(run.nucl, run.len, run.len, true),
                             context.TryGetKMerStats(state.kmer_));
@@ -264,7 +347,7 @@ class StateBuilder {
 template <class PenaltyCalcer>
 class MoveToNextDivergence {
   using State = CorrectionState<typename PenaltyCalcer::PenaltyState>;
-  std::vector<IonEvent> Proceeded;
+  std::vector<IonEvent>& Proceeded;
   State& state_;
   const CorrectionContext& context_;
   const PenaltyCalcer& calcer_;
@@ -274,10 +357,13 @@ class MoveToNextDivergence {
   MoveToNextDivergence(State& state,
                        const CorrectionContext& context,
                        const PenaltyCalcer& calcer)
-      : state_(state),
+      : Proceeded(context.Buffers().proceeded),
+        state_(state),
         context_(context),
         calcer_(calcer),
-        cursor_((unsigned)state.cursor_) {}
+        cursor_((unsigned)state.cursor_) {
+    Proceeded.clear();
+  }
 
   inline bool FindNextDivergence() {
     const auto& context = context_;
@@ -301,7 +387,7 @@ class MoveToNextDivergence {
   // we'll use it only while we move in branch…
   inline void Move() {
     for (unsigned i = 0; i < Proceeded.size(); ++i) {
-      state_.current_read_->Add(Proceeded[i].FixedHRun());
+      state_.current_read_ = context_.Buffers().reads.Add(state_.current_read_, Proceeded[i].FixedHRun());
       state_.kmer_ <<= Proceeded[i].FixedHRun();
       calcer_.Update(state_.penalty_state, Proceeded[i],
                     context_.TryGetKMerStats(state_.kmer_));
@@ -358,10 +444,10 @@ class HRunSizeSearcher {
     return IonEvent(observed_nucl_, observed_size_, observed_size_, is_good_func(hkmer_));
   }
 
-  inline std::vector<IonEvent> TryFindInsertions(char max_error_size = 3,
-                                                  const bool greedy = true) {
-    std::vector<IonEvent> results;
-    results.reserve(max_error_size);
+  inline void TryFindInsertions(std::vector<IonEvent>& results,
+                                char max_error_size = 3,
+                                const bool greedy = true) {
+    results.clear();
 
     const char nucl = hkmer_[K - 1].nucl;
     for (char i = 1; i <= max_error_size; ++i) {
@@ -374,13 +460,12 @@ class HRunSizeSearcher {
         }
       }
     }
-    return results;
   }
 
-  inline std::vector<IonEvent> TryFindAllDeletions(const char max_error_size = 3,
-                                                    const bool greedy = true) {
-    std::vector<IonEvent> results;
-    results.reserve(max_error_size);
+  inline void TryFindAllDeletions(std::vector<IonEvent>& results,
+                                  const char max_error_size = 3,
+                                  const bool greedy = true) {
+    results.clear();
 
     const char nucl = hkmer_[K - 1].nucl;
     const char start = (char)std::max(1, observed_size_ - max_error_size);
@@ -394,7 +479,6 @@ class HRunSizeSearcher {
         }
       }
     }
-    return results;
   }
 
   inline IonEvent TryFindInsertion(char max_error_size = 3) {
@@ -429,13 +513,13 @@ class HRunSizeSearcher {
                     found);
   }
 
-  inline std::vector<IonEvent> Find(const char max_error_size = 3) {
-    std::vector<IonEvent> events;
+  inline void Find(std::vector<IonEvent>& events, const char max_error_size = 3) {
+    events.clear();
 
     IonEvent without = WithoutCorrection();
     if (without.is_to_good_correction_) {
       events.push_back(without);
-      return events;
+      return;
     }
 
     IonEvent insertion = TryFindInsertion(max_error_size);
@@ -447,8 +531,6 @@ class HRunSizeSearcher {
     if (deletion.is_to_good_correction_) {
       events.push_back(deletion);
     }
-
-    return events;
   }
 };
 
@@ -468,7 +550,7 @@ class CorrectLastHRun {
  private:
   inline bool AddAnotherNuclInsertions(const HRun run,
                                        const TState& previous,
-                                       std::priority_queue<TState>& corrections) {
+                                       std::vector<TState>& corrections) {
     bool found = false;
     const auto& kmer = previous.GetHKMer();
 
@@ -484,13 +566,14 @@ class CorrectLastHRun {
         another_nucl_insertion[K - 1].len = i & 0x3F;
         if (is_good_function_(another_nucl_insertion)) {
           HRunSizeSearcher rest_searcher(another_nucl_insertion, run, is_good_function_);
-          auto events = rest_searcher.Find((const char)kMaxSecondIndel);
+          auto& events = context_.Buffers().rest_events;
+          rest_searcher.Find(events, (const char)kMaxSecondIndel);
           for (auto& event : events) {
             if (event.is_to_good_correction_) {
               StateBuilder<PenaltyCalcer> builder(previous, calcer_, context_);
               builder.AddEvent(IonEvent(c, 0, (const char)i, true));  // new insertion
               builder.AddEvent(event);
-              corrections.emplace(builder.Build());
+              push_queue(corrections, builder.Build());
               found = true;
             }
           }
@@ -510,7 +593,7 @@ class CorrectLastHRun {
         calcer_(calcer),
         is_good_function_(calcer_.Good()) {}
 
-  inline void AddOnlySimpleCorrections(std::priority_queue<TState>& corrections,
+  inline void AddOnlySimpleCorrections(std::vector<TState>& corrections,
                                        unsigned indel_size = 1) {
     const unsigned cursor = previous_.Position();
     const HRun run = context_.GetHRun(cursor);
@@ -525,14 +608,14 @@ class CorrectLastHRun {
       if (insertion.is_to_good_correction_) {
         StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
         builder.AddEvent(insertion);
-        corrections.emplace(builder.Build());
+        push_queue(corrections, builder.Build());
       }
 
       auto deletion = searcher.TryFindDeletion((const char)indel_size);
       if (deletion.is_to_good_correction_) {
         StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
         builder.AddEvent(deletion);
-        corrections.emplace(builder.Build());
+        push_queue(corrections, builder.Build());
       }
     }
     //
@@ -551,7 +634,7 @@ class CorrectLastHRun {
             StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
             builder.AddEvent(IonEvent(run.nucl, run.len, 0, true));
             builder.AddEvent(IonEvent(c, 0, 1, true));
-            corrections.emplace(builder.Build());
+            push_queue(corrections, builder.Build());
           }
         }
       }
@@ -576,14 +659,14 @@ class CorrectLastHRun {
             builder.AddEvent(IonEvent(c, (char)0, (char)1, true));
             builder.AddEvent(
                 IonEvent(run.nucl, (char)(maxLen - i), (char)(maxLen - i), true));
-            corrections.emplace(builder.Build());
+            push_queue(corrections, builder.Build());
           }
         }
       }
     }
   }
 
-  inline bool AddPossibleCorrections(std::priority_queue<TState>& corrections) {
+  inline bool AddPossibleCorrections(std::vector<TState>& corrections) {
     const unsigned cursor = previous_.Position();
     const HRun run = context_.GetHRun(cursor);
     bool found = false;
@@ -591,19 +674,21 @@ class CorrectLastHRun {
     if (is_good_function_(previous_.GetHKMer())) {
       HRunSizeSearcher searcher(previous_.GetHKMer(), run, is_good_function_);
       {
-        auto insertions = searcher.TryFindInsertions((char)kMaxInDel);
+        auto& insertions = context_.Buffers().insertions;
+        searcher.TryFindInsertions(insertions, (char)kMaxInDel);
         for (const auto& insertion : insertions) {
           if (insertion.is_to_good_correction_) {
             StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
             builder.AddEvent(insertion);
-            corrections.emplace(builder.Build());
+            push_queue(corrections, builder.Build());
             found = true;
           }
         }
       }
 
       {
-        auto deletions = searcher.TryFindAllDeletions((const char)std::max((int)run.len, 1));
+        auto& deletions = context_.Buffers().deletions;
+        searcher.TryFindAllDeletions(deletions, (const char)std::max((int)run.len, 1));
         if (deletions.size()) {
           for (const auto& deletion : deletions) {
             const uint8_t restSize =
@@ -611,7 +696,7 @@ class CorrectLastHRun {
             if (restSize <= kMaxInDel) {
               StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
               builder.AddEvent(deletion);
-              corrections.emplace(builder.Build());
+              push_queue(corrections, builder.Build());
             }
 
             // Try insertion after part of hrun. Errors of type aaaaa -> aaa g
@@ -648,14 +733,14 @@ class CorrectLastHRun {
           if (next_run.nucl != previous_.GetHKMer()[K - 1].nucl) {
             StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
             builder.AddEvent(IonEvent(run.nucl, run.len, 0, true));  // full deletion
-            corrections.emplace(builder.Build());
+            push_queue(corrections, builder.Build());
             found = true;
           } else {
             {
               StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
               builder.AddEvent(IonEvent(run.nucl, run.len, 0, true));  // full deletion
               builder.AddEvent(IonEvent(next_run.nucl, next_run.len, 0, true));  // full deletion
-              corrections.emplace(builder.Build());
+              push_queue(corrections, builder.Build());
             }
             {
               StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
@@ -686,7 +771,7 @@ class CorrectLastHRun {
             found = true;
             StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
             builder.AddEvent(IonEvent(run.nucl, run.len, (char) (run.len + 1), false));
-            corrections.emplace(builder.Build());
+            push_queue(corrections, builder.Build());
             break;
           }
         }
@@ -712,7 +797,7 @@ class CorrectLastHRun {
             found = true;
             StateBuilder<PenaltyCalcer> builder(previous_, calcer_, context_);
             builder.AddEvent(IonEvent(run.nucl, run.len, (uint8_t)(run.len - 1), false));
-            corrections.emplace(builder.Build());
+            push_queue(corrections, builder.Build());
             break;
           }
         }
@@ -13,7 +13,10 @@
 #include "kmer_data.hpp"
 #include "utils/logger/log_writers.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <unordered_map>
 #include <vector>
 #include "quality_metrics.h"
 #include <boost/math/special_functions/gamma.hpp>
@@ -75,7 +78,16 @@ HKMer TGenomicHKMersEstimator::ByPosteriorQualCenter(
   return res;
 }
 
-void TGenomicHKMersEstimator::ProceedCluster(std::vector<size_t>& cluster) {
+// Positions of the keys, in increasing order, for every distinct key
+static std::unordered_map<uint32_t, std::vector<size_t>> GroupByKey(const std::vector<uint32_t>& keys) {
+  std::unordered_map<uint32_t, std::vector<size_t>> groups;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    groups[keys[i]].push_back(i);
+  }
+  return groups;
+}
+
+void TGenomicHKMersEstimator::ProceedCluster(std::vector<size_t>& cluster, unsigned nthreads) {
   std::sort(cluster.begin(), cluster.end(), CountCmp(data_));
 
   std::vector<double> qualities;
@@ -108,23 +120,51 @@ void TGenomicHKMersEstimator::ProceedCluster(std::vector<size_t>& cluster) {
 
 
   std::vector<double> kmerErrorRates;
+  std::vector<uint32_t> candidateKeys;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const auto& centerCandidate = data_[candidates[i]];
+    kmerErrorRates.push_back(exp(GenerateLikelihood(centerCandidate.kmer, centerCandidate.kmer)));
+    candidateKeys.push_back(hkmerNuclKey(centerCandidate.kmer));
+  }
+  const auto sameKeyCandidates = GroupByKey(candidateKeys);
+
+  const bool filterByCount = cfg::get().subcluster_filter_by_count_enabled;
+  const double countMult = cfg::get().subcluster_count_mult;
+  // Candidates with different run nucleotides are at the infinite distance, so they add
+  // nothing to the count threshold unless the multiplier is at least one
+  const bool sameKeyParentsOnly = !filterByCount || pow(countMult, std::numeric_limits<double>::infinity()) == 0;
 
   {
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic) if (nthreads > 1)
     for (size_t i = 0; i < candidates.size(); ++i) {
       const auto& centerCandidate = data_[candidates[i]];
-      kmerErrorRates.push_back(exp(GenerateLikelihood(centerCandidate.kmer, centerCandidate.kmer)));
 
-      for (size_t j = 0; j < i; ++j) {
+      auto proceedParent = [&](size_t j, double dist) {
         const auto& parent = data_[candidates[j]];
 
-        if (cfg::get().subcluster_filter_by_count_enabled) {
-          const double mult = pow(cfg::get().subcluster_count_mult, hammer::hkmerDistance(parent.kmer, centerCandidate.kmer).levenshtein_);
+        if (filterByCount) {
+          const double mult = pow(countMult, dist);
           countThreshold[i] +=  mult * parent.count / kmerErrorRates[j];
         }
 
-        if (hammer::hkmerDistance(parent.kmer, centerCandidate.kmer).levenshtein_ <= 1) {
+        if (dist <= 1) {
           distOneBestQualities[i] = std::min(distOneBestQualities[i], qualities[j]);
         }
+      };
+
+      if (sameKeyParentsOnly) {
+        for (size_t j : sameKeyCandidates.at(candidateKeys[i])) {
+          if (j >= i) {
+            break;
+          }
+          proceedParent(j, hammer::hkmerDistance(data_[candidates[j]].kmer, centerCandidate.kmer).levenshtein_);
+        }
+      } else {
+        for (size_t j = 0; j < i; ++j) {
+          proceedParent(j, candidateKeys[j] == candidateKeys[i]
+                               ? hammer::hkmerDistance(data_[candidates[j]].kmer, centerCandidate.kmer).levenshtein_
+                               : std::numeric_limits<double>::infinity());
+        }
       }
 
       auto distOneParents = FindDistOneFullDels(centerCandidate);
@@ -175,30 +215,45 @@ void TGenomicHKMersEstimator::ProceedCluster(std::vector<size_t>& cluster) {
     std::vector<HKMer> centralKmers;
     std::vector<std::vector<size_t> > subclusters(k, std::vector<size_t>());
 
+    std::vector<size_t> centralCounts;
+    std::vector<uint32_t> centralKeys;
     for (size_t i = 0; i < k; ++i) {
       auto centerId = centerCandidates[i];
       centralKmers.push_back(data_[centerId].kmer);
+      centralCounts.push_back((size_t)data_[centerId].count);
+      centralKeys.push_back(hkmerNuclKey(centralKmers.back()));
     }
+    const auto sameKeyCenters = GroupByKey(centralKeys);
+    // All the centers are at the infinite distance: the first one with the largest count wins
+    const size_t farCenter = std::max_element(centralCounts.begin(), centralCounts.end()) - centralCounts.begin();
 
+    std::vector<size_t> assignment(cluster.size());
+#pragma omp parallel for num_threads(nthreads) if (nthreads > 1)
     for (size_t i = 0; i < cluster.size(); ++i) {
       double dist = std::numeric_limits<double>::infinity();
-      size_t cidx = k;
+      size_t cidx = farCenter;
       size_t count = 0;
 
       size_t kmerIdx = cluster[i];
-      hammer::HKMer kmerx = data_[kmerIdx].kmer;
-
-      for (size_t j = 0; j < k; ++j) {
-        hammer::HKMer kmery = centralKmers[j];
-        double cdist = hammer::hkmerDistance(kmerx, kmery).levenshtein_;
-        if (cdist < dist || (cdist == dist && count < (size_t)data_[kmery].count)) {
-          cidx = j;
-          dist = cdist;
-          count = data_[kmery].count;
+      const hammer::HKMer& kmerx = data_[kmerIdx].kmer;
+
+      auto it = sameKeyCenters.find(hkmerNuclKey(kmerx));
+      if (it != sameKeyCenters.end()) {
+        for (size_t j : it->second) {
+          double cdist = hammer::hkmerDistance(kmerx, centralKmers[j]).levenshtein_;
+          if (cdist < dist || (cdist == dist && count < centralCounts[j])) {
+            cidx = j;
+            dist = cdist;
+            count = centralCounts[j];
+          }
         }
       }
-      VERIFY(cidx < k);
-      subclusters[cidx].push_back(cluster[i]);
+      assignment[i] = cidx;
+    }
+
+    for (size_t i = 0; i < cluster.size(); ++i) {
+      VERIFY(assignment[i] < k);
+      subclusters[assignment[i]].push_back(cluster[i]);
     }
 
     for (size_t i = 0; i < k; ++i) {
@@ -229,10 +284,16 @@ void TGenomicHKMersEstimator::ProceedCluster(std::vector<size_t>& cluster) {
   // Now let's "estimate" quality
   std::vector<char> distOneGoodCenters(centerCandidates.size());
 
+  std::vector<uint32_t> centerKeys;
+  for (size_t idx : centerCandidates) {
+    centerKeys.push_back(hkmerNuclKey(data_[idx].kmer));
+  }
+  const auto sameKeyCenters = GroupByKey(centerKeys);
+
   for (uint k = 0; k < centerCandidates.size(); ++k) {
     const auto idx = centerCandidates[k];
     const KMerStat& centerCandidate = data_[idx];
-    for (uint j = 0; j < centerCandidates.size(); ++j) {
+    for (size_t j : sameKeyCenters.at(centerKeys[k])) {
       if (hammer::hkmerDistance(centerCandidate.kmer, data_[centerCandidates[j]].kmer).hamming_ == 1) {
         distOneGoodCenters[k] = 1;
       }
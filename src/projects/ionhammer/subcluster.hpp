@@ -73,7 +73,10 @@ class TGenomicHKMersEstimator {
     return indices;
   }
 
-  void ProceedCluster(std::vector<size_t>& cluster);
+  // hk-mers are compared only with the ones with the same run nucleotides, since the
+  // distance to the rest is infinite. nthreads > 1 splits the work on the cluster itself,
+  // which is worth for the oversized clusters only
+  void ProceedCluster(std::vector<size_t>& cluster, unsigned nthreads = 1);
 
   static size_t GetCenterIdx(const KMerData& kmerData,
                              const std::vector<size_t>& cluster) {
@@ -96,6 +96,10 @@ public:
         return edge_annotation_.size();
     }
 
+    const std::map<EdgeId, BinSet> &edge_annotation() const {
+        return edge_annotation_;
+    }
+
     const std::set<bin_id> &interesting_bins() const {
         return bins_of_interest_;
     }
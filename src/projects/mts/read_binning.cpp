@@ -13,36 +13,105 @@
 
 namespace debruijn_graph {
 
-std::set<bin_id> ContigBinner::RelevantBins(const io::SingleRead& r) const {
-    return edge_annotation_.RelevantBins(mapper_->MapRead(r).simple_path());
+void ContigBinner::IndexAnnotation() {
+    const auto &g = gp_.get<Graph>();
+    BinSet bins;
+    for (const auto &edge_bins : edge_annotation_.edge_annotation())
+        utils::insert_all(bins, edge_bins.second);
+    bins_.assign(bins.begin(), bins.end());
+    words_ = (bins_.size() + 63) / 64;
+    out_streams_.resize(bins_.size());
+
+    std::map<bin_id, size_t> bin_idx;
+    for (size_t i = 0; i < bins_.size(); ++i)
+        bin_idx[bins_[i]] = i;
+
+    edge_bins_.assign((g.max_eid() + 1) * words_, 0);
+    for (const auto &edge_bins : edge_annotation_.edge_annotation()) {
+        uint64_t *mask = edge_bins_.data() + g.int_id(edge_bins.first) * words_;
+        for (const auto &bin : edge_bins.second) {
+            size_t i = bin_idx[bin];
+            mask[i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
 }
 
-void ContigBinner::Init(bin_id bin) {
-    std::filesystem::path out_dir = out_root_ / bin;
+void ContigBinner::RelevantBins(const io::SingleRead& r, uint64_t *mask) const {
+    const auto &g = gp_.get<Graph>();
+    for (EdgeId e : mapper_->MapRead(r).simple_path()) {
+        const uint64_t *edge_mask = edge_bins_.data() + g.int_id(e) * words_;
+        for (size_t w = 0; w < words_; ++w)
+            mask[w] |= edge_mask[w];
+    }
+}
+
+void ContigBinner::Init(size_t bin) {
+    std::filesystem::path out_dir = out_root_ / bins_[bin];
     create_directories(out_dir);
-    out_streams_.emplace(bin, std::make_unique<ContigBinner::Stream>(
+    out_streams_[bin] = std::make_unique<ContigBinner::Stream>(
         out_dir / sample_name_.concat("_1.fastq.gz"),
-        out_dir / sample_name_.concat("_2.fastq.gz"))
-    );
+        out_dir / sample_name_.concat("_2.fastq.gz"));
+}
+
+std::vector<std::vector<size_t>> ContigBinner::BinBatch(const std::vector<io::PairedRead>& batch) {
+    //reads are mapped in parallel, bins are then collected in the read order
+    std::vector<uint64_t> masks(batch.size() * words_, 0);
+#   pragma omp parallel for schedule(guided)
+    for (size_t i = 0; i < batch.size(); ++i) {
+        uint64_t *mask = masks.data() + i * words_;
+        RelevantBins(batch[i].first(), mask);
+        RelevantBins(batch[i].second(), mask);
+    }
+
+    std::vector<std::vector<size_t>> bin_reads(bins_.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const uint64_t *mask = masks.data() + i * words_;
+        for (size_t w = 0; w < words_; ++w) {
+            for (uint64_t bits = mask[w]; bits; bits &= bits - 1) {
+                size_t bin = w * 64 + __builtin_ctzll(bits);
+                if (bins_of_interest_.size() && !bins_of_interest_.count(bins_[bin])) {
+                    INFO(bins_[bin] << " was excluded from read binning");
+                    continue;
+                }
+                bin_reads[bin].push_back(i);
+            }
+        }
+    }
+    return bin_reads;
+}
+
+void ContigBinner::WriteBatch(const std::vector<io::PairedRead>& batch,
+                              const std::vector<std::vector<size_t>>& bin_reads) {
+    std::vector<size_t> active_bins;
+    for (size_t bin = 0; bin < bin_reads.size(); ++bin) {
+        if (bin_reads[bin].empty())
+            continue;
+        if (!out_streams_[bin])
+            Init(bin);
+        active_bins.push_back(bin);
+    }
+
+    //every bin stream is compressed by a single thread, keeping the read order
+#   pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < active_bins.size(); ++i) {
+        size_t bin = active_bins[i];
+        auto &stream = *out_streams_[bin];
+        for (size_t read : bin_reads[bin])
+            stream << batch[read];
+    }
 }
 
 void ContigBinner::Run(io::PairedStream& paired_reads) {
-    io::PairedRead paired_read;
+    std::vector<io::PairedRead> batch;
+    batch.reserve(BATCH_SIZE);
     while (!paired_reads.eof()) {
-        paired_reads >> paired_read;
-        std::set<bin_id> bins;
-        utils::insert_all(bins, RelevantBins(paired_read.first()));
-        utils::insert_all(bins, RelevantBins(paired_read.second()));
-        for (const auto& bin : bins) {
-            if (bins_of_interest_.size() && !bins_of_interest_.count(bin)) {
-                INFO(bin << " was excluded from read binning");
-                continue;
-            }
-            if (!out_streams_.count(bin)) {
-                Init(bin);
-            }
-            *out_streams_[bin] << paired_read;
+        batch.clear();
+        io::PairedRead paired_read;
+        while (batch.size() < BATCH_SIZE && !paired_reads.eof()) {
+            paired_reads >> paired_read;
+            batch.push_back(std::move(paired_read));
         }
+        WriteBatch(batch, BinBatch(batch));
     }
 }
 
@@ -24,11 +24,26 @@ class ContigBinner {
     std::set<std::string> bins_of_interest_;
 
     typedef io::OPairedReadStream<ogzstream, io::FastqWriter> Stream;
-    std::map<bin_id, std::unique_ptr<Stream>> out_streams_;
+    //bins are numbered in lexicographic order, so that bit order agrees with std::set<bin_id>
+    std::vector<bin_id> bins_;
+    size_t words_;
+    //dense edge annotation: words_ words of bin bitmask per edge id
+    std::vector<uint64_t> edge_bins_;
+    std::vector<std::unique_ptr<Stream>> out_streams_;
 
-    std::set<bin_id> RelevantBins(const io::SingleRead& r) const;
+    static const size_t BATCH_SIZE = 1 << 16;
 
-    void Init(bin_id bin);
+    void IndexAnnotation();
+
+    void RelevantBins(const io::SingleRead& r, uint64_t *mask) const;
+
+    void Init(size_t bin);
+
+    //returns indices of the reads per bin for the batch
+    std::vector<std::vector<size_t>> BinBatch(const std::vector<io::PairedRead>& batch);
+
+    void WriteBatch(const std::vector<io::PairedRead>& batch,
+                    const std::vector<std::vector<size_t>>& bin_reads);
 
 public:
     ContigBinner(const graph_pack::GraphPack& gp,
@@ -41,7 +56,9 @@ public:
                      out_root_(out_root),
                      sample_name_(sample_name),
                      mapper_(MapperInstance(gp)),
-                     bins_of_interest_(bins_of_interest.begin(), bins_of_interest.end()) {
+                     bins_of_interest_(bins_of_interest.begin(), bins_of_interest.end()),
+                     words_(0) {
+        IndexAnnotation();
     }
 
     ~ContigBinner() {
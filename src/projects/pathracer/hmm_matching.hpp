@@ -0,0 +1,57 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#pragma once
+
+#include "hmm/hmmmatcher.hpp"
+
+#include "utils/parallel/openmp_wrapper.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Calls match(matcher, from, to) for consecutive ranges of [0, size) and returns the matcher with all the hits
+// (not summarized). Domain definition draws from the RNG of the pipeline, so unless hcfg.reseed is set,
+// the scores of a sequence depend on the sequences matched before it. In this case the whole range is matched
+// by a single matcher in order. Otherwise every range gets its own matcher and the ranges are processed as
+// OpenMP tasks, so the threads of the enclosing loop over HMMs which ran out of work take part as well.
+template <typename F>
+hmmer::HMMMatcher MatchSequences(size_t size, const hmmer::HMM &hmm, const hmmer::hmmer_cfg &hcfg, F match) {
+    if (!hcfg.reseed) {
+        hmmer::HMMMatcher matcher(hmm, hcfg);
+        match(matcher, 0, size);
+        return matcher;
+    }
+
+    size_t nchunks = std::max<size_t>(1, std::min(size, 4 * size_t(omp_get_max_threads())));
+    std::vector<std::unique_ptr<hmmer::HMMMatcher>> matchers(nchunks);
+    auto spawn = [&]() {
+        for (size_t i = 0; i < nchunks; ++i) {
+            #pragma omp task firstprivate(i) shared(matchers, hcfg, hmm, match)
+            {
+                matchers[i] = std::make_unique<hmmer::HMMMatcher>(hmm, hcfg);
+                match(*matchers[i], i * size / nchunks, (i + 1) * size / nchunks);
+            }
+        }
+        #pragma omp taskwait
+    };
+
+    if (omp_in_parallel()) {
+        spawn();
+    } else {
+        #pragma omp parallel
+        #pragma omp single
+        spawn();
+    }
+
+    // Merged hits are sorted by score and then by (unique) name, so the order of merging does not matter
+    hmmer::HMMMatcher matcher = std::move(*matchers.front());
+    for (size_t i = 1; i < matchers.size(); ++i)
+        matcher.merge(*matchers[i]);
+
+    return matcher;
+}
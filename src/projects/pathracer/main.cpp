@@ -15,6 +15,7 @@
 #include "cached_cursor.hpp"
 #include "superpath_index.hpp"
 #include "hmm_path_info.hpp"
+#include "hmm_matching.hpp"
 #include "fasta_reader.hpp"
 
 #include "stack_limit.hpp"
@@ -189,7 +190,8 @@ void process_cmdline(int argc, char **argv, PathracerConfig &cfg) {
           cfg.hcfg.max     << option("--max")             % "Turn all heuristic filters off (less speed, more power)",
           (option("--F1") & number("value", cfg.hcfg.F1)) % "Stage 1 (MSV) threshold: promote hits w/ P <= F1",
           (option("--F2") & number("value", cfg.hcfg.F2)) % "Stage 2 (Vit) threshold: promote hits w/ P <= F2",
-          (option("--F3") & number("value", cfg.hcfg.F3)) % "Stage 3 (Fwd) threshold: promote hits w/ P <= F3"
+          (option("--F3") & number("value", cfg.hcfg.F3)) % "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",
+          cfg.hcfg.reseed  << option("--reseed")          % "reset RNG for every domain region and rescore paths in parallel (scores may differ slightly)"
       ),
       "Developer options:" % (
           cfg.parallel_component_processing << option("--parallel-components") % "process connected components of neighborhood subgraph in parallel [default: false]",
@@ -264,7 +266,6 @@ auto ScoreSequences(const StringArray &seqs,
                     const hmmer::HMM &hmm, const PathracerConfig &cfg) {
     DEBUG("ScoreSequences started");
     bool hmm_in_aas = hmm.abc()->K == 20;
-    hmmer::HMMMatcher matcher(hmm, cfg.hcfg);
 
     if (!hmm_in_aas) {
         DEBUG("HMM in nucleotides");
@@ -272,22 +273,40 @@ auto ScoreSequences(const StringArray &seqs,
         DEBUG("HMM in amino acids");
     }
 
+    // Sequences are extracted and translated up front in parallel, so only the pipeline itself
+    // runs in the matching order (see MatchSequences)
+    size_t nframes = hmm_in_aas ? 3 : 1;
+    std::vector<std::string> queries(seqs.size() * nframes);
+    #pragma omp parallel for schedule(dynamic, 64)
     for (size_t i = 0; i < seqs.size(); ++i) {
         std::string seq = seqs[i];
         if (seq.size() < 20)
             continue;
-        std::string ref = refs.size() > i ? refs[i] : std::to_string(i);
         if (!hmm_in_aas) {
-            matcher.match(ref.c_str(), seq.c_str());
+            queries[i] = std::move(seq);
         } else {
-            for (size_t shift = 0; shift < 3; ++shift) {
-                std::string ref_shift = ref + "/" + std::to_string(shift);
-                std::string seq_aas = aa::translate(seq.c_str() + shift);
-                matcher.match(ref_shift.c_str(), seq_aas.c_str());
-            }
+            for (size_t shift = 0; shift < 3; ++shift)
+                queries[i * 3 + shift] = aa::translate(seq.c_str() + shift);
         }
     }
 
+    auto matcher = MatchSequences(seqs.size(), hmm, cfg.hcfg,
+                                  [&](hmmer::HMMMatcher &matcher, size_t from, size_t to) {
+        for (size_t i = from; i < to; ++i) {
+            if (queries[i * nframes].empty())
+                continue;
+            std::string ref = refs.size() > i ? refs[i] : std::to_string(i);
+            if (!hmm_in_aas) {
+                matcher.match(ref.c_str(), queries[i].c_str());
+            } else {
+                for (size_t shift = 0; shift < 3; ++shift) {
+                    std::string ref_shift = ref + "/" + std::to_string(shift);
+                    matcher.match(ref_shift.c_str(), queries[i * 3 + shift].c_str());
+                }
+            }
+        }
+    });
+
     matcher.summarize();
     return matcher;
 }
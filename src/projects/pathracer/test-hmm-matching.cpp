@@ -0,0 +1,129 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#include <gtest/gtest.h>
+#include "hmm_matching.hpp"
+
+#include "hmm/hmmfile.hpp"
+
+extern "C" {
+    #include "p7_config.h"
+    #include "easel.h"
+    #include "hmmer.h"
+}
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char *AAS = "ACDEFGHIKLMNPQRSTVWY";
+
+std::string random_aas(std::mt19937 &rand, size_t len) {
+    std::string s;
+    for (size_t i = 0; i < len; ++i)
+        s += AAS[rand() % 20];
+    return s;
+}
+
+std::string mutate(std::mt19937 &rand, std::string s) {
+    for (char &c : s) {
+        if (rand() % 8 == 0)
+            c = AAS[rand() % 20];
+    }
+    return s;
+}
+
+// Random sequences with zero, one or several (close to each other) mutated copies of the query
+std::vector<std::string> make_targets(const std::string &query, size_t n) {
+    std::mt19937 rand(42);
+    std::vector<std::string> seqs;
+    for (size_t i = 0; i < n; ++i) {
+        std::string seq = random_aas(rand, 20 + rand() % 100);
+        for (size_t copies = rand() % 4; copies > 0; --copies)
+            seq += mutate(rand, query) + random_aas(rand, rand() % 10);
+        seqs.push_back(seq);
+    }
+    return seqs;
+}
+
+std::string dump(const hmmer::HMMMatcher &matcher) {
+    std::ostringstream os;
+    os.precision(10);
+    os << matcher.pipeline()->nseqs << ' ' << matcher.pipeline()->Z << '\n';
+    for (const auto &hit : matcher.hits()) {
+        os << hit.name() << ' ' << hit.score() << ' ' << hit.lnP() << ' '
+           << hit.reported() << hit.included() << ' ' << hit.ndom() << '\n';
+        for (const auto &domain : hit.domains()) {
+            os << "  " << domain.bitscore() << ' ' << domain.lnP() << ' '
+               << domain.env().first << '-' << domain.env().second << ' '
+               << domain.reported() << domain.included() << '\n';
+        }
+    }
+    return os.str();
+}
+
+template <typename Matcher>
+void match_range(Matcher &matcher, const std::vector<std::string> &seqs, size_t from, size_t to) {
+    for (size_t i = from; i < to; ++i)
+        matcher.match(std::to_string(i).c_str(), seqs[i].c_str());
+}
+
+std::string match_serially(const hmmer::HMM &hmm, const hmmer::hmmer_cfg &cfg,
+                           const std::vector<std::string> &seqs) {
+    hmmer::HMMMatcher matcher(hmm, cfg);
+    match_range(matcher, seqs, 0, seqs.size());
+    matcher.summarize();
+    return dump(matcher);
+}
+
+std::string match_sequences(const hmmer::HMM &hmm, const hmmer::hmmer_cfg &cfg,
+                            const std::vector<std::string> &seqs, int threads) {
+    omp_set_num_threads(threads);
+    auto matcher = MatchSequences(seqs.size(), hmm, cfg, [&](hmmer::HMMMatcher &m, size_t from, size_t to) {
+        match_range(m, seqs, from, to);
+    });
+    matcher.summarize();
+    return dump(matcher);
+}
+
+}  // namespace
+
+class HMMMatching : public ::testing::Test {
+  protected:
+    HMMMatching()
+            : query_(random_query()),
+              hmm_(hmmer::HMMSequenceBuilder(hmmer::Alphabet::AMINO, hmmer::ScoreSystem::Default)
+                           .from_string("query", query_.c_str(), nullptr)),
+              seqs_(make_targets(query_, 500)) {}
+
+    static std::string random_query() {
+        std::mt19937 rand(239);
+        return random_aas(rand, 60);
+    }
+
+    std::string query_;
+    hmmer::HMM hmm_;
+    std::vector<std::string> seqs_;
+};
+
+TEST_F(HMMMatching, SerialWithoutReseeding) {
+    hmmer::hmmer_cfg cfg;
+    std::string expected = match_serially(hmm_, cfg, seqs_);
+    EXPECT_NE(std::string::npos, expected.find("\n  "));
+    for (int threads : {1, 4})
+        EXPECT_EQ(expected, match_sequences(hmm_, cfg, seqs_, threads)) << threads;
+}
+
+TEST_F(HMMMatching, ReseededIndependentOfThreads) {
+    hmmer::hmmer_cfg cfg;
+    cfg.reseed = true;
+    std::string expected = match_serially(hmm_, cfg, seqs_);
+    for (int threads : {1, 2, 3, 8})
+        EXPECT_EQ(expected, match_sequences(hmm_, cfg, seqs_, threads)) << threads;
+}
@@ -23,8 +23,14 @@ template<class Graph>
 class SetOfForbiddenEdgesPathChooser : public omnigraph::PathProcessor<Graph>::Callback {
     typedef typename Graph::EdgeId EdgeId;
     typedef typename Graph::VertexId VertexId;
+public:
+    //last edges of forbidden paths indexed by their first edges
+    typedef std::unordered_map<EdgeId, std::vector<EdgeId>> ForbiddenPathEnds;
+
+private:
     const Graph &g_;
-    std::set<std::vector<EdgeId>> forbidden_edges_;
+    const ForbiddenPathEnds &forbidden_ends_;
+    std::unordered_set<EdgeId> path_edges_;
     std::vector<EdgeId> answer_path_;
     std::vector<std::vector<EdgeId>> all_known_answers_;
 
@@ -39,30 +45,46 @@ class SetOfForbiddenEdgesPathChooser : public omnigraph::PathProcessor<Graph>::C
         return math::ge(50.0, max_coverage/min_coverage);
     }
 
-    bool IsNewPathBetter(const path_extend::BidirectionalPath &current, const path_extend::BidirectionalPath &candidate) const {
-        int current_length = (int)current.Length();
-        int candidate_length = (int)candidate.Length();
+    //path is forbidden if it passes through both ends of some forbidden path
+    bool CrossesForbidden(const std::vector<EdgeId> &path) {
+        path_edges_.clear();
+        path_edges_.insert(path.begin(), path.end());
+        for (EdgeId e : path_edges_) {
+            auto it = forbidden_ends_.find(e);
+            if (it == forbidden_ends_.end())
+                continue;
+            for (EdgeId back : it->second) {
+                if (path_edges_.count(back))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool IsNewPathBetter(const std::vector<EdgeId> &current, const std::vector<EdgeId> &candidate) const {
+        int current_length = (int)omnigraph::CumulativeLength(g_, current);
+        int candidate_length = (int)omnigraph::CumulativeLength(g_, candidate);
         return candidate_length < current_length;
     }
 
 public:
-    SetOfForbiddenEdgesPathChooser(const Graph &g, const std::set<std::vector<EdgeId>> &forbidden_edges)
-            : g_(g), forbidden_edges_(forbidden_edges) {}
-
-    void HandleReversedPath(const std::vector<EdgeId> &reversed_path) override {
-        std::vector<EdgeId> forward_path = reversed_path;
-        std::reverse(forward_path.begin(), forward_path.end());
+    static ForbiddenPathEnds IndexForbidden(const std::set<std::vector<EdgeId>> &forbidden_paths) {
+        ForbiddenPathEnds forbidden_ends;
+        for (const auto &forbidden_path : forbidden_paths) {
+            if (!forbidden_path.empty())
+                forbidden_ends[forbidden_path.front()].push_back(forbidden_path.back());
+        }
+        return forbidden_ends;
+    }
 
-        for (const auto& forbidden_path : forbidden_edges_) {
-            if (forbidden_path.empty())
-                continue;
+    SetOfForbiddenEdgesPathChooser(const Graph &g, const ForbiddenPathEnds &forbidden_ends)
+            : g_(g), forbidden_ends_(forbidden_ends) {}
 
-            bool cross_start = std::find(std::begin(forward_path), std::end(forward_path), forbidden_path.front()) != forward_path.end();
-            bool cross_end = find(std::begin(forward_path), std::end(forward_path), forbidden_path.back()) != forward_path.end();
+    void HandleReversedPath(const std::vector<EdgeId> &reversed_path) override {
+        std::vector<EdgeId> forward_path = this->ReversePath(reversed_path);
 
-            if (cross_end && cross_start)
-                return;
-        }
+        if (CrossesForbidden(forward_path))
+            return;
 
         if (answer_path_.empty()) {
             if (!CheckCoverageDiff(forward_path))
@@ -76,11 +98,9 @@ public:
         if (!CheckCoverageDiff(forward_path))
             return;
 
-        auto current = path_extend::BidirectionalPath::create(g_, answer_path_);
-        auto candidate = path_extend::BidirectionalPath::create(g_, forward_path);
         all_known_answers_.push_back(answer_path_);
-        if (IsNewPathBetter(*current, *candidate)) {
-            answer_path_ = forward_path;
+        if (IsNewPathBetter(answer_path_, forward_path)) {
+            answer_path_ = std::move(forward_path);
         }
     }
 
@@ -118,76 +138,134 @@ public:
 
 private:
 
-    void ConnectWithWeakEdge(VertexId v1, VertexId v2,
-                             SetOfForbiddenEdgesPathChooser<Graph> &chooser) {
+    //weak edges to be added between a pair of domains, found independently of the others
+    struct WeakConnection {
+        VertexId to;
+        std::vector<std::pair<std::vector<EdgeId>, size_t>> edges;
+    };
+
+    void FindWeakConnection(VertexId v1, VertexId v2,
+                            SetOfForbiddenEdgesPathChooser<Graph> &chooser,
+                            WeakConnection &connection) const {
         const auto &g = gp_.get<Graph>();
         DEBUG("Trying to connect " << domain_graph_.GetVertexName(v1) << " and " << domain_graph_.GetVertexName(v2) << " with weak edge");
         int last_mapping = (int)(g.length(domain_graph_.mapping_path(v1).back().first) - domain_graph_.mapping_path(v1).end_pos());
         int first_mapping = (int)domain_graph_.mapping_path(v2).start_pos();
+        connection.to = v2;
 
         if (5000 < last_mapping + first_mapping)
             return;
 
         int min_len = 0;
-        if (g.EdgeEnd(domain_graph_.domain_edges(v1).back()) != g.EdgeStart(domain_graph_.domain_edges(v2).front())) {
-            DEBUG("Trying to find paths from " << g.EdgeEnd(domain_graph_.domain_edges(v1).back()) << " to " << g.EdgeStart(domain_graph_.domain_edges(v2).front()));
-            ProcessPaths(g, min_len, 4000 - last_mapping - first_mapping, g.EdgeEnd(domain_graph_.domain_edges(v1).back()), g.EdgeStart(domain_graph_.domain_edges(v2).front()), chooser);
-            if (!chooser.answer().empty()) {
-                for (const auto &connecting_path : chooser.all_answers()) {
-                    DEBUG("Path was found");
-                    auto p = path_extend::BidirectionalPath::create(g, connecting_path);
-                    DEBUG("Start vertex: " << g.EdgeStart(p->Front()).int_id());
-                    DEBUG("End vertex: " << g.EdgeEnd(p->Back()).int_id());
-                    DEBUG("Path:");
-                    p->PrintDEBUG();
-                    domain_graph_.AddEdge(v1, v2, false, connecting_path, p->Length() + last_mapping + first_mapping);
-                }
-            }
-            else {
-                DEBUG("Path was not found");
+        VertexId start = g.EdgeEnd(domain_graph_.domain_edges(v1).back());
+        VertexId end = g.EdgeStart(domain_graph_.domain_edges(v2).front());
+        if (start == end) {
+            connection.edges.emplace_back(std::vector<EdgeId>(), last_mapping + first_mapping);
+            return;
+        }
+
+        DEBUG("Trying to find paths from " << start << " to " << end);
+        ProcessPaths(g, min_len, 4000 - last_mapping - first_mapping, start, end, chooser);
+        if (!chooser.answer().empty()) {
+            for (const auto &connecting_path : chooser.all_answers()) {
+                DEBUG("Path was found");
+                DEBUG("Path: " << connecting_path);
+                connection.edges.emplace_back(connecting_path,
+                                              omnigraph::CumulativeLength(g, connecting_path) + last_mapping + first_mapping);
             }
         } else {
-            domain_graph_.AddEdge(v1, v2, false, std::vector<EdgeId>(), last_mapping + first_mapping);
+            DEBUG("Path was not found");
         }
         chooser.reset();
     }
 
-    std::unordered_set<VertexId> VerticesReachedFrom(VertexId start_vertex) {
-        auto bounded_dijkstra = omnigraph::DijkstraHelper<Graph>::CreateBoundedDijkstra(gp_.get<Graph>(),
-                                                                                        4000, 10000);
-        bounded_dijkstra.Run(start_vertex);
-        std::unordered_set<VertexId> res;
-        for (auto entry : bounded_dijkstra.reached())
-            res.insert(entry.first);
-        TRACE("Reached vertices size - " << res.size());
-        return res;
+    //domains starting at the vertex, in the order of domain graph vertices
+    typedef std::unordered_map<VertexId, std::vector<VertexId>> DomainStartIndex;
+
+    DomainStartIndex IndexDomainStarts(const std::vector<VertexId> &domains) const {
+        const auto &g = gp_.get<Graph>();
+        DomainStartIndex index;
+        for (VertexId v : domains)
+            index[g.EdgeStart(domain_graph_.domain_edges(v).front())].push_back(v);
+        return index;
+    }
+
+    std::vector<VertexId> WeakEdgeCandidates(VertexId v1, const DomainStartIndex &domain_starts,
+                                             const std::unordered_map<VertexId, size_t> &order) const {
+        const auto &g = gp_.get<Graph>();
+        auto bounded_dijkstra = omnigraph::DijkstraHelper<Graph>::CreateBoundedDijkstra(g, 4000, 10000);
+        bounded_dijkstra.Run(g.EdgeEnd(domain_graph_.domain_edges(v1).back()));
+        TRACE("Reached vertices size - " << std::distance(bounded_dijkstra.reached_begin(), bounded_dijkstra.reached_end()));
+
+        std::vector<VertexId> candidates;
+        for (const auto &entry : bounded_dijkstra.reached()) {
+            auto it = domain_starts.find(entry.first);
+            if (it == domain_starts.end())
+                continue;
+            for (VertexId v2 : it->second) {
+                if (v1 != v2 &&
+                    domain_graph_.conjugate(v1) != v2 && domain_graph_.GetEdgesBetween(v1, v2).size() == 0 &&
+                    !domain_graph_.HasStrongIncomingEdge(v2) && domain_graph_.NearContigStart(v2))
+                    candidates.push_back(v2);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [&](VertexId a, VertexId b) {
+            return order.at(a) < order.at(b);
+        });
+        return candidates;
     }
 
     void ConstructWeakEdges() {
         const auto &g = gp_.get<Graph>();
 
-        std::set<std::vector<EdgeId>> forbidden_edges;
+        std::vector<VertexId> domains;
         for (VertexId v : domain_graph_.vertices())
-            forbidden_edges.insert(domain_graph_.mapping_path(v).simple_path());
-
-        SetOfForbiddenEdgesPathChooser<Graph> chooser(g, forbidden_edges);
-        size_t current_index = 0;
-        for (VertexId v1 : domain_graph_.vertices()) {
-            if (++current_index % 100 == 0)
-                INFO(current_index << " of " << domain_graph_.size() << " processed.");
+            domains.push_back(v);
+        std::unordered_map<VertexId, size_t> order;
+        for (size_t i = 0; i < domains.size(); ++i)
+            order[domains[i]] = i;
+
+        std::set<std::vector<EdgeId>> forbidden_paths;
+        for (VertexId v : domains)
+            forbidden_paths.insert(domain_graph_.mapping_path(v).simple_path());
+        auto forbidden_ends = SetOfForbiddenEdgesPathChooser<Graph>::IndexForbidden(forbidden_paths);
+        auto domain_starts = IndexDomainStarts(domains);
+
+        std::vector<VertexId> sources;
+        for (VertexId v1 : domains) {
+            if (!domain_graph_.HasStrongEdge(v1) && domain_graph_.NearContigEnd(v1))
+                sources.push_back(v1);
+        }
 
-            if (domain_graph_.HasStrongEdge(v1) || !domain_graph_.NearContigEnd(v1))
-                continue;
+        //connections are searched independently per source, domain graph is only read here
+        std::vector<std::vector<WeakConnection>> connections(sources.size());
+        size_t processed = 0;
+#       pragma omp parallel
+        {
+            SetOfForbiddenEdgesPathChooser<Graph> chooser(g, forbidden_ends);
+#           pragma omp for schedule(dynamic)
+            for (size_t i = 0; i < sources.size(); ++i) {
+                for (VertexId v2 : WeakEdgeCandidates(sources[i], domain_starts, order)) {
+                    connections[i].emplace_back();
+                    FindWeakConnection(sources[i], v2, chooser, connections[i].back());
+                }
 
-            auto reached_vertices = VerticesReachedFrom(g.EdgeEnd(domain_graph_.domain_edges(v1).back()));
+                size_t current;
+#               pragma omp atomic capture
+                current = ++processed;
+                if (current % 100 == 0)
+                    INFO(current << " of " << sources.size() << " processed.");
+            }
+        }
 
-            for (VertexId v2 : domain_graph_.vertices()) {
-                if (reached_vertices.count(g.EdgeStart(domain_graph_.domain_edges(v2).front())) &&
-                    v1 != v2 &&
-                    domain_graph_.conjugate(v1) != v2 &&  domain_graph_.GetEdgesBetween(v1, v2).size() == 0 &&
-                    !domain_graph_.HasStrongIncomingEdge(v2) && domain_graph_.NearContigStart(v2)) {
-                    ConnectWithWeakEdge(v1, v2, chooser);
-                }
+        //edges added earlier (e.g. conjugate ones) suppress the connection, so the order is kept
+        for (size_t i = 0; i < sources.size(); ++i) {
+            VertexId v1 = sources[i];
+            for (const auto &connection : connections[i]) {
+                if (domain_graph_.GetEdgesBetween(v1, connection.to).size() != 0)
+                    continue;
+                for (const auto &edge : connection.edges)
+                    domain_graph_.AddEdge(v1, connection.to, false, edge.first, edge.second);
             }
         }
     }
@@ -201,19 +279,38 @@ private:
         }
     };
 
-    std::pair<int,int> SearchForSubvector(const path_extend::BidirectionalPath &scaffold, const MappingPath<EdgeId> &domain) const {
-        if (domain.size() > scaffold.Size())
+    //positions of the edges in the scaffold
+    typedef std::unordered_map<EdgeId, std::vector<size_t>> EdgePositions;
+
+    const EdgePositions &ScaffoldEdgePositions(const path_extend::BidirectionalPath &scaffold) {
+        auto it = scaffold_positions_.find(scaffold.GetId());
+        if (it != scaffold_positions_.end())
+            return it->second;
+
+        EdgePositions &positions = scaffold_positions_[scaffold.GetId()];
+        for (size_t i = 0; i < scaffold.Size(); ++i)
+            positions[scaffold[i]].push_back(i);
+        return positions;
+    }
+
+    //first occurrence of the domain edges in the scaffold
+    std::pair<int,int> SearchForSubvector(const path_extend::BidirectionalPath &scaffold, const MappingPath<EdgeId> &domain) {
+        if (domain.size() == 0 || domain.size() > scaffold.Size())
             return { -1, -1 };
         scaffold.PrintDEBUG();
         DEBUG(domain.simple_path());
-        for (size_t i = 0; i < scaffold.Size() - domain.size() + 1; ++i) {
-            for (size_t j = 0; j < domain.size(); ++j) {
-                if (scaffold[i + j] != domain[j].first)
+        const auto &positions = ScaffoldEdgePositions(scaffold);
+        auto it = positions.find(domain[0].first);
+        if (it != positions.end()) {
+            for (size_t i : it->second) {
+                if (i + domain.size() > scaffold.Size())
                     break;
-
-                if (j == domain.size() - 1) {
-                    DEBUG( int(i) << " " << int(i+j) );
-                    return { int(i), int(i+j) };
+                size_t j = 1;
+                while (j < domain.size() && scaffold[i + j] == domain[j].first)
+                    ++j;
+                if (j == domain.size()) {
+                    DEBUG( int(i) << " " << int(i+j-1) );
+                    return { int(i), int(i+j-1) };
                 }
             }
         }
@@ -221,7 +318,7 @@ private:
         return { -1,-1 };
     }
 
-    std::pair<int,int> FindMappingToPath(const path_extend::BidirectionalPath &scaffold, const MappingPath<EdgeId> &domain, std::vector<EdgeId> &edges) const {
+    std::pair<int,int> FindMappingToPath(const path_extend::BidirectionalPath &scaffold, const MappingPath<EdgeId> &domain, std::vector<EdgeId> &edges) {
         auto res = SearchForSubvector(scaffold, domain);
         if (res.first == -1) {
             return std::make_pair<int,int>(-1,-1);
@@ -331,14 +428,14 @@ private:
 
         std::set<VertexId> removed_vertices;
 
-        for (auto p : mappings_for_path) {
+        for (const auto &p : mappings_for_path) {
             DEBUG("Processing path " << p.first);
             if (from_id_to_path[p.first]->IsCanonical())
                 continue;
 
             std::pair<std::pair<int, int>, std::pair<VertexId, std::vector<EdgeId>>> prev(std::make_pair(-1, -1), std::make_pair(VertexId(0), std::vector<EdgeId>()));
 
-            for (auto &external_p : p.second) { // std::pair<std::pair<int, int>, std::vector<std::pair<VertexId, std::vector<EdgeId>>
+            for (const auto &external_p : p.second) { // std::pair<std::pair<int, int>, std::vector<std::pair<VertexId, std::vector<EdgeId>>
                 for (const auto& imaps : external_p.second) {
                     auto maps = std::make_pair(external_p.first, imaps);
                     DEBUG("Processing mapping " << maps.second.first);
@@ -430,6 +527,7 @@ private:
 
     graph_pack::GraphPack &gp_;
     nrps::DomainGraph domain_graph_;
+    std::unordered_map<size_t, EdgePositions> scaffold_positions_;
     DECL_LOGGER("DomainGraphConstruction");
 };
 
@@ -373,6 +373,14 @@ private:
                 conjugate_fix.insert(e);
         }
 
+        // Splits and glues below would otherwise rewrite the index entries of all the k-mers of the edges.
+        // After Compact the original k-mers are looked up exactly as with the immediate updates. The corrected
+        // ones are not among the keys of the k-mer free index, they share the slots of other k-mers and
+        // whether they are found depends on the order of the updates in both modes.
+        auto &index = gp_.get_mutable<EdgeIndex<Graph>>();
+        if (index.IsAttached())
+            index.Defer();
+
         for (EdgeId e : conjugate_fix) {
             DEBUG("processing edge" << graph_.int_id(e));
 
@@ -385,6 +393,7 @@ private:
             }
         }
         INFO("All edges processed");
+        index.Compact();
         return res;
     }
 
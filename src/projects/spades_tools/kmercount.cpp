@@ -15,6 +15,7 @@
 
 #include "kmer_index/ph_map/kmer_maps.hpp"
 #include "kmer_index/kmer_mph/kmer_index_builder.hpp"
+#include "kmer_index/kmer_mph/kmer_abundance_counter.hpp"
 
 #include "utils/logger/log_writers.hpp"
 #include "utils/segfault_handler.hpp"
@@ -25,6 +26,8 @@
 #include <cstdio>
 #include <cstring>
 #include <cerrno>
+#include <fstream>
+#include <limits>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -50,6 +53,7 @@ class ParallelSortingSplitter : public kmers::KMerSortingSplitter<RtSeq> {
 
   std::vector<std::filesystem::path> files_;
   size_t read_buffer_size_;
+  bool counted_;
 
   class BufferFiller {
       size_t processed_;
@@ -86,8 +90,9 @@ class ParallelSortingSplitter : public kmers::KMerSortingSplitter<RtSeq> {
 
   public:
     using kmers::KMerSortingSplitter<RtSeq>::RawKMers;
-    ParallelSortingSplitter(const std::filesystem::path &workdir, unsigned K, size_t read_buffer_size = 0)
-            : KMerSortingSplitter<Seq>(workdir, K), read_buffer_size_(read_buffer_size) {}
+    ParallelSortingSplitter(const std::filesystem::path &workdir, unsigned K, size_t read_buffer_size = 0,
+                            bool counted = false)
+            : KMerSortingSplitter<Seq>(workdir, K), read_buffer_size_(read_buffer_size), counted_(counted) {}
 
     void push_back(const std::filesystem::path &filename) {
         files_.push_back(filename);
@@ -104,7 +109,10 @@ class ParallelSortingSplitter : public kmers::KMerSortingSplitter<RtSeq> {
             while (!irs.eof()) {
                 hammer::ReadProcessor rp(nthreads);
                 rp.Run(irs, filler);
-                DumpBuffers(out);
+                if (counted_)
+                    DumpCountedBuffers(out);
+                else
+                    DumpBuffers(out);
                 VERIFY_MSG(rp.read() == rp.processed(), "Queue unbalanced");
 
                 if (filler.processed() >> n) {
@@ -128,6 +136,13 @@ struct Args {
     std::filesystem::path workdir, dataset;
     size_t read_buffer_size = 536870912;
     std::vector<std::filesystem::path> input;
+    bool counts = false, histogram = false, sorted = false;
+    uint64_t min_count = 1, max_count = std::numeric_limits<uint64_t>::max();
+
+    // Multiplicities are needed, so the counting splitter / merger should be used
+    bool counting() const {
+        return counts || histogram || sorted || min_count > 1 || max_count < std::numeric_limits<uint64_t>::max();
+    }
 };
 }
 
@@ -142,6 +157,11 @@ void process_cmdline(int argc, char **argv, kmer_count::Args &args) {
         (option("-t", "--threads") & integer("value", args.nthreads)) % "# of threads to use",
         (option("-w", "--workdir") & value("dir", workdir)) % "Working directory to use",
         (option("-b", "--bufsize") & integer("value", args.read_buffer_size)) % "Sorting buffer size, per thread",
+        (option("-c", "--counts").set(args.counts)) % "Write k-mer counts along with the k-mers",
+        (option("-s", "--sorted").set(args.sorted)) % "Write k-mers sorted",
+        (option("--histogram").set(args.histogram)) % "Write k-mer abundance histogram",
+        (option("--min-count") & integer("value", args.min_count)) % "Skip k-mers with abundance less than value",
+        (option("--max-count") & integer("value", args.max_count)) % "Skip k-mers with abundance greater than value",
         (option("-h", "--help").set(print_help)) % "Show help",
         opt_values("input files", input)
     );
@@ -167,7 +187,15 @@ void process_cmdline(int argc, char **argv, kmer_count::Args &args) {
                              "\tdata[4] = 0000 -> 00 00 00 00 -> 0x00\n"
                              "\tdata[5] = 0000 -> 00 00 00 00 -> 0x00\n"
                              "\tdata[6] = 0000 -> 00 00 00 00 -> 0x00\n"
-                             "\tdata[7] = 0000 -> 00 00 00 00 -> 0x00\n");
+                             "\tdata[7] = 0000 -> 00 00 00 00 -> 0x00\n\n"
+                             "With --counts every kmer is followed by its count (32-bit unsigned integer, little-endian, "
+                             "saturated). With --sorted kmers are written in lexicographic order of their 64-bit words, "
+                             "so the outputs of different samples "
+                             "for the same K could be merged in one pass. With --min-count / --max-count only kmers "
+                             "with abundance within the given bounds are written.\n\n"
+                             "With --histogram kmer_histogram is written to the working directory additionally: "
+                             "tab-separated abundance and the number of distinct kmers with this abundance per line, "
+                             "all the kmers are taken into account regardless of the count bounds.\n");
     auto result = parse(argc, argv, cli);
     if (!result || print_help) {
         std::cout << help_message;
@@ -206,8 +234,11 @@ int main(int argc, char* argv[]) {
         INFO("K-mer length set to " << args.K);
         INFO("# of threads to use: " << args.nthreads);
 
+        if (args.min_count > args.max_count)
+            FATAL_ERROR("Minimal abundance " << args.min_count << " is greater than maximal one " << args.max_count);
+
         SimplePerfectHashMap index(args.K);
-        ParallelSortingSplitter splitter(args.workdir, args.K, args.read_buffer_size);
+        ParallelSortingSplitter splitter(args.workdir, args.K, args.read_buffer_size, args.counting());
 
         if (args.dataset != "") {
             io::DataSet<> idataset;
@@ -218,11 +249,24 @@ int main(int argc, char* argv[]) {
             for (const auto& s : args.input)
                 splitter.push_back(s);
         }
-        kmers::KMerDiskCounter<RtSeq> counter(args.workdir, std::move(splitter));
-        auto res = counter.CountAll(16, args.nthreads, /* merge */ true);
-        auto final_kmers = res.final_kmers();
         std::filesystem::path outputfile_name = args.workdir / "final_kmers";
-        std::rename(final_kmers->file().c_str(), outputfile_name.c_str());
+        if (args.counting()) {
+            kmers::KMerAbundanceCounter<RtSeq> counter(args.workdir, std::move(splitter));
+            auto res = counter.Count(16, args.nthreads, args.min_count, args.max_count);
+            counter.Write(res, outputfile_name, args.counts, args.sorted);
+            if (args.histogram) {
+                std::filesystem::path histogram_name = args.workdir / "kmer_histogram";
+                std::ofstream os(histogram_name);
+                for (const auto &entry : counter.histogram())
+                    os << entry.first << '\t' << entry.second << '\n';
+                INFO("K-mer abundance histogram saved to " << histogram_name);
+            }
+        } else {
+            kmers::KMerDiskCounter<RtSeq> counter(args.workdir, std::move(splitter));
+            auto res = counter.CountAll(16, args.nthreads, /* merge */ true);
+            auto final_kmers = res.final_kmers();
+            std::rename(final_kmers->file().c_str(), outputfile_name.c_str());
+        }
 
         INFO("K-mer counting done, kmers saved to " << outputfile_name);
     } catch (std::string const &s) {
@@ -0,0 +1,71 @@
+//***************************************************************************
+//* Copyright (c) 2023-2024 SPAdes team
+//* All Rights Reserved
+//* See file LICENSE for details.
+//***************************************************************************
+
+#include "adt/concurrent_dsu.hpp"
+#include "io/kmers/mmapped_reader.hpp"
+#include "utils/filesystem/temporary.hpp"
+#include "utils/logger/logger.hpp"
+#include "utils/logger/log_writers.hpp"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+TEST( DSU, ExtractSets ) {
+    const size_t size = 10000;
+    dsu::ConcurrentDSU dsu(size);
+    std::mt19937 rand(42);
+    std::vector<std::pair<size_t, size_t>> unions;
+    for (size_t i = 0; i < size / 2; ++i)
+        unions.emplace_back(rand() % size, rand() % (i % 10 ? 100 : size));
+#   pragma omp parallel for
+    for (size_t i = 0; i < unions.size(); ++i)
+        dsu.unite(unions[i].first, unions[i].second);
+
+    // Sets in the order of their roots, elements in increasing order
+    std::map<size_t, std::vector<size_t>> by_root;
+    for (size_t x = 0; x < size; ++x)
+        by_root[dsu.find_set(x)].push_back(x);
+    std::vector<std::vector<size_t>> expected;
+    for (auto &entry : by_root)
+        expected.push_back(std::move(entry.second));
+    EXPECT_EQ(dsu.num_sets(), expected.size());
+
+    std::vector<std::vector<size_t>> sets;
+    dsu.get_sets(sets);
+    EXPECT_EQ(expected, sets);
+
+    auto work_dir = fs::tmp::make_temp_dir(std::filesystem::temp_directory_path(), "dsu_test");
+    std::string prefix = work_dir->dir() / "sets";
+    ASSERT_EQ(expected.size(), dsu.extract_to_file(prefix));
+    MMappedRecordReader<size_t> elements(prefix, /* unlink */ true, -1ULL);
+    MMappedRecordReader<size_t> sizes(prefix + ".idx", /* unlink */ true, -1ULL);
+    ASSERT_EQ(size, elements.size());
+    ASSERT_EQ(expected.size(), sizes.size());
+    auto it = elements.begin();
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(expected[i].size(), sizes[i]);
+        EXPECT_EQ(expected[i], std::vector<size_t>(it, it + sizes[i]));
+        it += sizes[i];
+    }
+}
+
+void create_console_logger() {
+    using namespace logging;
+
+    logger *lg = create_logger("");
+    lg->add_writer(std::make_shared<console_writer>());
+    attach_logger(lg);
+}
+
+GTEST_API_ int main(int argc, char **argv) {
+  create_console_logger();
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
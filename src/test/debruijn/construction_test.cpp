@@ -12,12 +12,19 @@
 #include "io/reads/rc_reader_wrapper.hpp"
 #include "io/reads/read_stream_vector.hpp"
 #include "io/reads/vector_reader.hpp"
+#include "kmer_index/kmer_mph/kmer_abundance_counter.hpp"
+#include "kmer_index/kmer_mph/kmer_splitters.hpp"
+#include "kmer_index/ph_map/perfect_hash_map_builder.hpp"
 #include "modules/graph_construction.hpp"
+#include "modules/simplification/compressor.hpp"
 #include "pipeline/graph_pack.hpp" // FIXME: get rid of it
 #include "utils/filesystem/temporary.hpp"
 
 #include <gtest/gtest.h>
 
+#include <fstream>
+#include <map>
+#include <random>
 #include <set>
 #include <vector>
 
@@ -94,6 +101,339 @@ TEST_F( GraphConstruction, TestKmerFreeIndex ) {
     CheckIndex(reads, tmp_folder(), 5);
 }
 
+static std::set<std::string> IndexKeys(const Graph &graph, const EdgeIndex<Graph> &index) {
+    std::set<std::string> keys;
+    for (EdgeId e : graph.edges()) {
+        const Sequence &nucls = graph.EdgeNucls(e);
+        for (size_t i = 0; i + index.k() <= nucls.size(); ++i)
+            keys.insert(RtSeq(index.k(), nucls, i).str());
+    }
+    return keys;
+}
+
+// If keys are given, only these k-mers are looked up
+static void CheckSameLookups(const Graph &graph, const EdgeIndex<Graph> &index, const EdgeIndex<Graph> &expected,
+                             const std::set<std::string> *keys = nullptr) {
+    for (EdgeId e : graph.edges()) {
+        const Sequence &nucls = graph.EdgeNucls(e);
+        for (size_t i = 0; i + index.k() <= nucls.size(); ++i) {
+            RtSeq kmer(index.k(), nucls, i);
+            if (keys && !keys->count(kmer.str()))
+                continue;
+            EXPECT_EQ(expected.contains(kmer), index.contains(kmer));
+            EXPECT_EQ(expected.get(kmer), index.get(kmer));
+        }
+    }
+}
+
+static void CheckSameLookups(const Graph &graph, const EdgeIndex<Graph> &index, const std::filesystem::path &workdir) {
+    EdgeIndex<Graph> fresh(graph, workdir);
+    fresh.Refill();
+    CheckSameLookups(graph, index, fresh);
+}
+
+TEST_F( GraphConstruction, DeferredIndexUpdates ) {
+    const size_t k = 11;
+    std::mt19937 rand(42);
+    const char *nucls = "ACGT";
+    std::string genome;
+    for (size_t i = 0; i < 500; ++i)
+        genome += nucls[rand() % 4];
+    std::vector<std::string> reads;
+    for (size_t i = 0; i < 100; ++i) {
+        size_t start = rand() % (genome.size() - 60);
+        std::string read = genome.substr(start, 30 + rand() % 30);
+        if (i % 10 == 0)
+            read[read.size() / 2] = nucls[(dignucl(read[read.size() / 2]) + 1) % 4];
+        reads.push_back(read);
+    }
+
+    typedef io::VectorReadStream<io::SingleRead> RawStream;
+    graph_pack::GraphPack gp(k, tmp_folder(), 0);
+    auto workdir = fs::tmp::make_temp_dir(gp.workdir(), "tests");
+    io::ReadStreamList<io::SingleRead> streams(io::RCWrap<io::SingleRead>(RawStream(MakeReads(reads))));
+    auto &graph = gp.get_mutable<Graph>();
+    auto &index = gp.get_mutable<EdgeIndex<Graph>>();
+    ConstructGraphWithIndex(config::debruijn_config::construction(), workdir, streams, graph, index);
+    // Maintained the usual way under the same modifications
+    EdgeIndex<Graph> immediate(graph, workdir->dir());
+    immediate.Refill();
+    auto keys = IndexKeys(graph, index);
+
+    index.Defer();
+    std::set<EdgeId> to_split;
+    for (EdgeId e : graph.edges()) {
+        if (graph.length(e) > 1 && !to_split.count(graph.conjugate(e)))
+            to_split.insert(e);
+    }
+    for (EdgeId e : to_split)
+        graph.SplitEdge(e, graph.length(e) / 2);
+    CheckSameLookups(graph, index, workdir->dir());
+
+    omnigraph::CompressAllVertices(graph);
+    CheckSameLookups(graph, index, workdir->dir());
+
+    // The same as mismatch correction does: the mismatch is cut out into a separate edge and glued to the corrected one
+    std::vector<EdgeId> to_correct;
+    for (EdgeId e : graph.canonical_edges()) {
+        if (graph.length(e) > 2 * k + 2 && graph.conjugate(e) != e &&
+            !graph.RelatedVertices(graph.EdgeStart(e), graph.EdgeEnd(e)))
+            to_correct.push_back(e);
+    }
+    size_t glued = 0;
+    for (EdgeId e : to_correct) {
+        size_t position = k + 1 + rand() % (graph.length(e) - 2 * k - 2);
+        EdgeId mismatch = graph.SplitEdge(e, position + 1).first;
+        mismatch = graph.SplitEdge(mismatch, position - k).second;
+        std::string correct = graph.EdgeNucls(mismatch).str();
+        correct[k] = nucls[(dignucl(correct[k]) + 1) % 4];
+        EdgeId correct_edge = graph.AddEdge(graph.EdgeStart(mismatch), graph.EdgeEnd(mismatch), Sequence(correct));
+        graph.GlueEdges(mismatch, correct_edge);
+        glued += 1;
+    }
+    EXPECT_GT(glued, 2u);
+    omnigraph::CompressAllVertices(graph);
+    index.Compact();
+    EXPECT_FALSE(index.deferred());
+    // The corrected k-mers are not among the keys of the k-mer free index, their lookups land on the slots
+    // of other k-mers in both modes, so they are found or not depending on the order of the updates
+    CheckSameLookups(graph, index, immediate, &keys);
+}
+
+TEST_F( GraphConstruction, ExtensionIndexFromKPOMers ) {
+    const unsigned k = 7;
+    std::mt19937 rand(42);
+    const char *nucls = "ACGT";
+    std::string genome;
+    for (size_t i = 0; i < 300; ++i)
+        genome += nucls[rand() % 4];
+    std::vector<std::string> reads;
+    for (size_t i = 0; i < 200; ++i) {
+        size_t start = rand() % (genome.size() - 30);
+        reads.push_back(genome.substr(start, 10 + rand() % 20));
+    }
+
+    std::map<RtSeq, std::set<char>, RtSeq::less2> outgoing, incoming;
+    for (const auto &read : reads) {
+        for (const Sequence &seq : { Sequence(read), !Sequence(read) }) {
+            for (size_t i = 0; i + k < seq.size(); ++i) {
+                outgoing[seq.Subseq(i, i + k).start<RtSeq>(k)].insert(seq[i + k]);
+                incoming[seq.Subseq(i + 1, i + k + 1).start<RtSeq>(k)].insert(seq[i]);
+            }
+        }
+    }
+
+    typedef io::VectorReadStream<io::SingleRead> RawStream;
+    io::ReadStreamList<io::SingleRead> streams(io::RCWrap<io::SingleRead>(RawStream(MakeReads(reads))));
+    kmers::DeBruijnExtensionIndex<> index(k);
+    kmers::DeBruijnExtensionIndexBuilder().BuildExtensionIndexFromStream(fs::tmp::make_temp_dir(tmp_folder(), "tests"),
+                                                                         index, streams);
+
+    std::set<RtSeq, RtSeq::less2> kmers;
+    for (const auto &entry : outgoing)
+        kmers.insert(entry.first);
+    for (const auto &entry : incoming)
+        kmers.insert(entry.first);
+    size_t canonical = 0;
+    for (const RtSeq &kmer : kmers) {
+        canonical += kmer.IsMinimal();
+        auto kwh = index.ConstructKWH(kmer);
+        ASSERT_TRUE(index.valid(kwh));
+        EXPECT_EQ(outgoing[kmer].size(), index.OutgoingEdgeCount(kwh));
+        EXPECT_EQ(incoming[kmer].size(), index.IncomingEdgeCount(kwh));
+        for (char c : outgoing[kmer])
+            EXPECT_TRUE(index.CheckOutgoing(kwh, c));
+        for (char c : incoming[kmer])
+            EXPECT_TRUE(index.CheckIncoming(kwh, c));
+    }
+    EXPECT_EQ(canonical, index.size());
+
+    size_t iterated = 0;
+    for (auto &it : index.kmer_begin(3)) {
+        for (; it.good(); ++it)
+            iterated += 1;
+    }
+    EXPECT_EQ(index.size(), iterated);
+}
+
+namespace {
+
+class CountedVectorSplitter : public kmers::KMerSortingSplitter<RtSeq> {
+    std::vector<RtSeq> kmers_;
+
+  public:
+    CountedVectorSplitter(const std::filesystem::path &work_dir, unsigned k, std::vector<RtSeq> kmers)
+            : KMerSortingSplitter<RtSeq>(work_dir, k), kmers_(std::move(kmers)) {}
+
+    RawKMers Split(size_t num_files, unsigned) override {
+        auto out = PrepareBuffers(num_files, 1, 1 << 20);
+        for (size_t i = 0; i < kmers_.size(); ++i) {
+            push_back_internal(kmers_[i], 0);
+            // Small runs, so the occurrences of a k-mer are spread over several of them
+            if (i % 1000 == 999)
+                DumpCountedBuffers(out);
+        }
+        DumpCountedBuffers(out);
+        ClearBuffers();
+
+        return out;
+    }
+};
+
+}
+
+TEST_F( GraphConstruction, KMerAbundanceCounter ) {
+    const unsigned k = 21;
+    const uint64_t min_count = 2, max_count = 20;
+    std::mt19937 rand(42);
+    const char *nucls = "ACGT";
+    std::vector<RtSeq> pool;
+    for (size_t i = 0; i < 2000; ++i) {
+        std::string kmer;
+        for (size_t j = 0; j < k; ++j)
+            kmer += nucls[rand() % 4];
+        pool.push_back(RtSeq(k, kmer.c_str()));
+    }
+
+    std::vector<RtSeq> kmers;
+    std::map<RtSeq, uint64_t, RtSeq::less2> counts;
+    for (const RtSeq &kmer : pool) {
+        size_t count = 1 + rand() % (rand() % 4 ? 5 : 40);
+        kmers.insert(kmers.end(), count, kmer);
+        counts[kmer] += count;
+    }
+    std::shuffle(kmers.begin(), kmers.end(), rand);
+
+    typedef std::vector<uint64_t> KMerWords;
+    typedef std::vector<std::pair<KMerWords, uint64_t>> Counted;
+    std::map<uint64_t, size_t> histogram;
+    std::map<KMerWords, uint64_t> expected;
+    for (const auto &entry : counts) {
+        histogram[entry.second] += 1;
+        if (entry.second >= min_count && entry.second <= max_count)
+            expected[KMerWords(entry.first.data(), entry.first.data() + RtSeq::GetDataSize(k))] = entry.second;
+    }
+
+    auto workdir = fs::tmp::make_temp_dir(tmp_folder(), "tests");
+    kmers::KMerAbundanceCounter<RtSeq> counter(workdir, CountedVectorSplitter(workdir->dir(), k, kmers));
+    auto buckets = counter.Count(8, 2, min_count, max_count);
+    EXPECT_EQ(histogram, counter.histogram());
+
+    // k-mer words followed by the 32-bit count
+    auto read = [&](bool sorted) {
+        std::filesystem::path file = workdir->dir() / "kmers";
+        size_t total = counter.Write(buckets, file, /* counts */ true, sorted);
+        std::ifstream is(file, std::ios::binary);
+        Counted res;
+        KMerWords kmer(RtSeq::GetDataSize(k));
+        uint32_t count;
+        while (is.read((char*)kmer.data(), kmer.size() * sizeof(uint64_t)) && is.read((char*)&count, sizeof(count)))
+            res.emplace_back(kmer, count);
+        EXPECT_EQ(total, res.size());
+        return res;
+    };
+
+    auto sorted = read(true);
+    EXPECT_EQ(Counted(expected.begin(), expected.end()), sorted);
+    auto unsorted = read(false);
+    EXPECT_EQ(expected, (std::map<KMerWords, uint64_t>(unsorted.begin(), unsorted.end())));
+    EXPECT_EQ(expected.size(), unsorted.size());
+}
+
+TEST_F( GraphConstruction, ArrangeStoredKMersOutOfCore ) {
+    const unsigned k = 21;
+    std::mt19937 rand(42);
+    const char *nucls = "ACGT";
+    std::vector<std::string> reads;
+    for (size_t i = 0; i < 300; ++i) {
+        std::string read;
+        for (size_t j = 0; j < 1000; ++j)
+            read += nucls[rand() % 4];
+        reads.push_back(read);
+    }
+
+    typedef io::VectorReadStream<io::SingleRead> RawStream;
+    typedef kmers::KeyStoringMap<RtSeq, uint32_t> Index;
+    typedef kmers::DeBruijnReadKMerSplitter<io::SingleRead, kmers::StoringTypeFilter<kmers::SimpleStoring>> Splitter;
+    auto workdir = fs::tmp::make_temp_dir(tmp_folder(), "tests");
+    auto build = [&](Index &index, size_t arrange_mem_limit) {
+        io::ReadStreamList<io::SingleRead> streams(io::RCWrap<io::SingleRead>(RawStream(MakeReads(reads))));
+        kmers::KMerDiskCounter<RtSeq> counter(workdir, Splitter(workdir, k, streams));
+        kmers::KeyStoringIndexBuilder(arrange_mem_limit).BuildIndex(index, counter, 16, 1);
+    };
+
+    Index in_core(k), out_of_core(k);
+    build(in_core, 0);
+    // Every range of slots is 1 << 16 k-mers at least, so several ranges are spilled
+    build(out_of_core, 1);
+    ASSERT_GT(out_of_core.size(), 4u << 16);
+    ASSERT_EQ(in_core.size(), out_of_core.size());
+
+    size_t idx = 0;
+    for (auto it = out_of_core.kmer_begin(), jt = in_core.kmer_begin(); it != out_of_core.kmer_end(); ++it, ++jt, ++idx) {
+        RtSeq kmer = Index::traits_t::raw_create()(k, *it);
+        ASSERT_EQ(Index::traits_t::raw_create()(k, *jt), kmer);
+        auto kwh = out_of_core.ConstructKWH(kmer);
+        ASSERT_EQ(idx, kwh.idx());
+        ASSERT_TRUE(out_of_core.valid(kwh));
+    }
+    EXPECT_EQ(out_of_core.size(), idx);
+}
+
+TEST_F( GraphConstruction, KeyStoringMapFingerprints ) {
+    const unsigned k = 21;
+    std::mt19937 rand(42);
+    const char *nucls = "ACGT";
+    auto random_seq = [&](size_t len) {
+        std::string seq;
+        for (size_t j = 0; j < len; ++j)
+            seq += nucls[rand() % 4];
+        return seq;
+    };
+    std::vector<std::string> reads;
+    for (size_t i = 0; i < 300; ++i)
+        reads.push_back(random_seq(1000));
+
+    typedef io::VectorReadStream<io::SingleRead> RawStream;
+    typedef kmers::KeyStoringMap<RtSeq, uint32_t> Index;
+    typedef kmers::DeBruijnReadKMerSplitter<io::SingleRead, kmers::StoringTypeFilter<kmers::SimpleStoring>> Splitter;
+    auto workdir = fs::tmp::make_temp_dir(tmp_folder(), "tests");
+    auto build = [&](Index &index) {
+        io::ReadStreamList<io::SingleRead> streams(io::RCWrap<io::SingleRead>(RawStream(MakeReads(reads))));
+        kmers::KMerDiskCounter<RtSeq> counter(workdir, Splitter(workdir, k, streams));
+        kmers::KeyStoringIndexBuilder().BuildIndex(index, counter, 16, 1);
+    };
+
+    Index plain(k), fingerprinted(k, /* use_fingerprints */ true);
+    build(plain);
+    build(fingerprinted);
+    ASSERT_EQ(plain.size(), fingerprinted.size());
+
+    // Members together with their neighbours (mostly non-members) and random k-mers
+    std::vector<RtSeq> queries;
+    for (const auto &read : reads) {
+        Sequence seq(read);
+        for (size_t i = 0; i + k <= seq.size(); i += 7)
+            queries.push_back(seq.Subseq(i, i + k).start<RtSeq>(k));
+    }
+    for (size_t i = 0; i < 100000; ++i)
+        queries.push_back(RtSeq(k, random_seq(k).c_str()));
+
+    size_t members = 0;
+    for (const RtSeq &kmer : queries) {
+        auto kwh = plain.ConstructKWH(kmer), fkwh = fingerprinted.ConstructKWH(kmer);
+        bool valid = plain.valid(kwh);
+        members += valid;
+        ASSERT_EQ(valid, fingerprinted.valid(fkwh)) << kmer;
+        ASSERT_EQ(plain.NextEdgeCount(kwh), fingerprinted.NextEdgeCount(fkwh)) << kmer;
+        ASSERT_EQ(plain.RivalEdgeCount(kwh), fingerprinted.RivalEdgeCount(fkwh)) << kmer;
+        if (valid)
+            ASSERT_EQ(plain.true_kmer(kwh), fingerprinted.true_kmer(fkwh));
+    }
+    EXPECT_GT(members, 0u);
+    EXPECT_LT(members, queries.size());
+}
+
 TEST_F( GraphConstruction, SimpleTestEarlyPairedInfo ) {
     std::vector<MyPairedRead> paired_reads = {{"CCCAC", "CCACG"}, {"ACCAC", "CCACA"}};
     std::vector<MyEdge> edges = {"CCCA", "ACCA", "CCAC", "CACG", "CACA"};
@@ -8,6 +8,7 @@
 #include "graphio.hpp"
 
 #include "alignment/pacbio/g_aligner.hpp"
+#include "alignment/pacbio/pac_index.hpp"
 #include "assembly_graph/core/graph.hpp"
 #include "configs/config_struct.hpp"
 #include "edlib/edlib.h"
@@ -17,6 +18,8 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+
 using namespace debruijn_graph;
 
 TEST(GraphAligner, EdlibSHWFULLTest) {
@@ -195,3 +198,132 @@ TEST(GraphAligner, DijkstraGrowEndsTest ) {
     int score = ends_filler.edit_distance();
     EXPECT_EQ(ideal_score, score);
 }
+
+namespace {
+
+typedef sensitive_aligner::PacBioMappingIndex PacBioMappingIndex;
+
+// The former implementation of PacBioMappingIndex::GetRangedColors with the consistency of all the pairs precomputed
+std::vector<int> DenseRangedColors(const PacBioMappingIndex &index, const PacBioMappingIndex::RangeSet &mapping_descr) {
+    const int UNDEF_COLOR = static_cast<int>(sensitive_aligner::InvalidColors::UNDEF_COLOR);
+    const int DELETED_COLOR = static_cast<int>(sensitive_aligner::InvalidColors::DELETED_COLOR);
+    std::vector<sensitive_aligner::QualityRange> ranges(mapping_descr.begin(), mapping_descr.end());
+    size_t len = ranges.size();
+    std::vector<int> colors(len, UNDEF_COLOR);
+    std::vector<double> cluster_size(len);
+    for (size_t i = 0; i < len; ++i)
+        cluster_size[i] = ranges[i].size * ranges[i].quality;
+
+    std::vector<std::vector<bool>> cons_table(len, std::vector<bool>(len, false));
+    for (size_t i = 0; i < len; ++i) {
+        for (size_t j = i + 1; j < len; ++j)
+            cons_table[i][j] = index.IsConsistent(ranges[i], ranges[j]);
+    }
+
+    std::vector<double> max_size(len);
+    std::vector<size_t> prev(len);
+    while (true) {
+        for (size_t i = 0; i < len; ++i) {
+            max_size[i] = 0;
+            prev[i] = size_t(-1);
+        }
+        for (size_t i = 0; i < len; ++i) {
+            if (colors[i] != UNDEF_COLOR) continue;
+            max_size[i] = cluster_size[i];
+            for (size_t j = 0; j < i; j++) {
+                if (colors[j] != -1) continue;
+                if (cons_table[j][i] && math::ls(max_size[i], cluster_size[i] + max_size[j])) {
+                    max_size[i] = max_size[j] + cluster_size[i];
+                    prev[i] = j;
+                }
+            }
+        }
+        double maxx = 0;
+        int maxi = -1;
+        for (size_t j = 0; j < len; j++) {
+            if (math::gr(max_size[j], maxx)) {
+                maxx = max_size[j];
+                maxi = int(j);
+            }
+        }
+        if (maxi == -1)
+            break;
+        int cur_color = maxi;
+        colors[maxi] = cur_color;
+        int real_maxi = maxi, min_i = maxi;
+        while (prev[maxi] != -1ul) {
+            min_i = maxi;
+            maxi = int(prev[maxi]);
+            colors[maxi] = cur_color;
+        }
+        while (real_maxi >= min_i) {
+            if (colors[real_maxi] == UNDEF_COLOR)
+                colors[real_maxi] = DELETED_COLOR;
+            real_maxi--;
+        }
+    }
+    return colors;
+}
+
+// Anchors of a chimeric read: several random walks along the graph, each with a few anchors
+// on its edges (sometimes several on the same edge), and some spurious anchors on random edges
+PacBioMappingIndex::RangeSet RandomAnchors(const Graph &g, const std::vector<EdgeId> &edges, std::mt19937 &rand) {
+    PacBioMappingIndex::RangeSet res;
+    auto add = [&](EdgeId e, size_t read_pos) {
+        size_t edge_len = g.length(e);
+        size_t start = rand() % edge_len, end = std::min(edge_len, start + 1 + rand() % 2000);
+        double quality = 0.5 + 0.5 * double(rand() % 100) / 100.;
+        res.insert(sensitive_aligner::QualityRange(e, start, end, read_pos + start,
+                                                   read_pos + start + (end - start) * (90 + rand() % 20) / 100 + 1,
+                                                   quality));
+    };
+
+    size_t read_pos = 0;
+    for (size_t walks = 1 + rand() % 3; walks > 0; --walks) {
+        EdgeId e = edges[rand() % edges.size()];
+        for (size_t steps = 1 + rand() % 15; steps > 0; --steps) {
+            for (size_t anchors = rand() % 3; anchors > 0; --anchors)
+                add(e, read_pos);
+            read_pos += g.length(e);
+            if (g.OutgoingEdgeCount(g.EdgeEnd(e)) == 0)
+                break;
+            auto out = g.OutgoingEdges(g.EdgeEnd(e));
+            e = *std::next(out.begin(), rand() % g.OutgoingEdgeCount(g.EdgeEnd(e)));
+        }
+        read_pos += rand() % 5000;
+    }
+    for (size_t spurious = rand() % 8; spurious > 0; --spurious)
+        add(edges[rand() % edges.size()], rand() % (read_pos + 1));
+    return res;
+}
+
+}
+
+TEST(GraphAligner, SparseChainingSameAsDense) {
+    size_t K = 55;
+    Graph g(K);
+    graphio::ScanBasicGraph("./src/test/debruijn/graph_fragments/ecoli_400k/distance_estimation", g);
+    std::vector<EdgeId> edges(g.edges().begin(), g.edges().end());
+
+    std::mt19937 rand(42);
+    size_t chains = 0;
+    for (size_t max_path : {500, 3000, 15000}) {
+        auto pb = InitializePacBioProcessor();
+        pb.max_path_in_dijkstra = max_path;
+        PacBioMappingIndex index(g, pb, alignment::BWAIndex::AlignmentMode::PacBio);
+        for (size_t i = 0; i < 40; ++i) {
+            auto anchors = RandomAnchors(g, edges, rand);
+            std::vector<int> expected = DenseRangedColors(index, anchors);
+            auto colored = index.GetRangedColors(anchors);
+            ASSERT_EQ(expected.size(), colored.size());
+            std::vector<int> colors;
+            for (const auto &range : colored)
+                colors.push_back(range.second);
+            EXPECT_EQ(expected, colors) << "max_path_in_dijkstra " << max_path << ", set " << i;
+            // Chains of several anchors are the interesting case
+            for (size_t j = 0; j < colors.size(); ++j)
+                chains += colors[j] >= 0 && size_t(colors[j]) != j;
+        }
+    }
+    EXPECT_GT(chains, 0u);
+}
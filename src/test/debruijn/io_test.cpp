@@ -14,8 +14,11 @@
 #include "io/binary/paired_index.hpp"
 #include "io/graph/gfa_reader.hpp"
 #include "io/graph/gfa_writer.hpp"
+#include "io/reads/coverage_filtering_read_wrapper.hpp"
 
+#include <algorithm>
 #include <filesystem>
+#include <random>
 #include <gtest/gtest.h>
 
 using namespace debruijn_graph;
@@ -152,3 +155,81 @@ TEST(Io, GFADBG) {
     //fixme support 0-in-2-out DBG vertices in GFAWriter
 //    CheckGFAInOut("src/test/debruijn/graph_fragments/topology_ec/big_bad", "big_bad", gfa_out_base);
 }
+
+namespace {
+
+struct MultiplicityCollector {
+    const kmers::CQFKmerFilter &cqf;
+    std::vector<unsigned> mlts;
+
+    void ProcessKmer(const RtSeq &/*kmer*/, uint64_t hash) {
+        mlts.push_back(unsigned(cqf.lookup(hash)));
+    }
+};
+
+}
+
+TEST(Io, CoverageFilter) {
+    typedef rolling_hash::SymmetricCyclicHash<> SeqHasher;
+    const unsigned k = 11;
+    std::mt19937 rand(17);
+    const char *nucls = "ACGT";
+    auto random_seq = [&](size_t len) {
+        std::string s;
+        for (size_t i = 0; i < len; ++i)
+            s += nucls[rand() % 4];
+        return Sequence(s);
+    };
+
+    // Genome parts with different coverage
+    std::vector<Sequence> genome;
+    for (size_t i = 0; i < 10; ++i)
+        genome.push_back(random_seq(200));
+
+    SeqHasher hasher(k);
+    kmers::CQFKmerFilter cqf(100000);
+    MultiplicityCollector filler{cqf, {}};
+    kmers::KmerSequenceProcessor<SeqHasher, MultiplicityCollector> processor(hasher, filler);
+    for (size_t i = 0; i < genome.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            RtSeq kmer = genome[i].start<RtSeq>(k) >> 'A';
+            auto hash = hasher.hash(kmer);
+            for (size_t pos = k - 1; pos < genome[i].size(); ++pos) {
+                hash = hasher.hash_update(hash, kmer[0], genome[i][pos]);
+                kmer <<= genome[i][pos];
+                cqf.add((uint64_t) hash);
+            }
+        }
+    }
+
+    auto median = [&](const Sequence &s) -> unsigned {
+        if (s.size() < k)
+            return 0;
+        filler.mlts.clear();
+        processor.ProcessSequence(s, k);
+        size_t n = filler.mlts.size() / 2;
+        std::nth_element(filler.mlts.begin(), filler.mlts.begin() + n, filler.mlts.end());
+        return filler.mlts[n];
+    };
+
+    // Reads overlap the parts of different coverage and the random sequence
+    auto random_read = [&]() {
+        size_t part = rand() % (genome.size() - 1);
+        Sequence joined = genome[part] + genome[part + 1] + random_seq(50);
+        size_t len = 5 + rand() % 100;
+        size_t start = rand() % (joined.size() - len);
+        return joined.Subseq(start, start + len);
+    };
+
+    for (unsigned thr = 0; thr < 8; ++thr) {
+        io::CoverageFilter<io::SingleRead, SeqHasher> single_filter(k, hasher, cqf, thr);
+        io::CoverageFilter<io::PairedRead, SeqHasher> paired_filter(k, hasher, cqf, thr);
+        for (size_t i = 0; i < 200; ++i) {
+            Sequence left = random_read(), right = random_read();
+            io::SingleRead read("read", left.str());
+            EXPECT_EQ(median(left) >= thr, single_filter(read));
+            io::PairedRead pair(read, io::SingleRead("mate", right.str()), 0);
+            EXPECT_EQ(median(left) >= thr || median(right) >= thr, paired_filter(pair));
+        }
+    }
+}
@@ -250,6 +250,32 @@ TEST(PairedInfo, Remove) {
     EXPECT_FALSE(pi.contains(13, 2));
 }
 
+TEST(PairedInfo, RemoveHistogram) {
+    MockGraph graph;
+    MockClIndex pi(graph);
+    pi.Add(1, 8, {1, 1, 0});
+    pi.Add(1, 3, {2, 2, 0});
+    pi.Add(1, 3, {3, 1, 0});
+    pi.Add(1, 3, {4, 1, 0});
+    EXPECT_EQ(pi.size(), 8);
+    HistogramWithWeight to_remove;
+    to_remove.insert({2, 1, 0});
+    to_remove.insert({4, 1, 0});
+    to_remove.insert({5, 1, 0});
+    EXPECT_EQ(pi.Remove(1, 3, to_remove), 4);
+    EXPECT_EQ(pi.size(), 4);
+    HistogramWithWeight test1;
+    test1.insert({3, 1, 0});
+    EXPECT_EQ(pi.Get(1, 3).Unwrap(), test1);
+    //Check for auto-prune
+    test1.insert({7, 1, 0});
+    EXPECT_EQ(pi.Remove(1, 3, test1), 2);
+    EXPECT_FALSE(pi.contains(1, 3));
+    EXPECT_FALSE(pi.contains(4, 2));
+    EXPECT_EQ(pi.Remove(1, 3, test1), 0);
+    EXPECT_EQ(pi.size(), 2);
+}
+
 TEST(PairedInfo, UnexistingEdges) {
     //Check that accessing missing edges doesn't broke index
     MockGraph graph;
@@ -6,6 +6,7 @@
 //***************************************************************************
 
 
+#include "modules/path_extend/path_occurrence_index.hpp"
 #include "modules/path_extend/path_visualizer.hpp"
 #include "modules/path_extend/pe_utils.hpp"
 
@@ -13,6 +14,8 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+
 using namespace path_extend;
 using namespace debruijn_graph;
 
@@ -756,3 +759,113 @@ TEST( PathExtend, BidirectionalPathLoopDetector ) {
     EXPECT_EQ(path1->Size(), 12);
     EXPECT_EQ(path1->Back(), e7);
 }
+
+namespace {
+
+std::vector<EdgeId> RandomWalk(const Graph &g, std::vector<EdgeId> edges, size_t max_size, std::mt19937 &rnd) {
+    while (edges.size() < max_size) {
+        auto out = g.OutgoingEdges(g.EdgeEnd(edges.back()));
+        std::vector<EdgeId> next(out.begin(), out.end());
+        if (next.empty())
+            break;
+        edges.push_back(next[rnd() % next.size()]);
+    }
+    return edges;
+}
+
+}
+
+TEST( PathExtend, PathOccurrenceIndexMatches ) {
+    Graph g(13);
+    ASSERT_TRUE(graphio::ScanBasicGraph("./src/test/debruijn/graph_fragments/path_extend/distance_estimation", g));
+    std::vector<EdgeId> all_edges;
+    for (EdgeId e : g.edges())
+        all_edges.push_back(e);
+    std::mt19937 rnd(239);
+
+    PathContainer reads;
+    for (size_t i = 0; i < 200; ++i) {
+        auto edges = RandomWalk(g, { all_edges[rnd() % all_edges.size()] }, 2 + rnd() % 15, rnd);
+        reads.Add(BidirectionalPath::create(g, edges));
+    }
+    GraphCoverageMap cov_map(g, reads);
+    PathOccurrenceIndex index(cov_map);
+
+    std::vector<PathOccurrenceIndex::OccurrenceId> matches;
+    for (size_t i = 0; i < 500; ++i) {
+        const BidirectionalPath &read = reads.Get(rnd() % reads.size());
+        size_t from = rnd() % read.Size();
+        std::vector<EdgeId> prefix;
+        for (size_t j = from; j < read.Size(); ++j)
+            prefix.push_back(read[j]);
+        auto path = BidirectionalPath::create(g, RandomWalk(g, prefix, prefix.size() + rnd() % 4, rnd));
+
+        for (size_t end_pos = 0; end_pos < path->Size(); ++end_pos) {
+            std::vector<std::pair<size_t, size_t>> expected;
+            for (const auto *covering : cov_map.GetCoveringPaths(path->At(end_pos))) {
+                for (size_t pos : covering->FindAll(path->At(end_pos))) {
+                    if (pos + 1 < covering->Size() && EqualBegins(*path, end_pos, *covering, pos, false))
+                        expected.emplace_back(covering->GetId(), pos);
+                }
+            }
+
+            index.Matches(*path, end_pos, matches);
+            std::vector<std::pair<size_t, size_t>> found;
+            for (auto id : matches)
+                found.emplace_back(index[id].path->GetId(), index[id].pos);
+            EXPECT_EQ(expected, found);
+        }
+    }
+}
+
+TEST( PathExtend, BidirectionalPathRepeatQueries ) {
+    Graph g(13);
+    ASSERT_TRUE(graphio::ScanBasicGraph("./src/test/debruijn/graph_fragments/path_extend/distance_estimation", g));
+    std::vector<EdgeId> alphabet;
+    for (EdgeId e : g.edges()) {
+        alphabet.push_back(e);
+        if (alphabet.size() == 3)
+            break;
+    }
+    std::mt19937 rnd(42);
+
+    auto path = BidirectionalPath::create(g);
+    for (size_t step = 0; step < 1000; ++step) {
+        size_t op = rnd() % 5;
+        EdgeId e = alphabet[rnd() % alphabet.size()];
+        Gap gap(path->Empty() ? 0 : int(rnd() % 5));
+        if (path->Size() < 2 || (op <= 1 && path->Size() < 30))
+            path->PushBack(e, gap);
+        else if (op == 2 && path->Size() < 30)
+            path->BackEdgeAdded(e, *path, gap);
+        else if (op == 3)
+            path->PopBack();
+        else
+            path->BackEdgeRemoved(e, *path);
+
+        size_t n = path->Size();
+        size_t length = 0;
+        for (size_t i = n; i-- > 0; ) {
+            length += g.length(path->At(i)) + (i + 1 < n ? path->GapAt(i + 1).gap : 0);
+            ASSERT_EQ(length, path->LengthAt(i));
+        }
+
+        for (size_t from = 0; from < n; ++from)
+            ASSERT_EQ(path->FindFirst(path->SubPath(from)), (int) path->FindFirstOccurrenceOfTail(from));
+
+        for (size_t len = 1; len <= std::min<size_t>(n, 4); ++len) {
+            auto sample = path->SubPath(rnd() % (n - len + 1)).SubPath(0, len);
+            sample.PushBack(alphabet[rnd() % alphabet.size()]);
+            ASSERT_EQ(path->FindLast(sample), path->FindLastOccurrence(sample));
+            sample.PopBack();
+            ASSERT_EQ(path->FindLast(sample), path->FindLastOccurrence(sample));
+            ASSERT_EQ(path->FindFirst(sample) != -1, len != 2 || path->ContainsPair(sample[0], sample[1]));
+        }
+
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j) {
+                size_t len = n - std::max(i, j);
+                ASSERT_EQ(path->CompareFrom(i, path->SubPath(j, j + len)), path->EqualSubPaths(i, j, len));
+            }
+    }
+}
@@ -6,15 +6,25 @@
 //***************************************************************************
 
 #include "graphio.hpp"
+#include "test_utils.hpp"
 #include "tmp_folder_fixture.hpp"
 
+#include "alignment/edge_index.hpp"
+#include "io/reads/rc_reader_wrapper.hpp"
+#include "io/reads/read_stream_vector.hpp"
+#include "io/reads/vector_reader.hpp"
+#include "modules/graph_construction.hpp"
 #include "pipeline/graph_pack.hpp"
 #include "stages/simplification_pipeline/graph_simplification.hpp"
 #include "stages/simplification_pipeline/rna_simplification.hpp"
 #include "stages/simplification_pipeline/single_cell_simplification.hpp"
+#include "assembly_graph/paths/path_length_sets.hpp"
+#include "assembly_graph/components/splitters.hpp"
 
 #include <gtest/gtest.h>
 
+#include <random>
+
 using namespace debruijn_graph;
 using namespace debruijn_graph::config;
 
@@ -163,6 +173,94 @@ TEST_F( Simplification,  SimpleBulgeRemovalTest ) {
     EXPECT_EQ(4, g.size());
 }
 
+//Genome with lots of SNP bulges, some of them close enough to interact
+static void ConstructBulgesGraph(graph_pack::GraphPack &gp, size_t genome_length = 300000) {
+    const char *nucls = "ACGT";
+    std::mt19937 rand(42);
+    std::string genome;
+    for (size_t i = 0; i < genome_length; ++i)
+        genome += nucls[rand() % 4];
+
+    std::vector<std::string> reads;
+    for (size_t i = 0; i + 100 <= genome.size(); i += 10)
+        reads.push_back(genome.substr(i, 100));
+    for (size_t pos = 100; pos + 200 < genome.size(); pos += 60 + rand() % 100) {
+        std::string variant = genome.substr(pos - 50, 100);
+        variant[50] = nucls[(dignucl(variant[50]) + 1 + rand() % 3) % 4];
+        if (rand() % 4 == 0)
+            variant[50 + 5 + rand() % 20] = nucls[rand() % 4];
+        for (size_t j = 1 + rand() % 2; j > 0; --j)
+            reads.push_back(variant);
+    }
+
+    typedef io::VectorReadStream<io::SingleRead> RawStream;
+    io::ReadStreamList<io::SingleRead> streams(io::RCWrap<io::SingleRead>(RawStream(test_utils::MakeReads(reads))));
+    ConstructGraphWithCoverage(config::debruijn_config::construction(), fs::tmp::make_temp_dir(gp.workdir(), "tests"),
+                               streams, gp.get_mutable<Graph>(), gp.get_mutable<EdgeIndex<Graph>>(),
+                               gp.get_mutable<omnigraph::FlankingCoverage<Graph>>());
+}
+
+//Sequences with coverages, so that the gluing reaches the coverage handler as well
+static std::vector<std::string> EdgeSequences(const Graph &g, bool with_ids = false) {
+    std::vector<std::string> answer;
+    for (EdgeId e : g.edges()) {
+        std::string s = g.EdgeNucls(e).str() + " " + std::to_string(g.data(e).raw_coverage());
+        answer.push_back(with_ids ? std::to_string(e.int_id()) + " " + s : s);
+    }
+    std::sort(answer.begin(), answer.end());
+    return answer;
+}
+
+//Every k-mer of every edge is found by the index at its position
+static void CheckEdgeIndex(const graph_pack::GraphPack &gp) {
+    const auto &g = gp.get<Graph>();
+    const auto &index = gp.get<EdgeIndex<Graph>>();
+    ASSERT_TRUE(index.IsAttached());
+    for (EdgeId e : g.edges()) {
+        const Sequence &nucls = g.EdgeNucls(e);
+        for (size_t i = 0; i + index.k() <= nucls.size(); ++i)
+            ASSERT_EQ(std::make_pair(e, i), index.get(RtSeq(index.k(), nucls, i)));
+    }
+}
+
+TEST_F( Simplification,  ParallelBulgeRemover ) {
+    const size_t k = 21;
+    graph_pack::GraphPack serial_gp(k, tmp_folder(), 0), parallel_gp(k, tmp_folder(), 0),
+            single_thread_gp(k, tmp_folder(), 0);
+    ConstructBulgesGraph(serial_gp);
+    ConstructBulgesGraph(parallel_gp);
+    ConstructBulgesGraph(single_thread_gp);
+    auto &serial_graph = serial_gp.get_mutable<Graph>();
+    auto &parallel_graph = parallel_gp.get_mutable<Graph>();
+    auto &single_thread_graph = single_thread_gp.get_mutable<Graph>();
+    ASSERT_EQ(EdgeSequences(serial_graph), EdgeSequences(parallel_graph));
+
+    auto info = standard_simplif_relevant_info();
+    info.set_chunk_cnt(4 * omp_get_max_threads());
+    auto br_config = standard_br_config();
+    size_t serial_removed = 0, parallel_removed = 0, single_thread_removed = 0;
+    debruijn::simplification::BRInstance(serial_graph, br_config, info, nullptr,
+                                         [&](EdgeId) { serial_removed += 1; })->Run();
+    br_config.parallel = true;
+    debruijn::simplification::BRInstance(parallel_graph, br_config, info, nullptr,
+                                         [&](EdgeId) { parallel_removed += 1; })->Run();
+    int threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    debruijn::simplification::BRInstance(single_thread_graph, br_config, info, nullptr,
+                                         [&](EdgeId) { single_thread_removed += 1; })->Run();
+    omp_set_num_threads(threads);
+
+    //independent bulges of a buffer are only glued in parallel mode if there are enough of them
+    EXPECT_GT(parallel_removed, 2000u);
+    EXPECT_EQ(serial_removed, parallel_removed);
+    EXPECT_EQ(EdgeSequences(serial_graph), EdgeSequences(parallel_graph));
+    //ids of the new edges are reserved in the order of bulges
+    EXPECT_EQ(single_thread_removed, parallel_removed);
+    EXPECT_EQ(EdgeSequences(single_thread_graph, true), EdgeSequences(parallel_graph, true));
+    CheckEdgeIndex(serial_gp);
+    CheckEdgeIndex(parallel_gp);
+}
+
 TEST_F( Simplification,  TipobulgeTest ) {
     Graph g(55);
     ASSERT_TRUE(graphio::ScanBasicGraph("./src/test/debruijn/graph_fragments/tipobulge/tipobulge", g));
@@ -226,6 +324,143 @@ TEST_F( Simplification,  IterUniquePath ) {
     EXPECT_EQ(16, g.size());
 }
 
+void CheckMultiplicityCounts(const Graph &g, std::shared_ptr<omnigraph::ShortEdgeRegions<Graph>> regions,
+                             size_t uniqueness_length) {
+    omnigraph::MultiplicityCounter<Graph> dfs_counter(g, uniqueness_length, 8);
+    omnigraph::MultiplicityCounter<Graph> region_counter(g, regions, 8);
+    for (EdgeId e : g.edges()) {
+        EXPECT_EQ(dfs_counter.count(e, g.EdgeStart(e)), region_counter.count(e, g.EdgeStart(e)));
+        EXPECT_EQ(dfs_counter.count(e, g.EdgeEnd(e)), region_counter.count(e, g.EdgeEnd(e)));
+    }
+}
+
+TEST_F( Simplification,  MultiplicityCounterRegions ) {
+    for (size_t uniqueness_length : {100, 400, 1500}) {
+        Graph g(55);
+        ASSERT_TRUE(graphio::ScanBasicGraph("./src/test/debruijn/graph_fragments/topology_ec/iter_unique_path", g));
+        auto regions = std::make_shared<omnigraph::ShortEdgeRegions<Graph>>(g, uniqueness_length, 8);
+        CheckMultiplicityCounts(g, regions, uniqueness_length);
+        size_t slots = regions->slots();
+
+        //regions should follow the graph changes
+        omnigraph::EdgeRemover<Graph> edge_remover(g);
+        for (size_t i = 0; i < 10; ++i) {
+            auto it = std::find_if(g.e_begin(), g.e_end(), [&](EdgeId e) {
+                return g.length(e) < uniqueness_length;
+            });
+            if (it == g.e_end())
+                break;
+            edge_remover.DeleteEdge(*it);
+            CheckMultiplicityCounts(g, regions, uniqueness_length);
+            //no vertices are added, so the relabeled regions fit into the released slots
+            EXPECT_EQ(slots, regions->slots());
+        }
+    }
+}
+
+//reference answer by full path enumeration, returns false if enumeration limits were exceeded
+bool MostCoveredAlternativeContains(const Graph &g, EdgeId forbidden_edge, EdgeId compulsory_edge, bool &answer) {
+    omnigraph::MostCoveredSimpleAlternativePathChooser<Graph> path_chooser(g, forbidden_edge);
+    int error_code = omnigraph::ProcessPaths(g, 0, std::numeric_limits<size_t>::max(),
+                                             g.EdgeStart(forbidden_edge), g.EdgeEnd(forbidden_edge), path_chooser);
+    const auto &path = path_chooser.most_covered_path();
+    answer = !path.empty() && math::gr(path_chooser.max_coverage(), 0.) &&
+             (compulsory_edge == EdgeId() ||
+              std::find(path.begin(), path.end(), compulsory_edge) != path.end());
+    return error_code == 0;
+}
+
+//compares pruned search with the full enumeration for e and for the edges incident to its ends,
+//enumeration has to be exhaustive for every query, otherwise pruned search might find more paths
+void CheckAlternativePathSearch(const Graph &g, EdgeId e, omnigraph::AlternativePathSearch<Graph> &search,
+                                size_t &checked, size_t &positive) {
+    auto check = [&](EdgeId forbidden, EdgeId compulsory, bool found) {
+        bool answer;
+        ASSERT_TRUE(MostCoveredAlternativeContains(g, forbidden, compulsory, answer));
+        EXPECT_EQ(answer, found);
+        checked += 1;
+        positive += answer;
+    };
+    check(e, EdgeId(), search.AlternativeExists(e));
+    for (EdgeId f : g.OutgoingEdges(g.EdgeStart(e)))
+        check(f, e, search.BestAlternativeContains(f, e));
+    for (EdgeId f : g.IncomingEdges(g.EdgeEnd(e)))
+        check(f, e, search.BestAlternativeContains(f, e));
+}
+
+TEST_F( Simplification,  AlternativePathSearch ) {
+    std::vector<std::pair<const char *, size_t>> fragments = {
+        {"topology_ec/iter_unique_path", 86}, {"complex_bulge/complex_bulge", 100}, {"tipobulge/tipobulge", 74}};
+    for (const auto &fragment : fragments) {
+        Graph g(55);
+        ASSERT_TRUE(graphio::ScanBasicGraph(graph_fragment_root() + fragment.first, g));
+        omnigraph::AlternativePathSearch<Graph> search(g);
+        size_t checked = 0, positive = 0;
+        for (EdgeId e : g.edges())
+            CheckAlternativePathSearch(g, e, search, checked, positive);
+        EXPECT_EQ(fragment.second, checked);
+    }
+
+    //simple and double mutation bulges of positive coverage
+    graph_pack::GraphPack gp(21, tmp_folder(), 0);
+    ConstructBulgesGraph(gp, 20000);
+    const auto &g = gp.get<Graph>();
+    omnigraph::AlternativePathSearch<Graph> search(g);
+    size_t checked = 0, positive = 0, expected = 0;
+    for (EdgeId e : g.edges())
+        CheckAlternativePathSearch(g, e, search, checked, positive);
+    //every edge is queried itself and once per edge sharing its start or its end
+    for (VertexId v : g.vertices())
+        expected += g.OutgoingEdgeCount(v) * (1 + g.OutgoingEdgeCount(v)) +
+                    g.IncomingEdgeCount(v) * g.IncomingEdgeCount(v);
+    EXPECT_EQ(expected, checked);
+    EXPECT_GT(positive, checked / 4);
+}
+
+TEST_F( Simplification,  PathLengthSets ) {
+    const size_t max_length = 400;
+    for (const char *graph : {"complex_bulge/complex_bulge", "tipobulge/tipobulge"}) {
+        Graph g(55);
+        ASSERT_TRUE(graphio::ScanBasicGraph(graph_fragment_root() + graph, g));
+        omnigraph::PathLengthSets<Graph> path_lengths(g);
+        for (VertexId start : g.vertices()) {
+            path_lengths.Run(start, max_length);
+            for (VertexId end : g.vertices()) {
+                for (size_t min_len = 0; min_len + 70 <= max_length; min_len += 50) {
+                    omnigraph::DistancesLengthsCallback<Graph> callback(g);
+                    if (omnigraph::ProcessPaths(g, min_len, min_len + 70, start, end, callback) != 0)
+                        continue;
+                    std::vector<size_t> lengths;
+                    path_lengths.Lengths(end, min_len, min_len + 70, lengths);
+                    EXPECT_EQ(callback.distances(), lengths);
+                    EXPECT_EQ(!lengths.empty(), path_lengths.Contains(end, min_len, min_len + 70));
+                }
+            }
+        }
+    }
+}
+
+TEST_F( Simplification,  ParallelLongEdgesExclusiveSplitter ) {
+    for (const char *graph : {"complex_bulge/complex_bulge", "big_complex_bulge/big_complex_bulge",
+                              "tipobulge/tipobulge"}) {
+        Graph g(55);
+        ASSERT_TRUE(graphio::ScanBasicGraph(graph_fragment_root() + graph, g));
+        for (size_t bound : {60, 100, 300}) {
+            auto serial = omnigraph::LongEdgesExclusiveSplitter<Graph>(g, bound);
+            auto parallel = omnigraph::ParallelLongEdgesExclusiveSplitter<Graph>(g, bound);
+            while (serial->HasNext()) {
+                ASSERT_TRUE(parallel->HasNext());
+                auto expected = serial->Next(), actual = parallel->Next();
+                EXPECT_EQ(expected.vertices(), actual.vertices());
+                EXPECT_EQ(expected.edges(), actual.edges());
+                EXPECT_EQ(expected.exits(), actual.exits());
+                EXPECT_EQ(expected.entrances(), actual.entrances());
+            }
+            EXPECT_FALSE(parallel->HasNext());
+        }
+    }
+}
+
 //TEST( Simplification,  MFIterUniquePath ) {
 //    Graph g(55);
 //    ASSERT_TRUE(graphio::ScanBasicGraph("./src/test/debruijn/graph_fragments/topology_ec/iter_unique_path", g));
@@ -301,6 +536,100 @@ TEST_F( Simplification,  BigComplexBulge ) {
     EXPECT_EQ(66, graph.size());
 }
 
+//The same as ComplexTipClipper did before parallel candidate search: check every candidate against the current graph
+static std::vector<size_t> SerialClipComplexTips(Graph &g, double relative_coverage,
+                                                 size_t max_edge_len, size_t max_path_len) {
+    std::vector<size_t> removed;
+    omnigraph::ComplexTipFinder<Graph> finder(g, relative_coverage, max_edge_len, max_path_len);
+    omnigraph::ComponentRemover<Graph> remover(g, [&](const std::set<EdgeId> &edges) {
+        for (EdgeId e : edges)
+            removed.push_back(g.int_id(e));
+    });
+    std::vector<VertexId> candidates;
+    for (VertexId v : g) {
+        if (!finder(v).empty())
+            candidates.push_back(v);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (VertexId v : candidates) {
+        if (!g.contains(v))
+            continue;
+        auto component = finder(v);
+        if (!component.empty())
+            remover.DeleteComponent(component.e_begin(), component.e_end());
+    }
+    std::sort(removed.begin(), removed.end());
+    return removed;
+}
+
+//Genome with lots of complex tips (branching sources joining the genome close to each other) and random coverage
+static void ConstructComplexTipsGraph(graph_pack::GraphPack &gp) {
+    const char *nucls = "ACGT";
+    std::mt19937 rand(42);
+    auto random_seq = [&](size_t len) {
+        std::string res;
+        for (size_t i = 0; i < len; ++i)
+            res += nucls[rand() % 4];
+        return res;
+    };
+
+    std::string genome = random_seq(20000);
+    std::vector<std::string> reads;
+    for (size_t i = 0; i + 100 <= genome.size(); i += 50)
+        reads.push_back(genome.substr(i, 100));
+    for (size_t i = 0; i < 200; ++i) {
+        size_t pos = rand() % (genome.size() - 500);
+        std::string tip = random_seq(60 + rand() % 60);
+        reads.push_back(tip + genome.substr(pos, 80));
+        for (size_t j = rand() % 3; j > 0; --j) {
+            size_t branch = 30 + rand() % (tip.size() - 40);
+            reads.push_back(tip.substr(0, branch) + random_seq(20 + rand() % 40) +
+                            genome.substr(pos + rand() % 200, 80));
+        }
+    }
+
+    typedef io::VectorReadStream<io::SingleRead> RawStream;
+    io::ReadStreamList<io::SingleRead> streams(io::RCWrap<io::SingleRead>(RawStream(test_utils::MakeReads(reads))));
+    auto &graph = gp.get_mutable<Graph>();
+    ConstructGraphWithIndex(config::debruijn_config::construction(), fs::tmp::make_temp_dir(gp.workdir(), "tests"),
+                            streams, graph, gp.get_mutable<EdgeIndex<Graph>>());
+    for (EdgeId e : graph.edges()) {
+        if (e <= graph.conjugate(e)) {
+            double cov = double(1 + rand() % 50);
+            graph.coverage_index().SetAvgCoverage(e, cov);
+            graph.coverage_index().SetAvgCoverage(graph.conjugate(e), cov);
+        }
+    }
+}
+
+TEST_F( Simplification,  ParallelComplexTipClipper ) {
+    const double relative_coverage = 2.;
+    const size_t max_edge_len = 200, max_path_len = 300;
+    const size_t k = 21;
+    graph_pack::GraphPack serial_gp(k, tmp_folder(), 0), parallel_gp(k, tmp_folder(), 0);
+    ConstructComplexTipsGraph(serial_gp);
+    ConstructComplexTipsGraph(parallel_gp);
+    auto &serial_graph = serial_gp.get_mutable<Graph>();
+    auto &parallel_graph = parallel_gp.get_mutable<Graph>();
+    ASSERT_EQ(serial_graph.size(), parallel_graph.size());
+
+    std::vector<size_t> expected = SerialClipComplexTips(serial_graph, relative_coverage, max_edge_len, max_path_len);
+
+    std::vector<size_t> removed;
+    omnigraph::ComplexTipClipper<Graph> clipper(parallel_graph, relative_coverage, max_edge_len, max_path_len,
+                                                4 * omp_get_max_threads(), "",
+                                                [&](const std::set<EdgeId> &edges) {
+                                                    for (EdgeId e : edges)
+                                                        removed.push_back(parallel_graph.int_id(e));
+                                                });
+    clipper.Run();
+    std::sort(removed.begin(), removed.end());
+
+    EXPECT_GT(removed.size(), 100u);
+    EXPECT_EQ(expected, removed);
+    EXPECT_EQ(serial_graph.size(), parallel_graph.size());
+}
+
 //Relative coverage removal tests
 
 void TestRelativeCoverageRemover(const std::string &path, const std::string &tmp_folder, size_t graph_size) {
@@ -43,3 +43,42 @@ TEST( Sequence, ReverseComplement ) {
     Sequence s2 = Sequence("ACG");
     EXPECT_EQ("CGT", (!s2).str());
 }
+
+TEST( Sequence, SumOfViews ) {
+    Sequence s("ACGTACGTACGTACGTACGTACGTACGTACGTAACCGGTT");
+    EXPECT_EQ(s.Subseq(3, 37).str() + (!s).Subseq(5).str(),
+              (s.Subseq(3, 37) + (!s).Subseq(5)).str());
+    EXPECT_EQ(s.str() + s.str(), (s + s).str());
+    EXPECT_EQ("", (Sequence("") + Sequence("")).str());
+}
+
+TEST( Sequence, Find ) {
+    Sequence s("TTATTAGGGATACGTACGTACGTACGTACGTACGTACGTACGTTTT");
+    EXPECT_EQ(2, s.find(Sequence("ATTA")));
+    EXPECT_EQ(-1ULL, s.find(Sequence("ATTA"), 3));
+    EXPECT_EQ(11, s.find(Sequence("ACGTACGTACGTACGTACGTACGTACGTACGTTT")));
+    EXPECT_EQ(15, s.find(Sequence("ACGTACGTACGTACGTACGTACGTACGT"), 12));
+    EXPECT_EQ(-1ULL, s.find(Sequence("CCC")));
+    EXPECT_EQ(-1ULL, Sequence("ACG").find(Sequence("ACGT")));
+    EXPECT_EQ(s.size() - 6, (!s).find(!Sequence("TTATTA")));
+}
+
+TEST( Sequence, Compare ) {
+    Sequence s("ACGTACGTACGTACGTACGTACGTACGTACGTAACCGGTT");
+    EXPECT_EQ(Sequence(s.Subseq(5).str()), s.Subseq(5));
+    EXPECT_EQ(Sequence((!s).str()), !s);
+    EXPECT_TRUE(s.Subseq(0, 36) < s);
+    EXPECT_TRUE(Sequence("ACGTACGTACGTACGTACGTACGTACGTACGTAACCGA") < s.Subseq(0, 38));
+    EXPECT_FALSE(s < s.Subseq(0, 36));
+}
+
+TEST( Sequence, Builder ) {
+    Sequence s("ACGTACGTACGTACGTACGTACGTACGTACGTAACCGGTT");
+    SequenceBuilder sb;
+    sb.append(s.Subseq(1, 10)).append(char(3)).append(!s);
+    EXPECT_EQ(s.Subseq(1, 10).str() + "T" + (!s).str(), sb.BuildSequence().str());
+    EXPECT_EQ(sb.BuildSequence().str(), sb.str());
+    EXPECT_EQ('T', nucl(sb[9]));
+    sb.clear();
+    EXPECT_EQ(0, sb.size());
+}